@@ -0,0 +1,32 @@
+#!/bin/bash
+# bench_parse.sh
+# Скорость разбора больших конфигураций: генерирует DAG из N задач
+# (около 100 байт на задачу, до трех зависимостей на предыдущие задачи)
+# и запускает исполнитель с --parse-only.
+# Использование: ./bench_parse.sh [количество_задач]
+
+JOBS=${1:-1000000}
+EXECUTOR=${EXECUTOR:-./dag_executor}
+CONFIG=$(mktemp /tmp/bench_parse_XXXXXX.yaml)
+
+trap 'rm -f "$CONFIG"' EXIT
+
+awk -v jobs="$JOBS" 'BEGIN {
+    srand(1)
+    print "max_concurrent: 8\n"
+    print "resources:\n  db: 4\n"
+    for (i = 1; i <= jobs; i++) {
+        printf "job%d:\n  command: \"echo job %d > /dev/null\"  # задача %d\n", i, i, i
+        deps = ""
+        for (d = 0; d < 3 && i > 1; d++) {
+            dep = int(rand() * (i - 1)) + 1
+            deps = deps (d ? ", " : "") "job" dep
+        }
+        printf "  dependencies: [%s]\n", deps
+        if (i % 10 == 0) print "  resources: {db: 1}"
+        print ""
+    }
+}' > "$CONFIG"
+
+echo "Конфигурация: $JOBS задач, $(( $(stat -c %s "$CONFIG") / 1024 / 1024 )) МБ"
+"$EXECUTOR" --no-history --parse-only "$CONFIG" | tail -n 1
@@ -0,0 +1,57 @@
+#!/bin/bash
+# bench_sched.sh
+# Бенчмарк планировщика на синтетических графах dag_gen: для каждой формы
+# (слоистый DAG, веер, цепочка, мьютексы) и каждого размера выполняет граф
+# с --stats и сводит в таблицу время разбора и проверки, задержку
+# диспетчера, время выполнения против нижней границы и пиковую память.
+# Графы больше MAX_RUN задач (по умолчанию 100000) только разбираются
+# (--parse-only), если не задано FULL=1.
+# Использование: ./bench_sched.sh [число_задач ...]
+# Переменные: EXECUTOR, GEN, SHAPES, SLEEP (средняя длительность задачи, с),
+# BATCHABLE=1 (задачи command: с batchable: true в общем shell слота)
+
+SIZES=${*:-1000 10000 100000 1000000}
+EXECUTOR=${EXECUTOR:-./dag_executor}
+GEN=${GEN:-./dag_gen}
+SHAPES=${SHAPES:-layered fanout chain mutex}
+MAX_RUN=${MAX_RUN:-100000}
+CONFIG=$(mktemp /tmp/bench_sched_XXXXXX.yaml)
+STATS=$(mktemp /tmp/bench_sched_XXXXXX.txt)
+
+trap 'rm -f "$CONFIG" "$STATS" "$CONFIG.history" "$CONFIG.journal"' EXIT
+
+GEN_ARGS=()
+if [ -n "$SLEEP" ]; then
+    GEN_ARGS=(--sleep "$SLEEP")
+fi
+if [ "$BATCHABLE" = "1" ]; then
+    GEN_ARGS+=(--batchable)
+fi
+
+# printf выравнивает по байтам, поэтому заголовок записан готовой строкой
+echo "форма       задач разбор,с  пров.,с   p50,мкс   p99,мкс   время,с   граница   отн.   RSS,МБ"
+
+for shape in $SHAPES; do
+    for jobs in $SIZES; do
+        "$GEN" "$shape" "$jobs" "${GEN_ARGS[@]}" > "$CONFIG" || exit 1
+
+        if [ "$jobs" -gt "$MAX_RUN" ] && [ "$FULL" != "1" ]; then
+            "$EXECUTOR" --no-history --no-journal --parse-only --stats "$CONFIG" > "$STATS"
+            awk -v shape="$shape" -v jobs="$jobs" '
+                /^Разбор конфигурации:/ { parse = $(NF - 3) }
+                /^Граф и проверка:/ { validate = $4; rss = $(NF - 1) }
+                END { printf "%-8s %8s %8s %8s %9s %9s %9s %9s %6s %8s\n",
+                             shape, jobs, parse, validate, "-", "-", "-", "-", "-", rss }' "$STATS"
+            continue
+        fi
+
+        "$EXECUTOR" --no-history --no-journal --stats "$CONFIG" > "$STATS"
+        awk -v shape="$shape" -v jobs="$jobs" '
+            /^  Разбор:/ { parse = $2; validate = $7 }
+            /^  Задержка диспетчера/ { gsub(",", ""); p50 = $5; p99 = $9 }
+            /^  Время выполнения:/ { gsub(",", ""); makespan = $3; bound = $7; ratio = $NF }
+            /^  Пиковая память/ { rss = $(NF - 1) }
+            END { printf "%-8s %8s %8s %8s %9s %9s %9s %9s %6s %8s\n",
+                         shape, jobs, parse, validate, p50, p99, makespan, bound, ratio, rss }' "$STATS"
+    done
+done
@@ -0,0 +1,49 @@
+#!/bin/bash
+# bench_spawn.sh
+# Микробенчмарк запуска задач: DAG из N независимых тривиальных задач,
+# запущенный четырьмя способами - fork или posix_spawn, через /bin/sh
+# (command:) или напрямую (exec:).
+# Использование: ./bench_spawn.sh [количество_задач] [max_concurrent]
+
+JOBS=${1:-2000}
+CONCURRENT=${2:-4}
+EXECUTOR=${EXECUTOR:-./dag_executor}
+SHELL_CONFIG=$(mktemp /tmp/bench_spawn_XXXXXX.yaml)
+EXEC_CONFIG=$(mktemp /tmp/bench_spawn_XXXXXX.yaml)
+
+trap 'rm -f "$SHELL_CONFIG" "$EXEC_CONFIG"' EXIT
+
+#Генерация конфигураций: одни и те же задачи в двух формах
+generate() {
+    local line=$1
+    echo "max_concurrent: $CONCURRENT"
+    echo
+    for ((i = 1; i <= JOBS; i++)); do
+        echo "job$i:"
+        echo "  $line"
+        echo "  dependencies: []"
+        echo
+    done
+}
+generate 'command: "true"' > "$SHELL_CONFIG"
+generate 'exec: [true]' > "$EXEC_CONFIG"
+
+run() {
+    local title=$1 config=$2
+    shift 2
+    local start end elapsed_ms
+    start=$(date +%s%N)
+    "$EXECUTOR" --no-history "$@" "$config" > /dev/null
+    local rc=$?
+    end=$(date +%s%N)
+    elapsed_ms=$(( (end - start) / 1000000 ))
+    [ "$elapsed_ms" -gt 0 ] || elapsed_ms=1
+    printf "  %-28s %6d мс  %6d задач/с  (код возврата: %d)\n" \
+           "$title" "$elapsed_ms" $(( JOBS * 1000 / elapsed_ms )) "$rc"
+}
+
+echo "Задач: $JOBS, max_concurrent: $CONCURRENT"
+run "fork + /bin/sh (как раньше)" "$SHELL_CONFIG" --fork
+run "posix_spawn + /bin/sh" "$SHELL_CONFIG"
+run "fork + exec:" "$EXEC_CONFIG" --fork
+run "posix_spawn + exec:" "$EXEC_CONFIG"
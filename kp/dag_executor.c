@@ -2,437 +2,1675 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <spawn.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <signal.h>
-#include <yaml.h>
+#include <time.h>
 
-#define MAX_JOBS 100
 #define MAX_NAME_LEN 100
-#define MAX_DEPS 10
-#define MAX_MUTEXES 10
-#define MAX_MUTEX_PER_JOB 5
 #define DEFAULT_MAX_CONCURRENT 4
-#define COMMAND_BUFFER_SIZE 512
+#define INITIAL_CAPACITY 64
+#define EPOLL_BATCH 64 //Сколько событий забирать за один epoll_wait
+#define KILL_GRACE_SECONDS 2.0 //Пауза между SIGTERM и SIGKILL при отмене задачи
+#define OUTPUT_CHUNK 65536 //Сколько байт вывода задачи переносить за один splice/tee
+#define LINE_BUFFER_SIZE 4096 //Буфер незавершенной строки для общего потока с префиксами
+#define GRAPH_PRINT_LIMIT 100 //Подробный вывод графа только для небольших DAG
+#define TRACE_BUFFER_RECORDS 4096 //Записей трассы в буфере до перевода в JSON
+#define QUEUE_WAIT_BUCKETS 6 //Границы гистограммы ожидания в очереди, см. queue_wait_bounds
+#define WORKER_CONNECT_ATTEMPTS 100 //Попыток подключиться к еще не запущенному воркеру
+#define WORKER_CONNECT_DELAY_US 50000 //Пауза между попытками
+#define DEFAULT_WORKER_CAPACITY 4
+#define WIRE_MAX_PAYLOAD (2 << 20) //Наибольшие данные сообщения протокола: argv в пределах ARG_MAX
+#define WIRE_READ_LIMIT (4 * OUTPUT_CHUNK) //Сколько байт протокола читать за одно событие epoll
+#define CGROUP_CPU_PERIOD_US 100000 //Период cpu.max: cpu_max: 1.5 - 150 мс на каждые 100 мс
+#define CGROUP_RMDIR_ATTEMPTS 40 //Попыток удалить лист cgroup, пока в нем завершаются процессы
+#define CGROUP_RMDIR_DELAY_US 25000
+#define DEFAULT_JOB_DURATION 1.0 //Вес задачи без оценки длительности, секунды
+#define HISTORY_MAGIC "DAGH"
+#define HISTORY_VERSION 1
+#define HISTORY_SUFFIX ".history"
+#define HISTORY_NOT_MEASURED -1 //cpu_us/max_rss_kb задачи, для которой их не измерить (batchable)
+#define CACHE_SUFFIX ".cache"
+#define CACHE_HASH_CHUNK (16 << 20) //Между такими кусками файла поток кэша проверяет отмену
+#define JOURNAL_MAGIC "DAGJ"
+#define JOURNAL_VERSION 1
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_SYNC_SECONDS 1.0 //fdatasync журнала не чаще одного раза за этот интервал
+#define JOURNAL_BUFFER_RECORDS 256 //Переходов в буфере журнала до write
+#define SNAPSHOT_MAGIC "DAGB"
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_ALIGN 64     //Выравнивание разделов снимка в файле
+#define FNV64_OFFSET 14695981039346656037ull
+#define FNV64_PRIME 1099511628211ull
+#define REGRESSION_THRESHOLD 0.2  //Замедление больше чем на 20% считается регрессией
+#define EXEC_ARGV_END UINT32_MAX  //Конец argv задачи в dag.exec_args
+#define EMIT_FD 3                 //Дескриптор, в который задача с emits: true пишет новые задачи
+#define BATCH_STATUS_FD 3         //Дескриптор, в который общий shell пишет коды завершения задач
+#define BATCH_STATUS_SIZE 16      //Строка кода завершения от общего shell
 
 //Предварительное объявление структуры Job
 typedef struct Job Job;
 
-//Структура для мьютекса
+//Статистика одного запуска задачи (run_id == 0 - данных нет)
 typedef struct {
-    char name[MAX_NAME_LEN];
-    pthread_mutex_t mutex;
+    uint32_t run_id;
+    bool failed;
+    double wall_time;     //Секунды
+    double cpu_time;      //Секунды, user + system
+    long max_rss_kb;
+} RunStats;
+
+//Заголовок файла истории
+typedef struct {
+    char magic[4];
+    uint32_t version;
+} HistoryHeader;
+
+//Заголовок журнала переходов задач
+typedef struct {
+    char magic[4];
+    uint32_t version;
+} JournalHeader;
+
+//Состояния задачи в журнале
+enum {
+    JOURNAL_STARTED = 1,
+    JOURNAL_COMPLETED,
+    JOURNAL_FAILED
+};
+
+//Запись журнала: задача по индексу и хешу имени (чтобы не спутать ее с
+//другой задачей, если конфигурация изменилась) и ее новое состояние
+typedef struct {
+    uint32_t job;
+    uint32_t name_hash;
+    uint32_t state;
+} JournalRecord;
+
+//Запись в файле истории, за ней следуют name_len байт имени задачи
+typedef struct {
+    uint32_t run_id;
+    uint16_t name_len;
+    uint8_t failed;
+    uint8_t reserved;
+    int64_t timestamp;    //Время завершения, секунды Unix
+    int64_t wall_us;
+    int64_t cpu_us;       //HISTORY_NOT_MEASURED - не измерено
+    int64_t max_rss_kb;   //HISTORY_NOT_MEASURED - не измерено
+} HistoryRecord;
+
+//Разделы скомпилированного снимка DAG (--compile). Разделы после
+//SNAPSHOT_EXEC_ARGV не записываются: в файле на их месте дыра, которая
+//читается нулями и заполняется уже в отображении при выполнении
+enum {
+    SNAPSHOT_STRINGS,
+    SNAPSHOT_SYMBOLS,
+    SNAPSHOT_SLOTS,
+    SNAPSHOT_JOBS,
+    SNAPSHOT_MUTEXES,
+    SNAPSHOT_DEPS,
+    SNAPSHOT_NEXT_OFFSETS,
+    SNAPSHOT_NEXT_JOBS,
+    SNAPSHOT_JOB_MUTEXES,
+    SNAPSHOT_JOB_MUTEX_AMOUNTS,
+    SNAPSHOT_EXEC_ARGS,
+    SNAPSHOT_JOB_FILES,
+    SNAPSHOT_TOPO_ORDER,
+    SNAPSHOT_LEVELS,
+    SNAPSHOT_EXEC_ARGV,       //Указатели на argv, заполняются при загрузке
+    SNAPSHOT_READY_QUEUE,
+    SNAPSHOT_DEFERRED_JOBS,
+    SNAPSHOT_SECTION_COUNT
+};
+
+//Раздел снимка: смещение от начала файла и размер в байтах
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+} SnapshotSection;
+
+//Заголовок снимка. Массивы лежат в файле в том же виде, что и в памяти,
+//поэтому снимок читается только той сборкой, у которой совпадают
+//размеры структур
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t job_size;        //sizeof(Job), sizeof(Mutex), sizeof(Symbol), sizeof(char*)
+    uint32_t mutex_size;
+    uint32_t symbol_size;
+    uint32_t pointer_size;
+    int32_t job_count;
+    int32_t mutex_count;
+    int32_t dep_count;
+    int32_t job_mutex_count;
+    int32_t exec_arg_count;
+    int32_t job_file_count;
+    int32_t symbol_count;
+    int32_t slot_count;
+    int32_t max_concurrent;
+    int32_t level_count;
+    int32_t start_job_count;
+    uint32_t string_size;
+    int64_t memory_limit_kb;
+    SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+} SnapshotHeader;
+
+//Пул строк: имена и команды лежат подряд в одном растущем буфере,
+//а структуры хранят смещения, поэтому realloc их не инвалидирует
+typedef struct {
+    char* data;
+    uint32_t size;
+    uint32_t capacity;
+} StringPool;
+
+//Сканер конфигурации: файл отображается в память целиком и читается
+//строго вперед, строка за строкой. Значения копируются в один растущий
+//буфер scratch, поэтому на строку не выделяется память
+typedef struct {
+    const char* path;
+    int line_no;
+    char* scratch;
+    size_t scratch_capacity;
+    bool verbose;         //Подробный вывод только для первых GRAPH_PRINT_LIMIT задач
+    bool jobs_only;       //Описания от задачи: глобальные ключи запрещены
+} ConfigScanner;
+
+//Секция верхнего уровня, к которой относятся строки с отступом
+typedef enum {
+    SECTION_NONE,
+    SECTION_MUTEXES,
+    SECTION_RESOURCES,
+    SECTION_JOB
+} ConfigSection;
+
+//Символ: интернированное имя из YAML. Имя задачи или мьютекса
+//разрешается в индекс один раз, дальше все этапы работают с индексами
+typedef struct {
+    uint32_t name;        //Смещение имени в пуле строк
+    uint32_t hash;
+    int job;              //Индекс задачи с этим именем или -1
+    int mutex;            //Индекс мьютекса с этим именем или -1
+} Symbol;
+
+//Таблица символов: хеш-таблица с открытой адресацией и линейным
+//пробированием. slots хранит id символа или -1, размер - степень двойки
+typedef struct {
+    Symbol* symbols;
+    int count;
+    int capacity;
+    int* slots;
+    int slot_count;
+} SymbolTable;
+
+//Структура для мьютекса. Мьютекс - ресурс планировщика, а не pthread_mutex:
+//задача захватывает все свои мьютексы разом в момент запуска (в цикле событий)
+//и не занимает слот, пока ждет их.
+//Обычный мьютекс - ресурс емкостью 1; ресурсы из секции resources: (например,
+//db_connections: 8) - счетные семафоры, задача занимает заданное число единиц
+typedef struct {
+    uint32_t name;        //Смещение имени в пуле строк
+    int capacity;         //Емкость ресурса (1 для мьютекса)
+    int used;             //Сколько единиц сейчас занято
+    long contended;       //Сколько раз задача вставала в очередь ожидания этого ресурса
     int ref_count;
 } Mutex;
 
-//Структура для задачи (job)
+//Структура для задачи (job): описание из конфигурации и ключ планирования.
+//Списки зависимостей и мьютексов хранятся вне задачи, в общих массивах DAG:
+//задача знает только начало своего отрезка и его длину. Поля, которые читает
+//планировщик при каждом выборе задачи и освобождении последователей, идут
+//первыми; состояние запуска лежит отдельно, в dag.job_runtime
 struct Job {
-    char name[MAX_NAME_LEN];
-    char command[COMMAND_BUFFER_SIZE];
+    double priority;      //Длина самого длинного пути от задачи до завершающей
+    long ready_seq;       //Порядковый номер постановки в очередь готовых
+    int remaining_deps;
+    int mutex_count;
+    int mutex_start;      //Начало отрезка в dag.job_mutex_symbols / job_mutexes / job_mutex_amounts
+    bool completed;
+    bool emits;           //Задача может добавлять задачи через EMIT_FD (emits: true)
+    bool batchable;       //batchable: true - задачу можно выполнить в общем shell слота
+    int dependency_count;
+    int dep_start;        //Начало отрезка в dag.dep_symbols
+    uint32_t name;        //Смещение имени в пуле строк
+    int symbol;           //id символа с именем задачи
+    uint32_t command;     //Смещение команды в пуле строк
+    int exec_start;       //Начало argv в dag.exec_args / exec_argv, -1 - запуск через /bin/sh
+    int exec_argc;
+    int input_start;      //Входы и выходы задачи: отрезки в dag.job_files
+    int input_count;
+    int output_start;
+    int output_count;
+    double estimated_duration; //Оценка длительности из YAML, секунды (< 0 - не задана)
+    double timeout;       //Ограничение времени из YAML, секунды (<= 0 - нет)
+    double cpu_max;       //Лимит процессора в ядрах для --cgroups (0 - нет)
+    long memory_max_kb;   //Лимит памяти задачи для --cgroups (0 - нет)
+};
+
+//Состояние запуска задачи: dag.job_runtime[i] относится к dag.jobs[i].
+//В снимок не попадает и заводится заново при каждой загрузке графа
+typedef struct {
     pid_t pid;
+    int pidfd;            //pidfd запущенного процесса в dag.epoll_fd или -1
+    int timerfd;          //Таймер тайм-аута или отсрочки SIGKILL, -1 - не создан
+    int slot;             //Слот max_concurrent, занятый задачей, или -1
+    int worker;           //Воркер, выполняющий задачу (--workers): номер + 1, 0 - нет
+    int cgroup_fd;        //Каталог листа cgroup задачи или -1
+    int output_fd;        //Читающий конец канала с stdout/stderr задачи или -1
+    int log_fd;           //Файл журнала задачи в --log-dir или -1
+    int emit_fd;          //Читающий конец канала описаний новых задач или -1
     int status;
-    bool completed;
     bool failed;
-    int dependency_count;
-    char dependencies[MAX_DEPS][MAX_NAME_LEN];
-    int mutex_count;
-    char mutexes[MAX_MUTEX_PER_JOB][MAX_NAME_LEN];
-    pthread_mutex_t *mutex_ptrs[MAX_MUTEX_PER_JOB];
-    int remaining_deps;
-    Job* next_jobs[MAX_DEPS];
-    int next_job_count;
+    bool term_sent;       //Группе процессов задачи уже отправлен SIGTERM
+    bool timed_out;
+    bool cancelled;       //Задача остановлена из-за ошибки в другой задаче
+    bool cached;          //Задача пропущена: результат взят из кэша
+    bool cache_pending;   //Задача заняла слот и ждет ответа потока кэша
+    bool batched;         //Задача выполняется в dag.batch_shells[slot]
+    int woken_by;         //Ресурс (номер + 1), из очереди которого задача вернулась в готовые, 0 - нет
+    double parked_at;     //Когда задача встала в очередь ожидания ресурса или памяти
+    double started_at;    //Момент запуска (monotonic_seconds)
+    double ready_at;      //Моменты для --trace: постановка в очередь готовых,
+    double blocked_at;    //первый отказ из-за ресурсов или памяти (0 - не было)
+    double exited_at;     //и завершение процесса
+    double dispatch_latency; //--stats: от момента, когда задачу стало можно запустить
+                             //(готова и есть свободный слот), до решения о запуске
+    uint64_t cache_key;   //Ключ кэша, посчитанный при запуске
+    char* line_buffer;    //Незавершенная строка для --prefix-output
+    int line_length;
+    char* emit_buffer;    //Принятые описания, разбираются после успешного завершения
+    size_t emit_size;
+    size_t emit_capacity;
+    long admitted_rss_kb; //Память, зарезервированная под задачу при запуске
+    RunStats last_run;    //Последний и предыдущий запуски из истории
+    RunStats prev_run;
+    RunStats current_run; //Текущий запуск
+} JobRuntime;
+
+//Виды событий цикла: старшие 32 бита epoll_event.data.u64, младшие - индекс задачи
+enum {
+    EVENT_EXIT,           //pidfd: процесс задачи завершился
+    EVENT_TIMER,          //timerfd задачи: тайм-аут или пора слать SIGKILL
+    EVENT_SIGNAL,         //signalfd: исполнитель получил SIGINT/SIGTERM
+    EVENT_OUTPUT,         //Канал вывода задачи: есть данные или писатель закрыл его
+    EVENT_EMIT,           //Канал EMIT_FD задачи: пришли описания новых задач
+    EVENT_METRICS,        //Сокет метрик: подключился клиент
+    EVENT_WORKER,         //Соединение координатора с воркером: пришли сообщения
+    EVENT_ACCEPT,         //Слушающий сокет воркера: подключился координатор
+    EVENT_BATCH,          //Сокет общего shell слота: код завершения задачи или shell завершился
+    EVENT_CACHE           //eventfd потока кэша: готовы результаты поиска в кэше
+};
+
+//Сообщения протокола координатор - воркер: заголовок WireHeader и size байт
+//данных после него (size кратен 8). Обе стороны на одной архитектуре,
+//поэтому числа передаются в родном порядке байт
+enum {
+    WIRE_HELLO,           //Воркер -> координатор: value - емкость воркера
+    WIRE_RUN,             //Координатор -> воркер: запустить задачу job. value - число
+                          //аргументов exec: (0 - команда для /bin/sh), данные - строки через \0
+    WIRE_SIGNAL,          //Координатор -> воркер: сигнал value группе процессов задачи job
+    WIRE_DONE             //Воркер -> координатор: задача job завершилась со статусом
+                          //wait value, данные - WireUsage
+};
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;
+    uint32_t job;         //Индекс задачи у координатора
+    int32_t value;
+} WireHeader;
+
+typedef struct {
+    double cpu_time;
+    int64_t max_rss_kb;
+} WireUsage;
+
+//Буфер входящих сообщений: сокет читается, сколько есть, а разбираются
+//только полностью пришедшие сообщения
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} MessageBuffer;
+
+//Воркер со стороны координатора
+typedef struct {
+    const char* endpoint;
+    int fd;
+    int capacity;         //Сколько задач воркер выполняет одновременно
+    int running;
+    MessageBuffer input;
+} Worker;
+
+//Слот воркера: запущенный им процесс задачи
+typedef struct {
+    pid_t pid;
+    int pidfd;            //-1 - слот свободен
+    uint32_t job;
+    bool term_sent;
+} WorkerSlot;
+
+//Очередь задач, ждущих ресурс или память: куча в порядке ready_before.
+//Задача, которой не хватило ресурса, ждет здесь, а не в очереди готовых,
+//и возвращается туда, только когда ресурс освобождается
+typedef struct {
+    int* jobs;
+    int count;
+    int capacity;
+    int woken;            //Единицы ресурса, обещанные разбуженным, но еще не выбранным задачам
+    double blocked_seconds; //Суммарное ожидание задач, уже покинувших очередь
+} WaitList;
+
+//Общий shell слота для задач с batchable: true. Команды задач приходят ему
+//по одной строке через сокет на stdin, а код завершения он пишет в тот же
+//сокет через BATCH_STATUS_FD. Shell - лидер своей группы, его подоболочка
+//с задачей остается в ней, поэтому сигнал задаче получает вся группа
+typedef struct {
+    pid_t pid;            //0 - shell не запущен
+    int fd;               //Сокет исполнителя в epoll или -1
+    int job;              //Выполняемая задача или -1
+    char status[BATCH_STATUS_SIZE]; //Незавершенная строка кода завершения
+    int status_length;
+} BatchShell;
+
+//Запрос к потоку кэша. Все, что нужно для ключа и записи кэша, копируется
+//в data: поток не читает dag, который цикл событий тем временем меняет
+enum {
+    CACHE_LOOKUP,         //Посчитать ключ и проверить запись кэша (перед запуском)
+    CACHE_STORE           //Записать запись кэша (после успешного запуска)
 };
 
+typedef struct CacheRequest {
+    struct CacheRequest* next;
+    int kind;
+    int job;
+    uint64_t key;         //CACHE_STORE - ключ для записи, CACHE_LOOKUP - посчитанный ключ
+    bool hit;             //CACHE_LOOKUP: задачу можно пропустить
+    int input_count;
+    int output_count;
+    size_t command_size;  //Команда (или argv из exec: через \0) в начале data
+    char data[];          //Команда, путь записи кэша, входы, выходы - строки через \0
+} CacheRequest;
+
+//Верхние границы корзин гистограммы ожидания в очереди готовых, секунды
+static const double queue_wait_bounds[QUEUE_WAIT_BUCKETS] = { 0.001, 0.01, 0.1, 1, 10, 60 };
+
+//Запись трассы о задаче: моменты всех ее состояний (monotonic_seconds)
+typedef struct {
+    int job;
+    int slot;
+    double ready_at;
+    double blocked_at;
+    double started_at;
+    double exited_at;
+    double finished_at;
+    bool failed;
+    bool cached;
+} TraceRecord;
+
+//Событие симулятора: завершение задачи в момент time
+typedef struct {
+    double time;
+    int job;
+} SimEvent;
+
 //Структура для DAG
 typedef struct {
-    Job jobs[MAX_JOBS];
+    Job* jobs;
     int job_count;
-    Mutex mutexes[MAX_MUTEXES];
+    int job_capacity;
+    JobRuntime* job_runtime; //Состояние запуска, параллельно jobs
+    int job_runtime_capacity;
+    StringPool strings;
+    SymbolTable symtab;
+    
+    //Зависимости всех задач подряд: id символов из YAML и разрешенные
+    //индексы задач (отрезок задачи - dep_start .. dep_start + dependency_count)
+    int* dep_symbols;
+    int* deps;
+    int dep_count;
+    int dep_capacity;
+    
+    //Граф последователей в формате CSR: последователи задачи i лежат в
+    //next_jobs[next_offsets[i] .. next_offsets[i + 1]). Динамические задачи
+    //добавляются в конец, поэтому их отрезки дописываются после всех прежних
+    int* next_offsets;
+    int* next_jobs;
+    
+    //Емкости массивов графа (растут, когда задачи добавляют новые задачи):
+    //ready_queue и deferred_jobs - graph_capacity элементов, next_offsets - на один больше
+    int graph_capacity;
+    int resolved_dep_capacity;
+    int next_job_capacity;
+    int resolved_mutex_capacity;
+    
+    //Мьютексы задач: id символов и индексы в dag.mutexes
+    int* job_mutex_symbols;
+    int* job_mutex_amounts; //Сколько единиц ресурса нужно задаче (1 для мьютекса)
+    int* job_mutexes;
+    int job_mutex_count;
+    int job_mutex_capacity;
+    int job_mutex_amount_capacity;
+    
+    Mutex* mutexes;
     int mutex_count;
+    int mutex_capacity;
+    
+    //argv задач с exec: смещения в пуле строк, argv каждой задачи
+    //завершается EXEC_ARGV_END. exec_argv - массивы указателей для posix_spawn;
+    //пул строк может переехать при добавлении задач, поэтому отрезок задачи
+    //заполняется прямо перед запуском (launch_job)
+    uint32_t* exec_args;
+    int exec_arg_count;
+    int exec_arg_capacity;
+    char** exec_argv;
+    int exec_argv_capacity;
+    
+    //Файлы из inputs:/outputs: задач (смещения в пуле строк)
+    uint32_t* job_files;
+    int job_file_count;
+    int job_file_capacity;
+    char* cache_dir;      //Каталог кэша <config>.cache или NULL, если кэш выключен
+    bool cache_dir_created; //Каталог создается при первой записи кэша
+    
+    //Поток кэша: хеширует входы и выходы задач вне цикла событий, чтобы
+    //большой файл не задерживал тайм-ауты, сбор задач и вывод
+    pthread_t cache_thread;
+    bool cache_thread_started;
+    pthread_mutex_t cache_lock;
+    pthread_cond_t cache_cond;
+    CacheRequest* cache_queue; //Очередь запросов потоку (FIFO)
+    CacheRequest* cache_queue_tail;
+    CacheRequest* cache_done; //Выполненные CACHE_LOOKUP для цикла событий
+    bool cache_stop;
+    atomic_bool cache_abort; //DAG отменяется: хеширование прерывается
+    int cache_event_fd;   //eventfd в epoll: есть выполненные запросы, или -1
+    
+    //Журнал переходов задач для --resume
+    char* journal_path;
+    int journal_fd;       //-1 - журнал не ведется
+    JournalRecord journal_buffer[JOURNAL_BUFFER_RECORDS];
+    int journal_count;
+    bool journal_dirty;   //Есть записи, еще не сброшенные fdatasync
+    double journal_synced_at;
+    int resumed_jobs;     //Задачи, выполненные по журналу прошлого запуска
+    
+    //cgroup исполнителя (--cgroups): в нем листы запущенных задач
+    char* cgroup_path;    //NULL - cgroup v2 недоступны, задачи без изоляции
+    int cgroup_fd;
+    int cgroup_home_fd;   //Исходный cgroup исполнителя, куда он возвращается в конце, или -1
+    bool cgroup_cpu;      //Включены ли контроллеры для листов задач
+    bool cgroup_memory;
+    int cgroup_leftovers; //Листы, которые не удалось удалить при сборе задачи
+    
+    //Результаты validate_dag: топологический порядок и уровни задач
+    //(уровень = длина самого длинного пути от стартовой задачи)
+    int* topo_order;
+    int* levels;
+    int level_count;
+    int start_job_count;  //Стартовые задачи идут первыми в topo_order
+    double critical_path; //Длина критического пути, секунды
+    
     int max_concurrent;
+    long memory_limit_kb; //Лимит суммарной памяти запущенных задач (0 - нет)
+    long running_memory_kb;
+    
+    //История запусков: файл рядом с конфигурацией
+    char* history_path;
+    int history_fd;
+    uint32_t history_run_id;
+    int history_jobs;     //Сколько задач имеют данные в истории
+    
     int running_jobs;
-    pthread_mutex_t running_mutex;
-    pthread_cond_t job_completed_cond;
+    int finished_jobs;
+    int failed_jobs;
+    int cached_jobs;
+    //Очередь готовых к запуску задач (remaining_deps == 0): двоичная куча
+    //индексов задач, упорядоченная функцией ready_before
+    int* ready_queue;
+    int ready_count;
+    long ready_seq;
+    int* deferred_jobs;   //Временный список задач, пропущенных при побудке ожидающих
+    WaitList* resource_waits; //Очереди ожидания ресурсов, по номеру в dag.mutexes
+    int resource_wait_capacity;
+    WaitList memory_waits; //Задачи, которым не хватило memory_limit_mb
+    int epoll_fd;         //epoll цикла событий: pidfd и таймеры запущенных задач
+    int signal_fd;        //signalfd для SIGINT/SIGTERM самого исполнителя
+    posix_spawnattr_t spawn_attr;
+    int tee_pipe[2];      //Промежуточный канал: tee копирует в него вывод для префиксов
+    bool cancelling;      //Запущенным задачам уже разослан SIGTERM
     bool dag_failed;
+    int* free_slots;      //Стек свободных слотов max_concurrent (номер дорожки в трассе)
+    int free_slot_count;
+    double* slot_freed_at; //Когда слот освободился в последний раз (для --stats)
+    
+    //Трасса выполнения (--trace)
+    FILE* trace_file;
+    TraceRecord* trace_records;
+    int trace_count;
+    double trace_start;
+    
+    //Воркеры (--workers): задачи запускаются на них, а не локально
+    Worker* workers;
+    int worker_count;
+    char* worker_list;    //Копия списка адресов, endpoint воркеров указывают в нее
+    
+    //Общие shell задач с batchable: true, по одному на слот max_concurrent
+    BatchShell* batch_shells;
+    char* batch_script;   //Строка с командой очередной задачи для shell
+    int batch_script_length;
+    int batch_script_capacity;
+    
+    //Метрики (--metrics-socket)
+    int metrics_fd;       //Слушающий сокет или -1
+    double metrics_start;
+    long* slot_jobs;      //Сколько задач выполнено в каждом слоте
+    long queue_wait_counts[QUEUE_WAIT_BUCKETS + 1]; //Последняя корзина - +Inf
+    double queue_wait_sum;
+    
+    //Отображение снимка, если DAG загружен из .dagbin: массивы графа
+    //указывают внутрь него (MAP_PRIVATE, изменения не попадают в файл)
+    void* snapshot;
+    size_t snapshot_size;
 } DAG;
 
 //Глобальный DAG
 DAG dag = {0};
 
+//Режимы работы
+static bool priority_mode = false;  //Сначала запускать задачи с длинным хвостом
+static bool simulate_mode = false;  //Только предсказать makespan, не запуская команды
+static bool report_mode = false;    //Только вывести отчет по истории запусков
+static bool history_enabled = true; //Записывать историю запусков
+static bool fork_mode = false;      //Запускать задачи через fork + execl (для сравнения)
+static bool prefix_output = false;  //Общий поток вывода задач с префиксом [имя]
+static const char* log_dir = NULL;  //Каталог для журналов задач
+static bool cache_enabled = true;   //Пропускать задачи с неизменными входами
+static bool parse_only = false;     //Только разобрать конфигурацию и вывести скорость разбора
+static const char* compile_path = NULL; //Записать снимок DAG в этот файл и выйти
+static const char* trace_path = NULL; //Файл трассы выполнения в формате Chrome trace
+static const char* metrics_path = NULL; //Unix-сокет, на котором отдаются метрики
+static const char* workers_list = NULL; //Адреса воркеров через запятую (режим координатора)
+static bool cgroups_mode = false; //Запускать задачи в своих cgroup v2 с лимитами из YAML
+static bool journal_enabled = true; //Вести журнал переходов задач
+static bool resume_mode = false; //Продолжить выполнение по журналу прошлого запуска
+static bool stats_mode = false; //Вывести статистику планировщика после выполнения
+
 //Прототипы функций
+bool grow_array(void** array, int* capacity, int needed, size_t elem_size);
+uint32_t pool_add(const char* str);
+const char* pool_str(uint32_t offset);
+uint32_t hash_name(const char* name);
+int lookup_symbol(const char* name, uint32_t hash);
+int intern_symbol(const char* name);
+Job* add_job(const char* name);
+JobRuntime* job_runtime(const Job* job);
+bool add_job_dependency(Job* job, const char* name);
+bool add_job_exec_arg(Job* job, const char* arg);
+bool add_job_file(Job* job, const char* path, bool is_input);
+bool add_job_mutex(Job* job, const char* name, int amount);
 Job* find_job_by_name(const char* name);
 Mutex* find_mutex_by_name(const char* name);
 Mutex* add_mutex(const char* name);
+Mutex* add_resource(const char* name, int capacity);
+bool scratch_reserve(ConfigScanner* sc, size_t size);
+const char* strip_line(const char* p, const char* end);
+const char* scan_scalar(ConfigScanner* sc, const char* p, const char* end,
+                        bool in_flow, const char** next);
+const char* next_flow_item(ConfigScanner* sc, const char** cursor, const char* end);
+bool open_flow(ConfigScanner* sc, const char** value, const char* end, char open,
+               const char* key);
+bool key_is(const char* key, size_t len, const char* name);
+bool parse_job_key(ConfigScanner* sc, Job* job, const char* key, size_t key_len,
+                   const char* value, const char* end);
+bool parse_top_level(ConfigScanner* sc, const char* line, const char* end,
+                     ConfigSection* section, Job** current_job);
+bool parse_section_item(ConfigScanner* sc, ConfigSection section,
+                        const char* line, const char* end);
+bool parse_config_data(ConfigScanner* sc, const char* data, size_t size);
 bool parse_yaml_config_simple(const char* filename);
 bool build_dependency_graph(void);
-bool has_cycle_util(int job_idx, bool visited[], bool rec_stack[]);
-bool has_cycles(void);
+bool resolve_job_mutexes(Job* job);
+bool topological_sort(void);
+void report_cycle(int* indegree);
 bool validate_dag(void);
-void* execute_job(void* arg);
+double monotonic_seconds(void);
+void snapshot_layout(void** fields[SNAPSHOT_SECTION_COUNT], uint64_t sizes[SNAPSHOT_SECTION_COUNT]);
+bool is_snapshot_file(const char* path);
+bool write_snapshot(const char* path);
+bool snapshot_indices_valid(void);
+bool load_snapshot(const char* path);
+bool detach_snapshot(void);
+bool load_history(const char* config_path);
+bool open_history_for_append(void);
+void append_history(Job* job);
+void print_history_report(void);
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t size);
+uint64_t hash_file(const char* path);
+const char* job_file_name(const Job* job, char* buffer, size_t size);
+void cache_record_path(const Job* job, char* path, size_t size);
+CacheRequest* cache_request(const Job* job, int kind);
+uint64_t job_cache_key(const CacheRequest* request);
+bool job_cache_hit(CacheRequest* request);
+void store_cache_record(const CacheRequest* request);
+void* cache_thread_main(void* arg);
+bool cache_submit(CacheRequest* request);
+void on_cache_event(void);
+void cache_thread_stop(void);
+bool can_admit_job(int job_idx);
+int blocking_resource(const Job* job);
+bool mutexes_available(const Job* job);
+void acquire_job_mutexes(int job_idx);
+void release_job_mutexes(const Job* job);
+int job_resource_amount(const Job* job, int resource);
+void park_job(int job_idx, int resource);
+void wake_waiters(int resource);
+void wake_memory_waiters(void);
+void free_wait_lists(void);
+int pick_ready_job(void);
+double job_weight(const Job* job);
+void compute_priorities(void);
+bool ready_before(int a, int b);
+void heap_insert(int* heap, int* count, int job_idx);
+int heap_pop(int* heap, int* count);
+void insert_ready_job(int job_idx);
+void push_ready_job(int job_idx);
+int pop_ready_job(void);
+void sim_event_push(SimEvent* events, int* count, SimEvent event);
+SimEvent sim_event_pop(SimEvent* events, int* count);
+double simulate_dag(bool use_priority);
+pid_t launch_job(Job* job, int output_fd, int emit_fd);
+bool open_job_output(Job* job, int* write_fd);
+void emit_prefixed(Job* job, const char* data, size_t size);
+void drain_job_output(Job* job);
+void close_job_output(Job* job);
+bool open_job_emits(Job* job, int* write_fd);
+void drain_job_emits(Job* job);
+void close_job_emits(Job* job);
+bool add_emitted_jobs(int parent_idx);
+bool link_emitted_jobs(int parent_idx, int first);
+void start_job(int job_idx);
+void launch_started_job(Job* job);
+void reap_job(Job* job);
+void complete_job(Job* job, int status);
+void finish_job(Job* job);
+uint64_t event_key(int kind, int job_idx);
+bool arm_job_timer(Job* job, double seconds);
+void terminate_job(Job* job);
+void on_job_timer(Job* job);
+void cancel_running_jobs(void);
+bool trace_open(const char* path);
+void trace_write_name(const char* name);
+void trace_write_span(const TraceRecord* record, const char* category, double begin, double end,
+                      bool async);
+void trace_flush(void);
+void trace_job(const Job* job);
+void trace_close(void);
+bool metrics_open(const char* path);
+void record_queue_wait(double seconds);
+void write_metrics(FILE* out);
+void serve_metrics(void);
+void metrics_close(const char* path);
+int open_endpoint(const char* endpoint, bool listening);
+bool send_message(int fd, uint32_t type, uint32_t job, int32_t value, const void* data, uint32_t size);
+bool fill_message_buffer(int fd, MessageBuffer* buffer);
+const WireHeader* next_message(const MessageBuffer* buffer, size_t* offset, bool* invalid);
+void consume_messages(MessageBuffer* buffer, size_t offset);
+bool connect_workers(const char* list);
+bool dispatch_job(Job* job);
+bool job_active(const Job* job);
+void signal_job(Job* job, int signo);
+void finish_remote_job(Job* job, int status, const WireUsage* usage);
+void on_worker_message(int worker_idx);
+void disconnect_workers(void);
+pid_t spawn_worker_job(const WireHeader* header, posix_spawnattr_t* attr);
+int run_worker(const char* endpoint, int capacity);
+bool cgroup_setup(void);
+bool cgroup_has_controller(const char* list, const char* controller);
+bool write_cgroup_file(int dir_fd, const char* file, const char* value);
+int read_cgroup_file(int dir_fd, const char* file, char* buffer, size_t size);
+long long sum_cgroup_key(int dir_fd, const char* file, const char* key);
+void cgroup_create_job(Job* job);
+void cgroup_collect_job(Job* job);
+void cgroup_release_job(Job* job);
+void cgroup_teardown(void);
+bool open_journal(const char* config_path);
+off_t replay_journal(void);
+void push_resumed_frontier(void);
+void journal_job(const Job* job, uint32_t state);
+void journal_write(void);
+int journal_sync(bool force);
+void close_journal(bool success);
+bool append_batch_script(const char* text, bool quoted);
+bool spawn_batch_shell(int slot);
+bool run_batched_job(Job* job);
+void on_batch_status(int slot);
+void close_batch_shells(void);
+int compare_doubles(const void* a, const void* b);
+double peak_rss_mb(void);
+void print_run_stats(double parse_time, double validate_time, double makespan, int config_jobs);
 bool execute_dag(void);
+void free_dag(void);
+void print_usage(const char* program_name);
 
-//Функция для поиска задачи по имени
-Job* find_job_by_name(const char* name) {
-    for (int i = 0; i < dag.job_count; i++) {
-        if (strcmp(dag.jobs[i].name, name) == 0) {
-            return &dag.jobs[i];
-        }
+//Увеличение динамического массива минимум до needed элементов (удвоением)
+bool grow_array(void** array, int* capacity, int needed, size_t elem_size) {
+    if (needed <= *capacity) {
+        return true;
     }
-    return NULL;
+    
+    int new_capacity = *capacity > 0 ? *capacity : INITIAL_CAPACITY;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    
+    void* new_array = realloc(*array, (size_t)new_capacity * elem_size);
+    if (!new_array) {
+        fprintf(stderr, "Не удалось выделить память\n");
+        return false;
+    }
+    
+    *array = new_array;
+    *capacity = new_capacity;
+    return true;
 }
 
-//Функция для поиска мьютекса по имени
-Mutex* find_mutex_by_name(const char* name) {
-    for (int i = 0; i < dag.mutex_count; i++) {
-        if (strcmp(dag.mutexes[i].name, name) == 0) {
-            return &dag.mutexes[i];
+//Добавление строки в пул, возвращает ее смещение
+uint32_t pool_add(const char* str) {
+    StringPool* pool = &dag.strings;
+    uint32_t len = strlen(str) + 1;
+    
+    if (pool->size + len > pool->capacity) {
+        uint32_t new_capacity = pool->capacity > 0 ? pool->capacity : 4096;
+        while (pool->size + len > new_capacity) {
+            new_capacity *= 2;
         }
+        char* new_data = realloc(pool->data, new_capacity);
+        if (!new_data) {
+            fprintf(stderr, "Не удалось выделить память под строки\n");
+            exit(1);
+        }
+        pool->data = new_data;
+        pool->capacity = new_capacity;
     }
-    return NULL;
+    
+    uint32_t offset = pool->size;
+    memcpy(pool->data + offset, str, len);
+    pool->size += len;
+    return offset;
 }
 
-//Функция для добавления мьютекса
-Mutex* add_mutex(const char* name) {
-    Mutex* mutex = find_mutex_by_name(name);
-    if (mutex) {
-        mutex->ref_count++;
-        return mutex;
+//Получение строки из пула по смещению
+const char* pool_str(uint32_t offset) {
+    return dag.strings.data + offset;
+}
+
+//Хеш FNV-1a для имен
+uint32_t hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
     }
-    
-    if (dag.mutex_count >= MAX_MUTEXES) {
-        fprintf(stderr, "Превышено максимальное количество мьютексов\n");
-        return NULL;
+    return hash;
+}
+
+//Поиск символа по имени, возвращает id или -1
+int lookup_symbol(const char* name, uint32_t hash) {
+    SymbolTable* table = &dag.symtab;
+    if (table->slot_count == 0) {
+        return -1;
     }
     
-    mutex = &dag.mutexes[dag.mutex_count++];
-    strncpy(mutex->name, name, MAX_NAME_LEN - 1);
-    mutex->name[MAX_NAME_LEN - 1] = '\0';
-    pthread_mutex_init(&mutex->mutex, NULL);
-    mutex->ref_count = 1;
-    
-    return mutex;
+    uint32_t mask = table->slot_count - 1;
+    for (uint32_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        int id = table->slots[slot];
+        if (id < 0) {
+            return -1;
+        }
+        Symbol* symbol = &table->symbols[id];
+        if (symbol->hash == hash && strcmp(pool_str(symbol->name), name) == 0) {
+            return id;
+        }
+    }
 }
 
-//структура для парсинга ямл файла
-bool parse_yaml_config_simple(const char* filename) {
-    printf("Упрощенный парсинг YAML конфигурации...\n");
+//Интернирование имени: возвращает id существующего символа или создает новый
+int intern_symbol(const char* name) {
+    SymbolTable* table = &dag.symtab;
+    uint32_t hash = hash_name(name);
     
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Не удалось открыть файл %s\n", filename);
-        return false;
+    int id = lookup_symbol(name, hash);
+    if (id >= 0) {
+        return id;
     }
     
-    char line[1024];
-    Job* current_job = NULL;
-    
-    //Значения по умолчанию
-    dag.max_concurrent = DEFAULT_MAX_CONCURRENT;
-    dag.job_count = 0;
-    dag.mutex_count = 0;
-    
-    //Инициализируем массив мьютексов
-    char* mutex_list[100] = {NULL};
-    int mutex_list_count = 0;
-    
-    while (fgets(line, sizeof(line), file)) {
-        //Убираем перевод строки
-        line[strcspn(line, "\n")] = '\0';
-        
-        //Пропускаем комментарии
-        char* comment = strchr(line, '#');
-        if (comment) *comment = '\0';
-        
-        char* trimmed = line;
-        while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
-        
-        //Пропускаем пустые строки
-        if (trimmed[0] == '\0') continue;
-        
-        //Парсим max_concurrent
-        if (strncmp(trimmed, "max_concurrent:", 15) == 0) {
-            char* value = trimmed + 15;
-            while (*value == ' ') value++;
-            dag.max_concurrent = atoi(value);
-            if (dag.max_concurrent <= 0) dag.max_concurrent = DEFAULT_MAX_CONCURRENT;
-            printf("Найдено max_concurrent: %d\n", dag.max_concurrent);
-            continue;
-        }
-        
-        // Парсим глобальные mutexes
-        if (strncmp(trimmed, "mutexes:", 8) == 0) {
-            printf("Парсинг глобальных мьютексов...\n");
-            //Читаем следующие строки, пока не найдем не-элемент списка
-            while (fgets(line, sizeof(line), file)) {
-                line[strcspn(line, "\n")] = '\0';
-                char* item = line;
-                while (*item == ' ' || *item == '\t' || *item == '-') item++;
-                
-                //Пропускаем комментарии в элементах списка
-                char* item_comment = strchr(item, '#');
-                if (item_comment) *item_comment = '\0';
-                
-                //Если строка пустая или начинается с буквы (новая секция), выходим
-                if (item[0] == '\0' || 
-                    (item[0] >= 'a' && item[0] <= 'z') || 
-                    (item[0] >= 'A' && item[0] <= 'Z')) {
-                    //Откатываемся на одну строку назад
-                    fseek(file, -strlen(line)-1, SEEK_CUR);
-                    break;
-                }
-                
-                //Убираем кавычки и запятые
-                if (item[0] == '"' || item[0] == '\'') {
-                    char quote = item[0];
-                    memmove(item, item+1, strlen(item)); //Убираем первую кавычку
-                    char* end_quote = strchr(item, quote);
-                    if (end_quote) *end_quote = '\0';
-                }
-                
-                //Убираем запятые и пробелы в конце
-                char* end = item + strlen(item) - 1;
-                while (end > item && (*end == ',' || *end == ' ' || *end == '\t')) {
-                    *end = '\0';
-                    end--;
-                }
-                
-                if (strlen(item) > 0) {
-                    //Сохраняем мьютекс во временный список
-                    mutex_list[mutex_list_count] = strdup(item);
-                    if (mutex_list[mutex_list_count]) {
-                        printf("  Найден мьютекс: %s\n", item);
-                        mutex_list_count++;
-                    }
-                }
-            }
-            continue;
+    //Держим заполнение таблицы не выше 1/2, чтобы цепочки пробирования были короткими
+    if ((table->count + 1) * 2 > table->slot_count) {
+        int new_slot_count = table->slot_count > 0 ? table->slot_count * 2 : INITIAL_CAPACITY * 2;
+        int* new_slots = malloc(new_slot_count * sizeof(int));
+        if (!new_slots) {
+            fprintf(stderr, "Не удалось выделить память под таблицу символов\n");
+            return -1;
         }
+        memset(new_slots, -1, new_slot_count * sizeof(int));
         
-        //Парсим job (строка вида "jobX:")
-        if (strstr(trimmed, "job") && trimmed[strlen(trimmed)-1] == ':') {
-            //Извлекаем имя job (без двоеточия)
-            char name[MAX_NAME_LEN];
-            strncpy(name, trimmed, MAX_NAME_LEN-1);
-            name[MAX_NAME_LEN-1] = '\0';
-            
-            //Убираем двоеточие в конце
-            char* colon = strchr(name, ':');
-            if (colon) *colon = '\0';
-            
-            //Убираем пробелы в конце
-            char* name_end = name + strlen(name) - 1;
-            while (name_end > name && (*name_end == ' ' || *name_end == '\t')) {
-                *name_end = '\0';
-                name_end--;
-            }
-            
-            if (dag.job_count >= MAX_JOBS) {
-                fprintf(stderr, "Слишком много задач\n");
-                fclose(file);
-                //Освобождаем память мьютексов
-                for (int i = 0; i < mutex_list_count; i++) {
-                    if (mutex_list[i]) free(mutex_list[i]);
-                }
-                return false;
+        uint32_t mask = new_slot_count - 1;
+        for (int i = 0; i < table->count; i++) {
+            uint32_t slot = table->symbols[i].hash & mask;
+            while (new_slots[slot] >= 0) {
+                slot = (slot + 1) & mask;
             }
-            
-            current_job = &dag.jobs[dag.job_count++];
-            strncpy(current_job->name, name, MAX_NAME_LEN-1);
-            current_job->name[MAX_NAME_LEN-1] = '\0';
-            current_job->dependency_count = 0;
-            current_job->mutex_count = 0;
-            current_job->command[0] = '\0';
-            current_job->completed = false;
-            current_job->failed = false;
-            current_job->remaining_deps = 0;
-            current_job->next_job_count = 0;
-            
-            printf("Найдена задача: %s\n", current_job->name);
-            continue;
+            new_slots[slot] = i;
         }
         
-        //Если у нас есть текущая задача
-        if (current_job != NULL) {
-            //Парсим command
-            if (strncmp(trimmed, "command:", 8) == 0) {
-                char* value = trimmed + 8;
-                while (*value == ' ') value++;
-                
-                //Убираем кавычки если есть
-                if (*value == '"' || *value == '\'') {
-                    char quote = *value;
-                    value++;
-                    char* end_quote = strchr(value, quote);
-                    if (end_quote) *end_quote = '\0';
-                }
-                
-                strncpy(current_job->command, value, COMMAND_BUFFER_SIZE-1);
-                current_job->command[COMMAND_BUFFER_SIZE-1] = '\0';
-                printf("  Команда: %s\n", current_job->command);
-                continue;
-            }
-            
-            //Парсим dependencies
-            if (strncmp(trimmed, "dependencies:", 13) == 0) {
-                printf("  Парсинг зависимостей для %s...\n", current_job->name);
-                
-                char* value = trimmed + 13;
-                while (*value == ' ') value++;
-                
-                //Проверяем формат: dependencies: [job1, job2]
-                if (*value == '[') {
-                    value++; // Пропускаем '['
-                    
-                    //Находим закрывающую скобку
-                    char* end_bracket = strchr(value, ']');
-                    if (end_bracket) *end_bracket = '\0';
-                    
-                    //Парсим зависимости, разделенные запятыми
-                    char* saveptr;
-                    char* dep = strtok_r(value, ",", &saveptr);
-                    while (dep != NULL && current_job->dependency_count < MAX_DEPS) {
-                        //Убираем пробелы
-                        while (*dep == ' ') dep++;
-                        char* end = dep + strlen(dep) - 1;
-                        while (end > dep && (*end == ' ' || *end == ']' || *end == '\t')) {
-                            *end = '\0';
-                            end--;
-                        }
-                        
-                        if (strlen(dep) > 0) {
-                            strncpy(current_job->dependencies[current_job->dependency_count], 
-                                   dep, MAX_NAME_LEN-1);
-                            current_job->dependencies[current_job->dependency_count][MAX_NAME_LEN-1] = '\0';
-                            current_job->dependency_count++;
-                            printf("    Зависимость: %s\n", dep);
-                        }
-                        dep = strtok_r(NULL, ",", &saveptr);
-                    }
-                }
-                continue;
-            }
-            
-            //Парсим mutexes внутри job
-            if (strncmp(trimmed, "mutexes:", 8) == 0) {
-                printf("  Парсинг мьютексов для %s...\n", current_job->name);
-                
-                char* value = trimmed + 8;
-                while (*value == ' ') value++;
-                
-                //Проверяем формат: mutexes: [db_access, file_lock]
-                if (*value == '[') {
-                    value++; // Пропускаем '['
-                    
-                    //Находим закрывающую скобку
-                    char* end_bracket = strchr(value, ']');
-                    if (end_bracket) *end_bracket = '\0';
-                    
-                    //Парсим мьютексы, разделенные запятыми
-                    char* saveptr;
-                    char* mutex = strtok_r(value, ",", &saveptr);
-                    while (mutex != NULL && current_job->mutex_count < MAX_MUTEX_PER_JOB) {
-                        //Убираем пробелы
-                        while (*mutex == ' ') mutex++;
-                        char* end = mutex + strlen(mutex) - 1;
-                        while (end > mutex && (*end == ' ' || *end == ']' || *end == '\t')) {
-                            *end = '\0';
-                            end--;
-                        }
-                        
-                        if (strlen(mutex) > 0) {
-                            strncpy(current_job->mutexes[current_job->mutex_count], 
-                                   mutex, MAX_NAME_LEN-1);
-                            current_job->mutexes[current_job->mutex_count][MAX_NAME_LEN-1] = '\0';
-                            current_job->mutex_count++;
-                            printf("    Мьютекс: %s\n", mutex);
-                        }
-                        mutex = strtok_r(NULL, ",", &saveptr);
-                    }
-                }
-                continue;
-            }
-            
-            //Если строка не начинается с пробела или таба, значит началась новая секция
-            if (trimmed == line) { // Нет отступов в начале
-                current_job = NULL;
-                //Нужно обработать эту строку заново
-                fseek(file, -strlen(line)-1, SEEK_CUR);
-            }
-        }
+        free(table->slots);
+        table->slots = new_slots;
+        table->slot_count = new_slot_count;
     }
     
-    fclose(file);
-    
-    //Теперь добавляем глобальные мьютексы из временного списка
-    for (int i = 0; i < mutex_list_count; i++) {
-        if (mutex_list[i]) {
-            add_mutex(mutex_list[i]);
-            free(mutex_list[i]);
-        }
+    if (!grow_array((void**)&table->symbols, &table->capacity, table->count + 1, sizeof(Symbol))) {
+        return -1;
     }
     
-    printf("Парсинг завершен. Загружено %d задач, %d мьютексов\n", 
-           dag.job_count, dag.mutex_count);
+    id = table->count++;
+    Symbol* symbol = &table->symbols[id];
+    symbol->name = pool_add(name);
+    symbol->hash = hash;
+    symbol->job = -1;
+    symbol->mutex = -1;
     
-    return true;
+    uint32_t mask = table->slot_count - 1;
+    uint32_t slot = hash & mask;
+    while (table->slots[slot] >= 0) {
+        slot = (slot + 1) & mask;
+    }
+    table->slots[slot] = id;
+    
+    return id;
 }
 
-//Построение графа зависимостей
-bool build_dependency_graph(void) {
-    //Инициализация связей next_jobs
-    for (int i = 0; i < dag.job_count; i++) {
-        Job* job = &dag.jobs[i];
-        job->next_job_count = 0;
-        job->remaining_deps = job->dependency_count; //Инициализируем счетчик зависимостей
+//Добавление новой задачи
+Job* add_job(const char* name) {
+    int symbol = intern_symbol(name);
+    if (symbol < 0) {
+        return NULL;
+    }
+    if (dag.symtab.symbols[symbol].job >= 0) {
+        fprintf(stderr, "Задача %s определена повторно\n", name);
+        return NULL;
     }
     
-    //Создаем связи next_jobs
-    for (int i = 0; i < dag.job_count; i++) {
-        Job* job = &dag.jobs[i];
-        
-        for (int j = 0; j < job->dependency_count; j++) {
-            Job* dep = find_job_by_name(job->dependencies[j]);
-            if (!dep) {
-                fprintf(stderr, "Зависимость %s не найдена для задачи %s\n",
-                       job->dependencies[j], job->name);
-                return false;
-            }
-            
-            if (dep->next_job_count >= MAX_DEPS) {
-                fprintf(stderr, "Превышено максимальное количество зависимостей для %s\n",
-                       dep->name);
-                return false;
-            }
-            
-            dep->next_jobs[dep->next_job_count++] = job;
-        }
+    if (!grow_array((void**)&dag.jobs, &dag.job_capacity, dag.job_count + 1, sizeof(Job)) ||
+        !grow_array((void**)&dag.job_runtime, &dag.job_runtime_capacity,
+                    dag.job_count + 1, sizeof(JobRuntime))) {
+        return NULL;
     }
     
-    //Привязываем мьютексы
-    for (int i = 0; i < dag.job_count; i++) {
-        Job* job = &dag.jobs[i];
-        for (int j = 0; j < job->mutex_count; j++) {
-            Mutex* mutex = find_mutex_by_name(job->mutexes[j]);
-            if (!mutex) {
-                fprintf(stderr, "Мьютекс %s не найден для задачи %s\n",
-                       job->mutexes[j], job->name);
-                return false;
-            }
-            job->mutex_ptrs[j] = &mutex->mutex;
-        }
+    dag.symtab.symbols[symbol].job = dag.job_count;
+    memset(&dag.job_runtime[dag.job_count], 0, sizeof(JobRuntime));
+    Job* job = &dag.jobs[dag.job_count++];
+    memset(job, 0, sizeof(Job));
+    job->symbol = symbol;
+    job->name = dag.symtab.symbols[symbol].name;
+    job->command = pool_add("");
+    job->exec_start = -1;
+    job->dep_start = dag.dep_count;
+    job->mutex_start = dag.job_mutex_count;
+    job->estimated_duration = -1.0;
+    return job;
+}
+
+//Состояние запуска задачи
+JobRuntime* job_runtime(const Job* job) {
+    return &dag.job_runtime[job - dag.jobs];
+}
+
+//Добавление зависимости текущей задаче. Задачи разбираются по очереди,
+//поэтому зависимости одной задачи всегда лежат в dep_symbols подряд.
+//Задача-зависимость может быть объявлена ниже, поэтому храним id символа
+bool add_job_dependency(Job* job, const char* name) {
+    int symbol = intern_symbol(name);
+    if (symbol < 0 ||
+        !grow_array((void**)&dag.dep_symbols, &dag.dep_capacity, dag.dep_count + 1, sizeof(int))) {
+        return false;
+    }
+    dag.dep_symbols[dag.dep_count++] = symbol;
+    job->dependency_count++;
+    return true;
+}
+
+//Добавление аргумента exec: текущей задаче. arg == NULL завершает argv
+bool add_job_exec_arg(Job* job, const char* arg) {
+    if (!grow_array((void**)&dag.exec_args, &dag.exec_arg_capacity,
+                    dag.exec_arg_count + 1, sizeof(uint32_t))) {
+        return false;
+    }
+    if (arg == NULL) {
+        dag.exec_args[dag.exec_arg_count++] = EXEC_ARGV_END;
+        return true;
+    }
+    dag.exec_args[dag.exec_arg_count++] = pool_add(arg);
+    job->exec_argc++;
+    return true;
+}
+
+//Добавление входного или выходного файла текущей задаче. Все файлы одного
+//списка идут подряд, поэтому задача хранит только начало и количество
+bool add_job_file(Job* job, const char* path, bool is_input) {
+    if (!grow_array((void**)&dag.job_files, &dag.job_file_capacity,
+                    dag.job_file_count + 1, sizeof(uint32_t))) {
+        return false;
+    }
+    dag.job_files[dag.job_file_count++] = pool_add(path);
+    if (is_input) {
+        job->input_count++;
+    } else {
+        job->output_count++;
+    }
+    return true;
+}
+
+//Добавление мьютекса (amount == 1) или ресурса текущей задаче
+bool add_job_mutex(Job* job, const char* name, int amount) {
+    int symbol = intern_symbol(name);
+    if (symbol < 0 ||
+        !grow_array((void**)&dag.job_mutex_symbols, &dag.job_mutex_capacity,
+                    dag.job_mutex_count + 1, sizeof(int)) ||
+        !grow_array((void**)&dag.job_mutex_amounts, &dag.job_mutex_amount_capacity,
+                    dag.job_mutex_count + 1, sizeof(int))) {
+        return false;
     }
     
-    //Отладочный вывод графа
-    printf("\nПостроен граф зависимостей:\n");
-    for (int i = 0; i < dag.job_count; i++) {
+    dag.job_mutex_symbols[dag.job_mutex_count] = symbol;
+    dag.job_mutex_amounts[dag.job_mutex_count] = amount;
+    dag.job_mutex_count++;
+    job->mutex_count++;
+    return true;
+}
+
+//Функция для поиска задачи по имени (через таблицу символов)
+Job* find_job_by_name(const char* name) {
+    int symbol = lookup_symbol(name, hash_name(name));
+    if (symbol < 0 || dag.symtab.symbols[symbol].job < 0) {
+        return NULL;
+    }
+    return &dag.jobs[dag.symtab.symbols[symbol].job];
+}
+
+//Функция для поиска мьютекса по имени (через таблицу символов)
+Mutex* find_mutex_by_name(const char* name) {
+    int symbol = lookup_symbol(name, hash_name(name));
+    if (symbol < 0 || dag.symtab.symbols[symbol].mutex < 0) {
+        return NULL;
+    }
+    return &dag.mutexes[dag.symtab.symbols[symbol].mutex];
+}
+
+//Функция для добавления мьютекса
+Mutex* add_mutex(const char* name) {
+    return add_resource(name, 1);
+}
+
+//Функция для добавления ресурса заданной емкости. Повторное объявление
+//обновляет емкость
+Mutex* add_resource(const char* name, int capacity) {
+    int symbol = intern_symbol(name);
+    if (symbol < 0) {
+        return NULL;
+    }
+    
+    Symbol* sym = &dag.symtab.symbols[symbol];
+    if (sym->mutex >= 0) {
+        Mutex* mutex = &dag.mutexes[sym->mutex];
+        mutex->capacity = capacity;
+        mutex->ref_count++;
+        return mutex;
+    }
+    
+    if (!grow_array((void**)&dag.mutexes, &dag.mutex_capacity, dag.mutex_count + 1, sizeof(Mutex))) {
+        return NULL;
+    }
+    
+    sym->mutex = dag.mutex_count;
+    Mutex* mutex = &dag.mutexes[dag.mutex_count++];
+    mutex->name = sym->name;
+    mutex->capacity = capacity;
+    mutex->ref_count = 1;
+    
+    return mutex;
+}
+
+//Расширение scratch до size байт
+bool scratch_reserve(ConfigScanner* sc, size_t size) {
+    if (size <= sc->scratch_capacity) {
+        return true;
+    }
+    size_t new_capacity = sc->scratch_capacity > 0 ? sc->scratch_capacity : 256;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+    char* new_scratch = realloc(sc->scratch, new_capacity);
+    if (!new_scratch) {
+        fprintf(stderr, "Не удалось выделить память под разбор конфигурации\n");
+        return false;
+    }
+    sc->scratch = new_scratch;
+    sc->scratch_capacity = new_capacity;
+    return true;
+}
+
+//Конец полезной части строки: отрезает комментарий и пробелы в конце.
+//'#' начинает комментарий только в начале строки или после пробела
+//и вне кавычек
+const char* strip_line(const char* p, const char* end) {
+    const char* hash = memchr(p, '#', end - p);
+    if (hash) {
+        char quote = 0;
+        for (const char* c = p; c < end; c++) {
+            if (quote) {
+                if (*c == '\\' && quote == '"' && c + 1 < end) c++;
+                else if (*c == quote) quote = 0;
+            } else if (*c == '"' || *c == '\'') {
+                quote = *c;
+            } else if (*c == '#' && (c == p || c[-1] == ' ' || c[-1] == '\t')) {
+                end = c;
+                break;
+            }
+        }
+    }
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    return end;
+}
+
+//Копирование скаляра из [p, end) в scratch. Двойные кавычки раскрывают
+//\" \\ \n \t, в одинарных '' означает одну кавычку. in_flow: значение
+//внутри [..] или {..}, простой скаляр заканчивается на ',' ']' '}'.
+//*next - позиция сразу после скаляра
+const char* scan_scalar(ConfigScanner* sc, const char* p, const char* end,
+                        bool in_flow, const char** next) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (!scratch_reserve(sc, (end - p) + 1)) {
+        return NULL;
+    }
+
+    char* out = sc->scratch;
+    if (p < end && (*p == '"' || *p == '\'')) {
+        char quote = *p++;
+        while (p < end) {
+            if (*p == quote) {
+                if (quote == '\'' && p + 1 < end && p[1] == '\'') {
+                    *out++ = '\'';
+                    p += 2;
+                    continue;
+                }
+                p++;
+                break;
+            }
+            if (quote == '"' && *p == '\\' && p + 1 < end) {
+                p++;
+                switch (*p) {
+                    case 'n': *out++ = '\n'; break;
+                    case 't': *out++ = '\t'; break;
+                    default: *out++ = *p; break;
+                }
+                p++;
+                continue;
+            }
+            *out++ = *p++;
+        }
+    } else {
+        const char* start = p;
+        while (p < end && !(in_flow && (*p == ',' || *p == ']' || *p == '}'))) p++;
+        const char* value_end = p;
+        while (value_end > start && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+        memcpy(out, start, value_end - start);
+        out += value_end - start;
+    }
+    *out = '\0';
+
+    if (next) *next = p;
+    return sc->scratch;
+}
+
+//Следующий элемент flow-списка [a, "b, c", d]; *cursor стоит после '['
+//или после предыдущего элемента. NULL - список закончился
+const char* next_flow_item(ConfigScanner* sc, const char** cursor, const char* end) {
+    const char* p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+    if (p >= end || *p == ']' || *p == '}') {
+        *cursor = p;
+        return NULL;
+    }
+    const char* item = scan_scalar(sc, p, end, true, &p);
+    *cursor = p;
+    return item;
+}
+
+//Начало flow-списка: пропускает пробелы и открывающую скобку open
+bool open_flow(ConfigScanner* sc, const char** value, const char* end, char open,
+               const char* key) {
+    const char* p = *value;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p >= end) {
+        //Пустое значение - пустой список
+        *value = p;
+        return true;
+    }
+    if (*p != open) {
+        fprintf(stderr, "%s:%d: значение %s должно начинаться с '%c'\n",
+                sc->path, sc->line_no, key, open);
+        return false;
+    }
+    *value = p + 1;
+    return true;
+}
+
+//Сравнение ключа [key, key + len) со строкой
+bool key_is(const char* key, size_t len, const char* name) {
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
+
+//Разбор строки с ключом внутри задачи; value - все после двоеточия
+bool parse_job_key(ConfigScanner* sc, Job* job, const char* key, size_t key_len,
+                   const char* value, const char* end) {
+    const char* item;
+
+    if (key_is(key, key_len, "command")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        job->command = pool_add(item);
+        if (sc->verbose) printf("  Команда: %s\n", item);
+        return true;
+    }
+
+    //exec: argv команды, запускаемой напрямую без /bin/sh:
+    //exec: [/bin/echo, "hello, world"]
+    if (key_is(key, key_len, "exec")) {
+        if (!open_flow(sc, &value, end, '[', "exec")) return false;
+        job->exec_start = dag.exec_arg_count;
+        job->exec_argc = 0;
+        if (sc->verbose) printf("  Exec:");
+        while ((item = next_flow_item(sc, &value, end))) {
+            if (!add_job_exec_arg(job, item)) return false;
+            if (sc->verbose) printf(" %s", item);
+        }
+        if (sc->verbose) printf("\n");
+        if (job->exec_argc == 0 || !add_job_exec_arg(job, NULL)) {
+            fprintf(stderr, "Ошибка: пустой exec у задачи %s\n", pool_str(job->name));
+            return false;
+        }
+        return true;
+    }
+
+    //timeout: ограничение времени выполнения в секундах
+    if (key_is(key, key_len, "timeout")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        job->timeout = atof(item);
+        if (sc->verbose) printf("  Тайм-аут: %.2f с\n", job->timeout);
+        return true;
+    }
+
+    //cpu_max: лимит процессора в ядрах, memory_max_mb: лимит памяти (для --cgroups)
+    if (key_is(key, key_len, "cpu_max")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        job->cpu_max = atof(item);
+        if (job->cpu_max < 0) job->cpu_max = 0;
+        if (sc->verbose) printf("  Лимит процессора: %.2f ядра\n", job->cpu_max);
+        return true;
+    }
+    if (key_is(key, key_len, "memory_max_mb")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        job->memory_max_kb = atol(item) * 1024;
+        if (job->memory_max_kb < 0) job->memory_max_kb = 0;
+        if (sc->verbose) printf("  Лимит памяти: %ld МБ\n", job->memory_max_kb / 1024);
+        return true;
+    }
+
+    //estimated_duration: оценка длительности в секундах
+    if (key_is(key, key_len, "estimated_duration")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        job->estimated_duration = atof(item);
+        if (job->estimated_duration < 0) job->estimated_duration = -1.0;
+        if (sc->verbose) printf("  Оценка длительности: %.2f с\n", job->estimated_duration);
+        return true;
+    }
+
+    //dependencies: [job1, job2]
+    if (key_is(key, key_len, "dependencies")) {
+        if (sc->verbose) printf("  Парсинг зависимостей для %s...\n", pool_str(job->name));
+        if (!open_flow(sc, &value, end, '[', "dependencies")) return false;
+        while ((item = next_flow_item(sc, &value, end))) {
+            if (!add_job_dependency(job, item)) return false;
+            if (sc->verbose) printf("    Зависимость: %s\n", item);
+        }
+        return true;
+    }
+
+    //inputs и outputs: inputs: [data.csv, params.json]
+    bool is_inputs = key_is(key, key_len, "inputs");
+    if (is_inputs || key_is(key, key_len, "outputs")) {
+        if (is_inputs) {
+            job->input_start = dag.job_file_count;
+            job->input_count = 0;
+        } else {
+            job->output_start = dag.job_file_count;
+            job->output_count = 0;
+        }
+        if (!open_flow(sc, &value, end, '[', is_inputs ? "inputs" : "outputs")) return false;
+        while ((item = next_flow_item(sc, &value, end))) {
+            if (!add_job_file(job, item, is_inputs)) return false;
+            if (sc->verbose) printf("    %s: %s\n", is_inputs ? "Вход" : "Выход", item);
+        }
+        return true;
+    }
+
+    //mutexes: [db_access, file_lock]
+    if (key_is(key, key_len, "mutexes")) {
+        if (sc->verbose) printf("  Парсинг мьютексов для %s...\n", pool_str(job->name));
+        if (!open_flow(sc, &value, end, '[', "mutexes")) return false;
+        while ((item = next_flow_item(sc, &value, end))) {
+            if (!add_job_mutex(job, item, 1)) return false;
+            if (sc->verbose) printf("    Мьютекс: %s\n", item);
+        }
+        return true;
+    }
+
+    //resources: {db_connections: 2, ram_gb: 48}
+    if (key_is(key, key_len, "resources")) {
+        if (sc->verbose) printf("  Парсинг ресурсов для %s...\n", pool_str(job->name));
+        if (!open_flow(sc, &value, end, '{', "resources")) return false;
+        while ((item = next_flow_item(sc, &value, end))) {
+            //Количество по умолчанию - одна единица
+            char* resource = (char*)item;
+            int amount = 1;
+            char* colon = strchr(resource, ':');
+            if (colon) {
+                amount = atoi(colon + 1);
+                while (colon > resource && (colon[-1] == ' ' || colon[-1] == '\t')) colon--;
+                *colon = '\0';
+            }
+            if (resource[0] == '\0') continue;
+            if (amount <= 0) {
+                fprintf(stderr, "Ошибка: задача %s запрашивает %d единиц ресурса %s\n",
+                        pool_str(job->name), amount, resource);
+                return false;
+            }
+            if (!add_job_mutex(job, resource, amount)) return false;
+            if (sc->verbose) printf("    Ресурс: %s x%d\n", resource, amount);
+        }
+        return true;
+    }
+
+    //emits: true - задача пишет описания новых задач в EMIT_FD
+    if (key_is(key, key_len, "emits")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        job->emits = strcmp(item, "true") == 0;
+        if (sc->verbose && job->emits) printf("  Добавляет задачи через fd %d\n", EMIT_FD);
+        return true;
+    }
+
+    //batchable: true - короткая задача, которую можно выполнить в общем shell
+    if (key_is(key, key_len, "batchable")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        job->batchable = strcmp(item, "true") == 0;
+        if (sc->verbose && job->batchable) printf("  Выполняется в общем shell слота\n");
+        return true;
+    }
+
+    //Опечатка в ключе (dependecies:) молча убрала бы ребра графа
+    fprintf(stderr, "%s:%d: неизвестный ключ задачи %s: %.*s\n",
+            sc->path, sc->line_no, pool_str(job->name), (int)key_len, key);
+    return false;
+}
+
+//Разбор строки верхнего уровня (без отступа). Меняет текущую секцию
+bool parse_top_level(ConfigScanner* sc, const char* line, const char* end,
+                     ConfigSection* section, Job** current_job) {
+    *section = SECTION_NONE;
+    *current_job = NULL;
+
+    const char* colon = memchr(line, ':', end - line);
+    if (!colon) {
+        fprintf(stderr, "%s:%d: ожидалось \"ключ:\"\n", sc->path, sc->line_no);
+        return false;
+    }
+    const char* key_end = colon;
+    while (key_end > line && (key_end[-1] == ' ' || key_end[-1] == '\t')) key_end--;
+    size_t key_len = key_end - line;
+    const char* value = colon + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    const char* item;
+
+    //Задача может описывать только новые задачи
+    if (sc->jobs_only && (value != end || key_is(line, key_len, "mutexes") ||
+                          key_is(line, key_len, "resources"))) {
+        fprintf(stderr, "%s:%d: ожидалось описание задачи \"имя:\", а не %.*s\n",
+                sc->path, sc->line_no, (int)key_len, line);
+        return false;
+    }
+
+    //max_concurrent
+    if (key_is(line, key_len, "max_concurrent")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        dag.max_concurrent = atoi(item);
+        if (dag.max_concurrent <= 0) dag.max_concurrent = DEFAULT_MAX_CONCURRENT;
+        printf("Найдено max_concurrent: %d\n", dag.max_concurrent);
+        return true;
+    }
+
+    //memory_limit_mb: лимит памяти для одновременно запущенных задач
+    if (key_is(line, key_len, "memory_limit_mb")) {
+        if (!(item = scan_scalar(sc, value, end, false, NULL))) return false;
+        dag.memory_limit_kb = atol(item) * 1024;
+        if (dag.memory_limit_kb < 0) dag.memory_limit_kb = 0;
+        printf("Найдено memory_limit_mb: %ld\n", dag.memory_limit_kb / 1024);
+        return true;
+    }
+
+    //Глобальные mutexes: блочный список "- имя" или [a, b]
+    if (key_is(line, key_len, "mutexes")) {
+        printf("Парсинг глобальных мьютексов...\n");
+        *section = SECTION_MUTEXES;
+        if (value < end) {
+            if (!open_flow(sc, &value, end, '[', "mutexes")) return false;
+            while ((item = next_flow_item(sc, &value, end))) {
+                if (!add_mutex(item)) return false;
+                printf("  Найден мьютекс: %s\n", item);
+            }
+        }
+        return true;
+    }
+
+    //Глобальные resources - счетные ресурсы с емкостью:
+    //resources:
+    //  db_connections: 8
+    //  ram_gb: 64
+    if (key_is(line, key_len, "resources")) {
+        printf("Парсинг глобальных ресурсов...\n");
+        *section = SECTION_RESOURCES;
+        return true;
+    }
+
+    //Любой другой ключ без значения - задача
+    if (value == end) {
+        if (key_len == 0 || key_len >= MAX_NAME_LEN) {
+            fprintf(stderr, "%s:%d: недопустимая длина имени задачи\n", sc->path, sc->line_no);
+            return false;
+        }
+        if (!scratch_reserve(sc, key_len + 1)) return false;
+        memcpy(sc->scratch, line, key_len);
+        sc->scratch[key_len] = '\0';
+
+        *current_job = add_job(sc->scratch);
+        if (!*current_job) return false;
+        *section = SECTION_JOB;
+
+        if (dag.job_count <= GRAPH_PRINT_LIMIT) {
+            printf("Найдена задача: %s\n", sc->scratch);
+        } else if (sc->verbose) {
+            printf("... (остальные задачи загружаются без подробного вывода)\n");
+        }
+        sc->verbose = dag.job_count <= GRAPH_PRINT_LIMIT;
+        return true;
+    }
+
+    fprintf(stderr, "%s:%d: неизвестный ключ %.*s\n", sc->path, sc->line_no, (int)key_len, line);
+    return false;
+}
+
+//Разбор строки с отступом в секции глобальных mutexes или resources
+bool parse_section_item(ConfigScanner* sc, ConfigSection section,
+                        const char* line, const char* end) {
+    const char* item;
+
+    if (section == SECTION_MUTEXES) {
+        if (*line != '-') {
+            fprintf(stderr, "%s:%d: ожидался элемент списка мьютексов \"- имя\"\n",
+                    sc->path, sc->line_no);
+            return false;
+        }
+        if (!(item = scan_scalar(sc, line + 1, end, false, NULL))) return false;
+        if (item[0] != '\0') {
+            if (!add_mutex(item)) return false;
+            printf("  Найден мьютекс: %s\n", item);
+        }
+        return true;
+    }
+
+    //SECTION_RESOURCES: "имя: емкость"
+    const char* colon = memchr(line, ':', end - line);
+    if (!colon) {
+        fprintf(stderr, "Ошибка: у ресурса не указана емкость: %.*s\n", (int)(end - line), line);
+        return false;
+    }
+    if (!(item = scan_scalar(sc, colon + 1, end, false, NULL))) return false;
+    int capacity = atoi(item);
+
+    const char* name_end = colon;
+    while (name_end > line && (name_end[-1] == ' ' || name_end[-1] == '\t')) name_end--;
+    if (!scratch_reserve(sc, (name_end - line) + 1)) return false;
+    memcpy(sc->scratch, line, name_end - line);
+    sc->scratch[name_end - line] = '\0';
+
+    if (capacity <= 0) {
+        fprintf(stderr, "Ошибка: емкость ресурса %s должна быть положительной\n", sc->scratch);
+        return false;
+    }
+    if (!add_resource(sc->scratch, capacity)) return false;
+    printf("  Найден ресурс: %s (емкость %d)\n", sc->scratch, capacity);
+    return true;
+}
+
+//Разбор текста конфигурации [data, data + size): строки читаются по порядку,
+//и каждая сразу добавляется в dag. Используется и для файла конфигурации,
+//и для описаний задач, которые присылает задача с emits: true
+bool parse_config_data(ConfigScanner* sc, const char* data, size_t size) {
+    ConfigSection section = SECTION_NONE;
+    Job* current_job = NULL;
+    bool ok = true;
+
+    const char* end = data + size;
+    const char* line = data;
+    while (ok && line < end) {
+        const char* eol = memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        sc->line_no++;
+
+        const char* content = line;
+        while (content < eol && (*content == ' ' || *content == '\t')) content++;
+        const char* content_end = strip_line(content, eol);
+
+        //Пустые строки и строки из одного комментария
+        if (content < content_end) {
+            if (content == line) {
+                ok = parse_top_level(sc, content, content_end, &section, &current_job);
+            } else if (section == SECTION_JOB) {
+                const char* colon = memchr(content, ':', content_end - content);
+                if (!colon) {
+                    fprintf(stderr, "%s:%d: ожидалось \"ключ: значение\"\n", sc->path, sc->line_no);
+                    ok = false;
+                } else {
+                    const char* key_end = colon;
+                    while (key_end > content && (key_end[-1] == ' ' || key_end[-1] == '\t')) key_end--;
+                    ok = parse_job_key(sc, current_job, content, key_end - content,
+                                       colon + 1, content_end);
+                }
+            } else if (section != SECTION_NONE) {
+                ok = parse_section_item(sc, section, content, content_end);
+            }
+        }
+        line = eol + 1;
+    }
+    return ok;
+}
+
+//Разбор YAML конфигурации за один проход по отображенному в память файлу.
+//Поддерживается подмножество YAML, которое используют конфигурации DAG:
+//ключи верхнего уровня, задачи с вложенными ключами, flow-списки [..]
+//и {..}, кавычки, комментарии, переводы строк LF и CRLF
+bool parse_yaml_config_simple(const char* filename) {
+    printf("Упрощенный парсинг YAML конфигурации...\n");
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Не удалось открыть файл %s\n", filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return false;
+    }
+
+    //Значения по умолчанию
+    dag.max_concurrent = DEFAULT_MAX_CONCURRENT;
+    dag.job_count = 0;
+    dag.mutex_count = 0;
+    dag.dep_count = 0;
+    dag.job_mutex_count = 0;
+
+    const char* data = NULL;
+    if (st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return false;
+        }
+        madvise((void*)data, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    ConfigScanner sc = { .path = filename, .verbose = true };
+    bool ok = parse_config_data(&sc, data, st.st_size);
+
+    if (data) {
+        munmap((void*)data, st.st_size);
+    }
+    free(sc.scratch);
+    if (!ok) {
+        return false;
+    }
+
+    printf("Парсинг завершен. Загружено %d задач, %d мьютексов\n",
+           dag.job_count, dag.mutex_count);
+
+    return true;
+}
+
+//Построение графа зависимостей
+bool build_dependency_graph(void) {
+    //Массивы, размер которых зависит от числа задач и ребер
+    dag.next_offsets = calloc(dag.job_count + 1, sizeof(int));
+    dag.next_jobs = malloc((dag.dep_count > 0 ? dag.dep_count : 1) * sizeof(int));
+    dag.job_mutexes = malloc((dag.job_mutex_count > 0 ? dag.job_mutex_count : 1) * sizeof(int));
+    dag.ready_queue = malloc((dag.job_count > 0 ? dag.job_count : 1) * sizeof(int));
+    dag.deferred_jobs = malloc((dag.job_count > 0 ? dag.job_count : 1) * sizeof(int));
+    dag.deps = malloc((dag.dep_count > 0 ? dag.dep_count : 1) * sizeof(int));
+    if (!dag.next_offsets || !dag.next_jobs || !dag.job_mutexes || !dag.ready_queue ||
+        !dag.deferred_jobs || !dag.deps) {
+        fprintf(stderr, "Не удалось выделить память под граф\n");
+        return false;
+    }
+    dag.graph_capacity = dag.job_count > 0 ? dag.job_count : 1;
+    dag.resolved_dep_capacity = dag.dep_count > 0 ? dag.dep_count : 1;
+    dag.next_job_capacity = dag.resolved_dep_capacity;
+    dag.resolved_mutex_capacity = dag.job_mutex_count > 0 ? dag.job_mutex_count : 1;
+    
+    //Разрешаем имена зависимостей и считаем число последователей каждой задачи
+    for (int i = 0; i < dag.job_count; i++) {
+        Job* job = &dag.jobs[i];
+        job->remaining_deps = job->dependency_count; //Инициализируем счетчик зависимостей
+        
+        for (int j = 0; j < job->dependency_count; j++) {
+            Symbol* dep = &dag.symtab.symbols[dag.dep_symbols[job->dep_start + j]];
+            if (dep->job < 0) {
+                fprintf(stderr, "Зависимость %s не найдена для задачи %s\n",
+                       pool_str(dep->name), pool_str(job->name));
+                return false;
+            }
+            
+            int dep_idx = dep->job;
+            dag.deps[job->dep_start + j] = dep_idx;
+            dag.next_offsets[dep_idx + 1]++;
+        }
+    }
+    
+    //Префиксные суммы дают начало отрезка последователей каждой задачи
+    for (int i = 0; i < dag.job_count; i++) {
+        dag.next_offsets[i + 1] += dag.next_offsets[i];
+    }
+    
+    //Раскладываем ребра по отрезкам
+    int* fill = malloc((dag.job_count > 0 ? dag.job_count : 1) * sizeof(int));
+    if (!fill) {
+        fprintf(stderr, "Не удалось выделить память под граф\n");
+        return false;
+    }
+    memcpy(fill, dag.next_offsets, dag.job_count * sizeof(int));
+    for (int i = 0; i < dag.job_count; i++) {
+        Job* job = &dag.jobs[i];
+        for (int j = 0; j < job->dependency_count; j++) {
+            int dep_idx = dag.deps[job->dep_start + j];
+            dag.next_jobs[fill[dep_idx]++] = i;
+        }
+    }
+    free(fill);
+    
+    //Привязываем мьютексы
+    for (int i = 0; i < dag.job_count; i++) {
+        if (!resolve_job_mutexes(&dag.jobs[i])) {
+            return false;
+        }
+    }
+    
+    for (int i = 0; i < dag.mutex_count; i++) {
+        dag.mutexes[i].used = 0;
+        dag.mutexes[i].contended = 0;
+    }
+    
+    //Место под argv для exec (указатели заполняет launch_job)
+    if (dag.exec_arg_count > 0 &&
+        !grow_array((void**)&dag.exec_argv, &dag.exec_argv_capacity, dag.exec_arg_count, sizeof(char*))) {
+        fprintf(stderr, "Не удалось выделить память для argv задач\n");
+        return false;
+    }
+    
+    //Отладочный вывод графа
+    if (dag.job_count > GRAPH_PRINT_LIMIT) {
+        printf("\nПостроен граф зависимостей: %d задач, %d ребер\n",
+               dag.job_count, dag.dep_count);
+        return true;
+    }
+    
+    printf("\nПостроен граф зависимостей:\n");
+    for (int i = 0; i < dag.job_count; i++) {
         Job* job = &dag.jobs[i];
-        printf("  %s:", job->name);
+        printf("  %s:", pool_str(job->name));
         
         if (job->dependency_count > 0) {
             printf(" зависит от [");
             for (int j = 0; j < job->dependency_count; j++) {
-                printf("%s", job->dependencies[j]);
+                printf("%s", pool_str(dag.symtab.symbols[dag.dep_symbols[job->dep_start + j]].name));
                 if (j < job->dependency_count - 1) printf(", ");
             }
             printf("]");
@@ -440,11 +1678,13 @@ bool build_dependency_graph(void) {
             printf(" (стартовая задача)");
         }
         
-        if (job->next_job_count > 0) {
+        int next_begin = dag.next_offsets[i];
+        int next_end = dag.next_offsets[i + 1];
+        if (next_end > next_begin) {
             printf(", ведет к [");
-            for (int j = 0; j < job->next_job_count; j++) {
-                printf("%s", job->next_jobs[j]->name);
-                if (j < job->next_job_count - 1) printf(", ");
+            for (int e = next_begin; e < next_end; e++) {
+                printf("%s", pool_str(dag.jobs[dag.next_jobs[e]].name));
+                if (e < next_end - 1) printf(", ");
             }
             printf("]");
         } else {
@@ -454,314 +1694,4420 @@ bool build_dependency_graph(void) {
         if (job->mutex_count > 0) {
             printf(", мьютексы: [");
             for (int j = 0; j < job->mutex_count; j++) {
-                printf("%s", job->mutexes[j]);
+                printf("%s", pool_str(dag.mutexes[dag.job_mutexes[job->mutex_start + j]].name));
+                if (dag.job_mutex_amounts[job->mutex_start + j] > 1) {
+                    printf(" x%d", dag.job_mutex_amounts[job->mutex_start + j]);
+                }
                 if (j < job->mutex_count - 1) printf(", ");
             }
             printf("]");
         }
-        
-        printf(", оставшиеся зависимости: %d\n", job->remaining_deps);
+        
+        printf(", оставшиеся зависимости: %d\n", job->remaining_deps);
+    }
+    
+    return true;
+}
+
+//Привязка мьютексов и ресурсов задачи к индексам в dag.mutexes, объединение
+//повторов и проверка емкости (при построении графа и для динамических задач)
+bool resolve_job_mutexes(Job* job) {
+    for (int j = 0; j < job->mutex_count; j++) {
+        Symbol* mutex = &dag.symtab.symbols[dag.job_mutex_symbols[job->mutex_start + j]];
+        if (mutex->mutex < 0) {
+            fprintf(stderr, "Мьютекс %s не найден для задачи %s\n",
+                   pool_str(mutex->name), pool_str(job->name));
+            return false;
+        }
+        dag.job_mutexes[job->mutex_start + j] = mutex->mutex;
+    }
+    
+    //Канонический порядок: мьютексы задачи сортируются по индексу,
+    //повторы объединяются (их количества складываются). Порядок из YAML
+    //больше ни на что не влияет
+    int* mutexes = &dag.job_mutexes[job->mutex_start];
+    int* amounts = &dag.job_mutex_amounts[job->mutex_start];
+    for (int j = 1; j < job->mutex_count; j++) {
+        int value = mutexes[j];
+        int amount = amounts[j];
+        int k = j - 1;
+        while (k >= 0 && mutexes[k] > value) {
+            mutexes[k + 1] = mutexes[k];
+            amounts[k + 1] = amounts[k];
+            k--;
+        }
+        mutexes[k + 1] = value;
+        amounts[k + 1] = amount;
+    }
+    int unique = 0;
+    for (int j = 0; j < job->mutex_count; j++) {
+        if (unique > 0 && mutexes[unique - 1] == mutexes[j]) {
+            amounts[unique - 1] += amounts[j];
+        } else {
+            mutexes[unique] = mutexes[j];
+            amounts[unique] = amounts[j];
+            unique++;
+        }
+    }
+    job->mutex_count = unique;
+    
+    //Задача, которой нужно больше емкости ресурса, не запустится никогда
+    for (int j = 0; j < job->mutex_count; j++) {
+        Mutex* mutex = &dag.mutexes[mutexes[j]];
+        if (amounts[j] > mutex->capacity) {
+            fprintf(stderr, "Задача %s запрашивает %d единиц ресурса %s, а его емкость %d\n",
+                    pool_str(job->name), amounts[j], pool_str(mutex->name), mutex->capacity);
+            return false;
+        }
+    }
+    return true;
+}
+
+//Топологическая сортировка (алгоритм Кана, без рекурсии).
+//Заполняет dag.topo_order и dag.levels; при цикле печатает его и возвращает false
+bool topological_sort(void) {
+    int n = dag.job_count;
+    dag.topo_order = malloc((n > 0 ? n : 1) * sizeof(int));
+    dag.levels = calloc(n > 0 ? n : 1, sizeof(int));
+    int* indegree = malloc((n > 0 ? n : 1) * sizeof(int));
+    if (!dag.topo_order || !dag.levels || !indegree) {
+        fprintf(stderr, "Не удалось выделить память для топологической сортировки\n");
+        free(indegree);
+        return false;
+    }
+    
+    //topo_order одновременно служит очередью: [head, tail) - задачи,
+    //у которых не осталось необработанных зависимостей
+    int tail = 0;
+    for (int i = 0; i < n; i++) {
+        indegree[i] = dag.jobs[i].dependency_count;
+        if (indegree[i] == 0) {
+            dag.topo_order[tail++] = i;
+        }
+    }
+    dag.start_job_count = tail;
+    dag.level_count = n > 0 ? 1 : 0;
+    
+    for (int head = 0; head < tail; head++) {
+        int job_idx = dag.topo_order[head];
+        int next_level = dag.levels[job_idx] + 1;
+        
+        for (int e = dag.next_offsets[job_idx]; e < dag.next_offsets[job_idx + 1]; e++) {
+            int next_idx = dag.next_jobs[e];
+            if (dag.levels[next_idx] < next_level) {
+                dag.levels[next_idx] = next_level;
+            }
+            if (--indegree[next_idx] == 0) {
+                dag.topo_order[tail++] = next_idx;
+                //Все зависимости обработаны, уровень задачи окончательный
+                if (dag.levels[next_idx] + 1 > dag.level_count) {
+                    dag.level_count = dag.levels[next_idx] + 1;
+                }
+            }
+        }
+    }
+    
+    //Все задачи, которые так и не попали в порядок, лежат на цикле или за ним
+    if (tail < n) {
+        report_cycle(indegree);
+        free(indegree);
+        return false;
+    }
+    
+    free(indegree);
+    return true;
+}
+
+//Вывод задач, входящих в циклы, и одного конкретного цикла.
+//indegree - остатки после алгоритма Кана: > 0 у всех необработанных задач
+void report_cycle(int* indegree) {
+    int n = dag.job_count;
+    
+    //Отбрасываем задачи "за циклом": обратный алгоритм Кана по необработанным
+    //задачам снимает те, из которых не выходит ребер в оставшееся множество
+    int* outdegree = calloc(n, sizeof(int));
+    int* queue = malloc(n * sizeof(int));
+    if (!outdegree || !queue) {
+        fprintf(stderr, "Обнаружен цикл в DAG\n");
+        free(outdegree);
+        free(queue);
+        return;
+    }
+    
+    int tail = 0;
+    for (int i = 0; i < n; i++) {
+        if (indegree[i] == 0) continue;
+        for (int e = dag.next_offsets[i]; e < dag.next_offsets[i + 1]; e++) {
+            if (indegree[dag.next_jobs[e]] > 0) {
+                outdegree[i]++;
+            }
+        }
+        if (outdegree[i] == 0) {
+            queue[tail++] = i;
+        }
+    }
+    for (int head = 0; head < tail; head++) {
+        int job_idx = queue[head];
+        indegree[job_idx] = 0;
+        Job* job = &dag.jobs[job_idx];
+        for (int j = 0; j < job->dependency_count; j++) {
+            int dep_idx = dag.deps[job->dep_start + j];
+            if (indegree[dep_idx] > 0 && --outdegree[dep_idx] == 0) {
+                queue[tail++] = dep_idx;
+            }
+        }
+    }
+    
+    //Оставшиеся задачи лежат на циклах
+    int members = 0;
+    int first = -1;
+    fprintf(stderr, "Обнаружен цикл в DAG. Задачи в циклах:");
+    for (int i = 0; i < n; i++) {
+        if (indegree[i] > 0) {
+            if (members < GRAPH_PRINT_LIMIT) {
+                fprintf(stderr, " %s", pool_str(dag.jobs[i].name));
+            }
+            if (first < 0) first = i;
+            members++;
+        }
+    }
+    if (members > GRAPH_PRINT_LIMIT) {
+        fprintf(stderr, " ... (всего %d)", members);
+    }
+    fprintf(stderr, "\n");
+    
+    //Идем по ребрам внутри оставшегося множества, пока не встретим
+    //уже посещенную задачу - это и есть конкретный цикл
+    if (first >= 0) {
+        int* visit_step = outdegree; //Переиспользуем: номер шага посещения + 1
+        memset(visit_step, 0, n * sizeof(int));
+        int path_len = 0;
+        int current = first;
+        while (visit_step[current] == 0) {
+            queue[path_len++] = current;
+            visit_step[current] = path_len;
+            for (int e = dag.next_offsets[current]; e < dag.next_offsets[current + 1]; e++) {
+                if (indegree[dag.next_jobs[e]] > 0) {
+                    current = dag.next_jobs[e];
+                    break;
+                }
+            }
+        }
+        
+        fprintf(stderr, "  Цикл:");
+        for (int k = visit_step[current] - 1; k < path_len; k++) {
+            fprintf(stderr, " %s ->", pool_str(dag.jobs[queue[k]].name));
+        }
+        fprintf(stderr, " %s\n", pool_str(dag.jobs[current].name));
+    }
+    
+    free(outdegree);
+    free(queue);
+}
+
+//Проверка корректности DAG
+bool validate_dag(void) {
+    //Проверка на наличие задач
+    if (dag.job_count == 0) {
+        fprintf(stderr, "DAG не содержит задач\n");
+        return false;
+    }
+    
+    //Проверка на циклы и построение топологического порядка
+    if (!topological_sort()) {
+        return false;
+    }
+    
+    //Проверка на наличие стартовых задач (задачи без зависимостей)
+    int start_jobs = dag.start_job_count;
+    
+    if (start_jobs == 0) {
+        fprintf(stderr, "Нет стартовых задач (задач без зависимостей)\n");
+        return false;
+    }
+    
+    //Проверка на наличие завершающих задач (задачи, от которых никто не зависит)
+    int end_jobs = 0;
+    for (int i = 0; i < dag.job_count; i++) {
+        if (dag.next_offsets[i + 1] == dag.next_offsets[i]) {
+            end_jobs++;
+        }
+    }
+    
+    if (end_jobs == 0) {
+        fprintf(stderr, "Нет завершающих задач\n");
+        return false;
+    }
+    
+    //Визуализация графа по уровням
+    printf("\nСтруктура графа (%d уровней):\n", dag.level_count);
+    if (dag.job_count <= GRAPH_PRINT_LIMIT) {
+        for (int level = 0; level < dag.level_count; level++) {
+            printf("  Уровень %d:", level);
+            for (int k = 0; k < dag.job_count; k++) {
+                int job_idx = dag.topo_order[k];
+                if (dag.levels[job_idx] == level) {
+                    printf(" %s", pool_str(dag.jobs[job_idx].name));
+                }
+            }
+            printf("\n");
+        }
+    }
+    
+    printf("\nDAG корректен:\n");
+    printf("  Всего задач: %d\n", dag.job_count);
+    printf("  Стартовых задач: %d\n", start_jobs);
+    printf("  Завершающих задач: %d\n", end_jobs);
+    printf("  Максимально параллельных задач: %d\n", dag.max_concurrent);
+    printf("  Всего мьютексов: %d\n", dag.mutex_count);
+    
+    return true;
+}
+
+//Вес задачи для планирования: оценка из YAML, иначе время последнего
+//успешного запуска из истории, иначе значение по умолчанию
+double job_weight(const Job* job) {
+    JobRuntime* run = job_runtime(job);
+    if (job->estimated_duration >= 0) {
+        return job->estimated_duration;
+    }
+    if (run->last_run.run_id != 0 && !run->last_run.failed) {
+        return run->last_run.wall_time;
+    }
+    return DEFAULT_JOB_DURATION;
+}
+
+//Можно ли запустить задачу, не превысив memory_limit_mb (вызывается из цикла событий).
+//Прогноз памяти берется из истории; если ничего не запущено, задача
+//допускается всегда, иначе она никогда бы не запустилась
+bool can_admit_job(int job_idx) {
+    if (dag.memory_limit_kb == 0 || dag.running_jobs == 0) {
+        return true;
+    }
+    long predicted = dag.job_runtime[job_idx].last_run.max_rss_kb;
+    return dag.running_memory_kb + predicted <= dag.memory_limit_kb;
+}
+
+//Первый ресурс задачи, в котором не хватает свободных единиц, или -1
+int blocking_resource(const Job* job) {
+    const int* mutexes = &dag.job_mutexes[job->mutex_start];
+    const int* amounts = &dag.job_mutex_amounts[job->mutex_start];
+    for (int i = 0; i < job->mutex_count; i++) {
+        const Mutex* mutex = &dag.mutexes[mutexes[i]];
+        if (mutex->used + amounts[i] > mutex->capacity) {
+            return mutexes[i];
+        }
+    }
+    return -1;
+}
+
+//Свободны ли все мьютексы задачи и хватает ли емкости ее ресурсов
+bool mutexes_available(const Job* job) {
+    return blocking_resource(job) < 0;
+}
+
+//Захват всех мьютексов и ресурсов задачи (вызывается из цикла событий после
+//mutexes_available, поэтому захват либо полный, либо не начинается)
+void acquire_job_mutexes(int job_idx) {
+    Job* job = &dag.jobs[job_idx];
+    const int* mutexes = &dag.job_mutexes[job->mutex_start];
+    const int* amounts = &dag.job_mutex_amounts[job->mutex_start];
+    for (int i = 0; i < job->mutex_count; i++) {
+        Mutex* mutex = &dag.mutexes[mutexes[i]];
+        mutex->used += amounts[i];
+        if (mutex->capacity == 1) {
+            printf("  %s: захвачен мьютекс %s\n", pool_str(job->name), pool_str(mutex->name));
+        } else {
+            printf("  %s: захвачено %d ед. ресурса %s (занято %d/%d)\n", pool_str(job->name),
+                   amounts[i], pool_str(mutex->name), mutex->used, mutex->capacity);
+        }
+    }
+}
+
+//Освобождение мьютексов и ресурсов задачи (вызывается из цикла событий)
+void release_job_mutexes(const Job* job) {
+    const int* mutexes = &dag.job_mutexes[job->mutex_start];
+    const int* amounts = &dag.job_mutex_amounts[job->mutex_start];
+    for (int i = job->mutex_count - 1; i >= 0; i--) {
+        Mutex* mutex = &dag.mutexes[mutexes[i]];
+        mutex->used -= amounts[i];
+        if (mutex->capacity == 1) {
+            printf("  %s: освобожден мьютекс %s\n", pool_str(job->name), pool_str(mutex->name));
+        } else {
+            printf("  %s: освобождено %d ед. ресурса %s (занято %d/%d)\n", pool_str(job->name),
+                   amounts[i], pool_str(mutex->name), mutex->used, mutex->capacity);
+        }
+        wake_waiters(mutexes[i]);
+    }
+}
+
+//Сколько единиц ресурса нужно задаче
+int job_resource_amount(const Job* job, int resource) {
+    for (int i = 0; i < job->mutex_count; i++) {
+        if (dag.job_mutexes[job->mutex_start + i] == resource) {
+            return dag.job_mutex_amounts[job->mutex_start + i];
+        }
+    }
+    return 0;
+}
+
+//Задача, которой не хватило ресурса (resource >= 0) или памяти (-1), встает
+//в очередь ожидания. Одна постановка - одно откладывание в статистике ресурса
+void park_job(int job_idx, int resource) {
+    if (resource >= dag.resource_wait_capacity) {
+        int old_capacity = dag.resource_wait_capacity;
+        if (!grow_array((void**)&dag.resource_waits, &dag.resource_wait_capacity,
+                        dag.mutex_count > resource + 1 ? dag.mutex_count : resource + 1,
+                        sizeof(WaitList))) {
+            dag.dag_failed = true;
+            insert_ready_job(job_idx);
+            return;
+        }
+        memset(&dag.resource_waits[old_capacity], 0,
+               (dag.resource_wait_capacity - old_capacity) * sizeof(WaitList));
+    }
+    
+    WaitList* list = resource >= 0 ? &dag.resource_waits[resource] : &dag.memory_waits;
+    if (!grow_array((void**)&list->jobs, &list->capacity, list->count + 1, sizeof(int))) {
+        dag.dag_failed = true;
+        insert_ready_job(job_idx);
+        return;
+    }
+    heap_insert(list->jobs, &list->count, job_idx);
+    
+    Job* job = &dag.jobs[job_idx];
+    JobRuntime* run = job_runtime(job);
+    run->parked_at = monotonic_seconds();
+    if (dag.trace_file && run->blocked_at == 0) {
+        run->blocked_at = run->parked_at;
+    }
+    if (resource >= 0) {
+        dag.mutexes[resource].contended++;
+    }
+}
+
+//Побудка ожидающих ресурс после его освобождения: в очередь готовых
+//возвращается ровно столько задач, сколько помещается в свободные единицы
+//(с учетом уже разбуженных). Задача, которой не хватает места, остается
+//ждать, а следующая за ней меньшая может пройти
+void wake_waiters(int resource) {
+    if (resource >= dag.resource_wait_capacity || dag.resource_waits[resource].count == 0) {
+        return;
+    }
+    WaitList* list = &dag.resource_waits[resource];
+    const Mutex* mutex = &dag.mutexes[resource];
+    double now = monotonic_seconds();
+    int skipped = 0;
+    
+    while (list->count > 0 && mutex->used + list->woken < mutex->capacity) {
+        int job_idx = heap_pop(list->jobs, &list->count);
+        Job* job = &dag.jobs[job_idx];
+        JobRuntime* run = job_runtime(job);
+        int amount = job_resource_amount(job, resource);
+        if (mutex->used + list->woken + amount > mutex->capacity) {
+            dag.deferred_jobs[skipped++] = job_idx;
+            continue;
+        }
+        list->woken += amount;
+        list->blocked_seconds += now - run->parked_at;
+        run->woken_by = resource + 1;
+        insert_ready_job(job_idx);
+    }
+    for (int i = 0; i < skipped; i++) {
+        heap_insert(list->jobs, &list->count, dag.deferred_jobs[i]);
+    }
+}
+
+//Побудка задач, ждущих памяти, после завершения любой задачи: прогноз
+//памяти у них разный, поэтому возвращаются все, а лишние встанут обратно
+void wake_memory_waiters(void) {
+    double now = monotonic_seconds();
+    while (dag.memory_waits.count > 0) {
+        int job_idx = heap_pop(dag.memory_waits.jobs, &dag.memory_waits.count);
+        dag.memory_waits.blocked_seconds += now - dag.job_runtime[job_idx].parked_at;
+        insert_ready_job(job_idx);
+    }
+}
+
+//Освобождение очередей ожидания в конце выполнения
+void free_wait_lists(void) {
+    for (int i = 0; i < dag.resource_wait_capacity; i++) {
+        free(dag.resource_waits[i].jobs);
+    }
+    free(dag.resource_waits);
+    dag.resource_waits = NULL;
+    dag.resource_wait_capacity = 0;
+    free(dag.memory_waits.jobs);
+    memset(&dag.memory_waits, 0, sizeof(dag.memory_waits));
+}
+
+//Выбор задачи для запуска (вызывается из цикла событий): самая приоритетная
+//готовая задача, для которой свободны мьютексы и хватает памяти. Задача,
+//которой чего-то не хватило, уходит в очередь ожидания этого ресурса (или
+//памяти) и в очередь готовых вернется только после его освобождения, поэтому
+//каждая задача просматривается один раз за эпизод ожидания.
+//Возвращает индекс задачи (ее мьютексы уже захвачены) или -1
+int pick_ready_job(void) {
+    while (dag.ready_count > 0) {
+        int job_idx = pop_ready_job();
+        Job* job = &dag.jobs[job_idx];
+        JobRuntime* run = job_runtime(job);
+        
+        //Разбуженная задача больше не держит обещанные ей единицы ресурса
+        int woken_by = run->woken_by - 1;
+        if (woken_by >= 0) {
+            dag.resource_waits[woken_by].woken -= job_resource_amount(job, woken_by);
+            run->woken_by = 0;
+        }
+        
+        if (!can_admit_job(job_idx)) {
+            park_job(job_idx, -1);
+        } else {
+            int blocked = blocking_resource(job);
+            if (blocked < 0) {
+                acquire_job_mutexes(job_idx);
+                return job_idx;
+            }
+            park_job(job_idx, blocked);
+        }
+        
+        //Обещанные ей единицы могут достаться следующему ожидающему
+        if (woken_by >= 0) {
+            wake_waiters(woken_by);
+        }
+    }
+    return -1;
+}
+
+//Приоритет задачи - длина самого длинного пути от нее до завершающей задачи
+//(включая ее саму). Считается одним проходом по topo_order в обратном порядке
+void compute_priorities(void) {
+    dag.critical_path = 0;
+    for (int k = dag.job_count - 1; k >= 0; k--) {
+        int job_idx = dag.topo_order[k];
+        double tail = 0;
+        for (int e = dag.next_offsets[job_idx]; e < dag.next_offsets[job_idx + 1]; e++) {
+            double next_priority = dag.jobs[dag.next_jobs[e]].priority;
+            if (next_priority > tail) tail = next_priority;
+        }
+        
+        Job* job = &dag.jobs[job_idx];
+        job->priority = job_weight(job) + tail;
+        if (job->priority > dag.critical_path) {
+            dag.critical_path = job->priority;
+        }
+    }
+}
+
+//Порядок в очереди готовых: в режиме приоритетов - по длине оставшегося
+//критического пути, при равенстве (и без приоритетов) - в порядке постановки
+bool ready_before(int a, int b) {
+    Job* job_a = &dag.jobs[a];
+    Job* job_b = &dag.jobs[b];
+    if (priority_mode && job_a->priority != job_b->priority) {
+        return job_a->priority > job_b->priority;
+    }
+    return job_a->ready_seq < job_b->ready_seq;
+}
+
+//Вставка в кучу задач, упорядоченную по ready_before (очередь готовых
+//или очередь ожидания ресурса)
+void heap_insert(int* heap, int* count, int job_idx) {
+    int pos = (*count)++;
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!ready_before(job_idx, heap[parent])) break;
+        heap[pos] = heap[parent];
+        pos = parent;
+    }
+    heap[pos] = job_idx;
+}
+
+//Извлечение первой по ready_before задачи из непустой кучи
+int heap_pop(int* heap, int* count) {
+    int top = heap[0];
+    int last = heap[--(*count)];
+    if (*count == 0) {
+        return top;
+    }
+    
+    int pos = 0;
+    while (true) {
+        int child = 2 * pos + 1;
+        if (child >= *count) break;
+        if (child + 1 < *count && ready_before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!ready_before(heap[child], last)) break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = last;
+    return top;
+}
+
+//Вставка в кучу готовых без изменения порядкового номера задачи
+void insert_ready_job(int job_idx) {
+    heap_insert(dag.ready_queue, &dag.ready_count, job_idx);
+}
+
+//Добавление задачи в очередь готовых (вызывается из цикла событий)
+void push_ready_job(int job_idx) {
+    dag.jobs[job_idx].ready_seq = dag.ready_seq++;
+    if (dag.trace_file || dag.metrics_fd != -1 || stats_mode) {
+        dag.job_runtime[job_idx].ready_at = monotonic_seconds();
+    }
+    insert_ready_job(job_idx);
+}
+
+//Извлечение задачи из очереди готовых (вызывается из цикла событий)
+int pop_ready_job(void) {
+    if (dag.ready_count == 0) {
+        return -1;
+    }
+    return heap_pop(dag.ready_queue, &dag.ready_count);
+}
+
+//Куча событий симулятора, упорядоченная по времени завершения
+void sim_event_push(SimEvent* events, int* count, SimEvent event) {
+    int pos = (*count)++;
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (events[parent].time <= event.time) break;
+        events[pos] = events[parent];
+        pos = parent;
+    }
+    events[pos] = event;
+}
+
+SimEvent sim_event_pop(SimEvent* events, int* count) {
+    SimEvent top = events[0];
+    SimEvent last = events[--(*count)];
+    int pos = 0;
+    while (*count > 0) {
+        int child = 2 * pos + 1;
+        if (child >= *count) break;
+        if (child + 1 < *count && events[child + 1].time < events[child].time) child++;
+        if (events[child].time >= last.time) break;
+        events[pos] = events[child];
+        pos = child;
+    }
+    if (*count > 0) events[pos] = last;
+    return top;
+}
+
+//Симуляция выполнения DAG без запуска команд. Длительность задачи - ее вес,
+//одновременно выполняется не больше max_concurrent задач. Мьютексы и ресурсы
+//задачи захватываются все сразу в момент старта; задача, которой не хватает
+//мьютексов или емкости ресурсов, пропускается, а слот отдается следующей
+//готовой задаче. Занятость ресурсов ведется в dag.mutexes[].used и
+//обнуляется по окончании симуляции.
+//Возвращает предсказанное время выполнения (makespan) или -1 при ошибке
+double simulate_dag(bool use_priority) {
+    int n = dag.job_count;
+    int* remaining = malloc(n * sizeof(int));
+    SimEvent* events = malloc(n * sizeof(SimEvent));
+    int* skipped = malloc(n * sizeof(int));
+    if (!remaining || !events || !skipped) {
+        fprintf(stderr, "Не удалось выделить память для симуляции\n");
+        free(remaining);
+        free(events);
+        free(skipped);
+        return -1;
+    }
+    
+    bool saved_priority_mode = priority_mode;
+    priority_mode = use_priority;
+    dag.ready_count = 0;
+    dag.ready_seq = 0;
+    
+    for (int i = 0; i < n; i++) {
+        remaining[i] = dag.jobs[i].dependency_count;
+    }
+    for (int k = 0; k < dag.start_job_count; k++) {
+        push_ready_job(dag.topo_order[k]);
+    }
+    
+    double now = 0;
+    int running = 0;
+    int event_count = 0;
+    int done = 0;
+    
+    while (done < n) {
+        //Запускаем готовые задачи, пока есть свободные слоты
+        int skipped_count = 0;
+        while (running < dag.max_concurrent && dag.ready_count > 0) {
+            int job_idx = pop_ready_job();
+            Job* job = &dag.jobs[job_idx];
+            int* mutexes = &dag.job_mutexes[job->mutex_start];
+            int* amounts = &dag.job_mutex_amounts[job->mutex_start];
+            
+            if (blocking_resource(job) >= 0) {
+                skipped[skipped_count++] = job_idx;
+                continue;
+            }
+            
+            for (int i = 0; i < job->mutex_count; i++) {
+                dag.mutexes[mutexes[i]].used += amounts[i];
+            }
+            SimEvent event = { now + job_weight(job), job_idx };
+            sim_event_push(events, &event_count, event);
+            running++;
+        }
+        for (int i = 0; i < skipped_count; i++) {
+            insert_ready_job(skipped[i]);
+        }
+        
+        if (event_count == 0) {
+            break; //Граф больше не может продвинуться
+        }
+        
+        //Переходим к ближайшему завершению задачи
+        SimEvent event = sim_event_pop(events, &event_count);
+        now = event.time;
+        running--;
+        done++;
+        
+        Job* job = &dag.jobs[event.job];
+        int* mutexes = &dag.job_mutexes[job->mutex_start];
+        int* amounts = &dag.job_mutex_amounts[job->mutex_start];
+        for (int i = 0; i < job->mutex_count; i++) {
+            dag.mutexes[mutexes[i]].used -= amounts[i];
+        }
+        for (int e = dag.next_offsets[event.job]; e < dag.next_offsets[event.job + 1]; e++) {
+            int next_idx = dag.next_jobs[e];
+            if (--remaining[next_idx] == 0) {
+                push_ready_job(next_idx);
+            }
+        }
+    }
+    
+    priority_mode = saved_priority_mode;
+    dag.ready_count = 0;
+    dag.ready_seq = 0;
+    for (int i = 0; i < dag.mutex_count; i++) {
+        dag.mutexes[i].used = 0;
+    }
+    free(remaining);
+    free(events);
+    free(skipped);
+    
+    return done == n ? now : -1;
+}
+
+//Хеш FNV-1a (64 бита) для ключей кэша: продолжает hash на size байтах
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= FNV64_PRIME;
+    }
+    return hash;
+}
+
+//Хеш содержимого файла (отображается в память). Отсутствующий файл дает
+//отдельное значение, чтобы его появление меняло ключ
+uint64_t hash_file(const char* path) {
+    uint64_t hash = hash_bytes(FNV64_OFFSET, path, strlen(path) + 1);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return hash_bytes(hash, "missing", 7);
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            //Хеш считается в потоке кэша; при отмене DAG его результат не нужен
+            for (off_t done = 0; done < st.st_size && !atomic_load(&dag.cache_abort);
+                 done += CACHE_HASH_CHUNK) {
+                off_t chunk = st.st_size - done < CACHE_HASH_CHUNK ? st.st_size - done : CACHE_HASH_CHUNK;
+                hash = hash_bytes(hash, data + done, chunk);
+            }
+            munmap(data, st.st_size);
+        } else {
+            hash = hash_bytes(hash, "unreadable", 10);
+        }
+    }
+    close(fd);
+    return hash;
+}
+
+//Ключ задачи для кэша: команда (или argv из exec:) и содержимое всех входов.
+//Считается в потоке кэша по копии из запроса
+uint64_t job_cache_key(const CacheRequest* request) {
+    uint64_t key = hash_bytes(FNV64_OFFSET, request->data, request->command_size);
+    const char* file = request->data + request->command_size;
+    file += strlen(file) + 1; //Путь записи кэша
+    for (int i = 0; i < request->input_count; i++) {
+        uint64_t file_hash = hash_file(file);
+        key = hash_bytes(key, &file_hash, sizeof(file_hash));
+        file += strlen(file) + 1;
+    }
+    return key;
+}
+
+//Имя файла задачи в --cache-dir и --log-dir. Имя задачи из YAML может
+//содержать "/" и "..", поэтому "/", "%" и точка в начале записываются как
+//%XX: файл всегда остается в своем каталоге, а разные имена не совпадают
+const char* job_file_name(const Job* job, char* buffer, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    size_t length = 0;
+    for (const char* p = pool_str(job->name); *p && length + 4 <= size; p++) {
+        unsigned char c = *p;
+        if (c == '/' || c == '%' || (c == '.' && p == pool_str(job->name))) {
+            buffer[length++] = '%';
+            buffer[length++] = hex[c >> 4];
+            buffer[length++] = hex[c & 15];
+        } else {
+            buffer[length++] = c;
+        }
+    }
+    buffer[length] = '\0';
+    return buffer;
+}
+
+//Путь к записи кэша задачи: <cache_dir>/<имя задачи>
+void cache_record_path(const Job* job, char* path, size_t size) {
+    char name[MAX_NAME_LEN * 3];
+    snprintf(path, size, "%s/%s", dag.cache_dir, job_file_name(job, name, sizeof(name)));
+}
+
+//Запрос к потоку кэша для задачи: копия команды, пути записи кэша, входов
+//и выходов. Возвращает NULL, если не хватило памяти
+CacheRequest* cache_request(const Job* job, int kind) {
+    JobRuntime* run = job_runtime(job);
+    char record_path[4096];
+    cache_record_path(job, record_path, sizeof(record_path));
+    
+    //Команда хешируется так же, как раньше: каждая строка argv (или команда
+    //целиком) вместе с завершающим нулем
+    size_t command_size = 0;
+    if (job->exec_start >= 0) {
+        for (int i = 0; i < job->exec_argc; i++) {
+            command_size += strlen(pool_str(dag.exec_args[job->exec_start + i])) + 1;
+        }
+    } else {
+        command_size = strlen(pool_str(job->command)) + 1;
+    }
+    size_t size = command_size + strlen(record_path) + 1;
+    for (int i = 0; i < job->input_count; i++) {
+        size += strlen(pool_str(dag.job_files[job->input_start + i])) + 1;
+    }
+    for (int i = 0; i < job->output_count; i++) {
+        size += strlen(pool_str(dag.job_files[job->output_start + i])) + 1;
+    }
+    
+    CacheRequest* request = malloc(sizeof(CacheRequest) + size);
+    if (!request) {
+        return NULL;
+    }
+    request->next = NULL;
+    request->kind = kind;
+    request->job = job - dag.jobs;
+    request->key = run->cache_key;
+    request->hit = false;
+    request->input_count = job->input_count;
+    request->output_count = job->output_count;
+    request->command_size = command_size;
+    
+    char* p = request->data;
+    if (job->exec_start >= 0) {
+        for (int i = 0; i < job->exec_argc; i++) {
+            p = stpcpy(p, pool_str(dag.exec_args[job->exec_start + i])) + 1;
+        }
+    } else {
+        p = stpcpy(p, pool_str(job->command)) + 1;
+    }
+    p = stpcpy(p, record_path) + 1;
+    for (int i = 0; i < job->input_count; i++) {
+        p = stpcpy(p, pool_str(dag.job_files[job->input_start + i])) + 1;
+    }
+    for (int i = 0; i < job->output_count; i++) {
+        p = stpcpy(p, pool_str(dag.job_files[job->output_start + i])) + 1;
+    }
+    return request;
+}
+
+//Можно ли пропустить задачу: прошлый успешный запуск был с тем же ключом,
+//а его выходы с тех пор не изменились и не удалены. Запись кэша - текстовый
+//файл: "key <хеш>", затем "output <хеш> <путь>" на каждый выход.
+//Выполняется в потоке кэша, ключ остается в request->key
+bool job_cache_hit(CacheRequest* request) {
+    request->key = job_cache_key(request);
+    
+    const char* path = request->data + request->command_size;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    
+    const char* expected = path + strlen(path) + 1;
+    for (int i = 0; i < request->input_count; i++) {
+        expected += strlen(expected) + 1;
+    }
+    unsigned long long key, output_hash;
+    bool hit = fscanf(file, "key %llx\n", &key) == 1 && key == request->key;
+    for (int i = 0; hit && i < request->output_count; i++) {
+        char output[4096];
+        hit = fscanf(file, "output %llx %4095[^\n]\n", &output_hash, output) == 2 &&
+              strcmp(output, expected) == 0 && output_hash == hash_file(expected);
+        expected += strlen(expected) + 1;
+    }
+    fclose(file);
+    return hit && !atomic_load(&dag.cache_abort);
+}
+
+//Запись кэша после успешного запуска (в потоке кэша). Пишется во временный
+//файл и переименовывается, чтобы прерванная запись не дала ложного попадания
+void store_cache_record(const CacheRequest* request) {
+    const char* path = request->data + request->command_size;
+    const char* output = path + strlen(path) + 1;
+    for (int i = 0; i < request->input_count; i++) {
+        output += strlen(output) + 1;
+    }
+    
+    char tmp_path[4200];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "w");
+    if (!file) {
+        perror("Ошибка записи кэша");
+        return;
+    }
+    fprintf(file, "key %016llx\n", (unsigned long long)request->key);
+    for (int i = 0; i < request->output_count; i++) {
+        fprintf(file, "output %016llx %s\n", (unsigned long long)hash_file(output), output);
+        output += strlen(output) + 1;
+    }
+    //Прерванный отменой хеш выхода дал бы запись, которая никогда не совпадет
+    bool ok = fclose(file) == 0 && !atomic_load(&dag.cache_abort);
+    if (!ok || rename(tmp_path, path) != 0) {
+        if (!ok && !atomic_load(&dag.cache_abort)) {
+            perror("Ошибка записи кэша");
+        }
+        unlink(tmp_path);
+    }
+}
+
+//Поток кэша: выполняет запросы по очереди. Результаты CACHE_LOOKUP уходят
+//в cache_done, и цикл событий узнает о них через cache_event_fd. Перед
+//выходом поток дописывает оставшиеся CACHE_STORE
+void* cache_thread_main(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&dag.cache_lock);
+    while (true) {
+        while (!dag.cache_queue && !dag.cache_stop) {
+            pthread_cond_wait(&dag.cache_cond, &dag.cache_lock);
+        }
+        CacheRequest* request = dag.cache_queue;
+        if (!request) {
+            break;
+        }
+        dag.cache_queue = request->next;
+        if (!dag.cache_queue) {
+            dag.cache_queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&dag.cache_lock);
+        
+        if (request->kind == CACHE_STORE) {
+            store_cache_record(request);
+            free(request);
+            pthread_mutex_lock(&dag.cache_lock);
+            continue;
+        }
+        request->hit = job_cache_hit(request);
+        
+        pthread_mutex_lock(&dag.cache_lock);
+        request->next = dag.cache_done;
+        dag.cache_done = request;
+        uint64_t one = 1;
+        if (write(dag.cache_event_fd, &one, sizeof(one)) != sizeof(one)) {
+            perror("Ошибка уведомления цикла событий");
+        }
+    }
+    pthread_mutex_unlock(&dag.cache_lock);
+    return NULL;
+}
+
+//Передача запроса потоку кэша (поток запускается при первом запросе).
+//Запрос переходит потоку; при ошибке он освобождается и возвращается false
+bool cache_submit(CacheRequest* request) {
+    if (!request) {
+        return false;
+    }
+    if (!dag.cache_thread_started) {
+        dag.cache_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event event = { .events = EPOLLIN, .data.u64 = event_key(EVENT_CACHE, 0) };
+        if (dag.cache_event_fd == -1 ||
+            epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, dag.cache_event_fd, &event) == -1) {
+            perror("Ошибка запуска потока кэша");
+            if (dag.cache_event_fd != -1) {
+                close(dag.cache_event_fd);
+                dag.cache_event_fd = -1;
+            }
+            free(request);
+            return false;
+        }
+        pthread_mutex_init(&dag.cache_lock, NULL);
+        pthread_cond_init(&dag.cache_cond, NULL);
+        dag.cache_queue = dag.cache_queue_tail = dag.cache_done = NULL;
+        dag.cache_stop = false;
+        int err = pthread_create(&dag.cache_thread, NULL, cache_thread_main, NULL);
+        if (err != 0) {
+            fprintf(stderr, "Ошибка запуска потока кэша: %s\n", strerror(err));
+            epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, dag.cache_event_fd, NULL);
+            close(dag.cache_event_fd);
+            dag.cache_event_fd = -1;
+            pthread_cond_destroy(&dag.cache_cond);
+            pthread_mutex_destroy(&dag.cache_lock);
+            free(request);
+            return false;
+        }
+        dag.cache_thread_started = true;
+    }
+    
+    pthread_mutex_lock(&dag.cache_lock);
+    if (dag.cache_queue_tail) {
+        dag.cache_queue_tail->next = request;
+    } else {
+        dag.cache_queue = request;
+    }
+    dag.cache_queue_tail = request;
+    pthread_cond_signal(&dag.cache_cond);
+    pthread_mutex_unlock(&dag.cache_lock);
+    return true;
+}
+
+//Результаты поиска в кэше (вызывается из цикла событий): задача либо
+//пропускается, либо запускается в уже занятом ею слоте
+void on_cache_event(void) {
+    uint64_t count;
+    if (read(dag.cache_event_fd, &count, sizeof(count)) != sizeof(count)) {
+        return;
+    }
+    pthread_mutex_lock(&dag.cache_lock);
+    CacheRequest* done = dag.cache_done;
+    dag.cache_done = NULL;
+    pthread_mutex_unlock(&dag.cache_lock);
+    
+    while (done) {
+        CacheRequest* request = done;
+        done = request->next;
+        Job* job = &dag.jobs[request->job];
+        JobRuntime* run = job_runtime(job);
+        run->cache_key = request->key;
+        run->cache_pending = false;
+        bool hit = request->hit;
+        free(request);
+        
+        if (dag.dag_failed) {
+            run->cancelled = true;
+            run->failed = true;
+            finish_job(job);
+        } else if (hit) {
+            printf("Задача %s пропущена: входы и выходы не изменились\n", pool_str(job->name));
+            run->cached = true;
+            finish_job(job);
+        } else {
+            launch_started_job(job);
+        }
+    }
+}
+
+//Остановка потока кэша в конце выполнения: оставшиеся записи кэша
+//дописываются, невостребованные результаты освобождаются
+void cache_thread_stop(void) {
+    if (!dag.cache_thread_started) {
+        return;
+    }
+    pthread_mutex_lock(&dag.cache_lock);
+    dag.cache_stop = true;
+    pthread_cond_signal(&dag.cache_cond);
+    pthread_mutex_unlock(&dag.cache_lock);
+    pthread_join(dag.cache_thread, NULL);
+    
+    while (dag.cache_done) {
+        CacheRequest* request = dag.cache_done;
+        dag.cache_done = request->next;
+        free(request);
+    }
+    pthread_cond_destroy(&dag.cache_cond);
+    pthread_mutex_destroy(&dag.cache_lock);
+    close(dag.cache_event_fd);
+    dag.cache_event_fd = -1;
+    dag.cache_thread_started = false;
+}
+
+//Монотонное время в секундах
+double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//Где в dag лежит массив каждого раздела снимка и сколько в нем байт
+//(по текущим счетчикам dag)
+void snapshot_layout(void** fields[SNAPSHOT_SECTION_COUNT], uint64_t sizes[SNAPSHOT_SECTION_COUNT]) {
+    uint64_t jobs = dag.job_count;
+    
+    fields[SNAPSHOT_STRINGS] = (void**)&dag.strings.data;
+    sizes[SNAPSHOT_STRINGS] = dag.strings.size;
+    fields[SNAPSHOT_SYMBOLS] = (void**)&dag.symtab.symbols;
+    sizes[SNAPSHOT_SYMBOLS] = (uint64_t)dag.symtab.count * sizeof(Symbol);
+    fields[SNAPSHOT_SLOTS] = (void**)&dag.symtab.slots;
+    sizes[SNAPSHOT_SLOTS] = (uint64_t)dag.symtab.slot_count * sizeof(int);
+    fields[SNAPSHOT_JOBS] = (void**)&dag.jobs;
+    sizes[SNAPSHOT_JOBS] = jobs * sizeof(Job);
+    fields[SNAPSHOT_MUTEXES] = (void**)&dag.mutexes;
+    sizes[SNAPSHOT_MUTEXES] = (uint64_t)dag.mutex_count * sizeof(Mutex);
+    fields[SNAPSHOT_DEPS] = (void**)&dag.deps;
+    sizes[SNAPSHOT_DEPS] = (uint64_t)dag.dep_count * sizeof(int);
+    fields[SNAPSHOT_NEXT_OFFSETS] = (void**)&dag.next_offsets;
+    sizes[SNAPSHOT_NEXT_OFFSETS] = (jobs + 1) * sizeof(int);
+    fields[SNAPSHOT_NEXT_JOBS] = (void**)&dag.next_jobs;
+    sizes[SNAPSHOT_NEXT_JOBS] = (uint64_t)dag.dep_count * sizeof(int);
+    fields[SNAPSHOT_JOB_MUTEXES] = (void**)&dag.job_mutexes;
+    sizes[SNAPSHOT_JOB_MUTEXES] = (uint64_t)dag.job_mutex_count * sizeof(int);
+    fields[SNAPSHOT_JOB_MUTEX_AMOUNTS] = (void**)&dag.job_mutex_amounts;
+    sizes[SNAPSHOT_JOB_MUTEX_AMOUNTS] = (uint64_t)dag.job_mutex_count * sizeof(int);
+    fields[SNAPSHOT_EXEC_ARGS] = (void**)&dag.exec_args;
+    sizes[SNAPSHOT_EXEC_ARGS] = (uint64_t)dag.exec_arg_count * sizeof(uint32_t);
+    fields[SNAPSHOT_JOB_FILES] = (void**)&dag.job_files;
+    sizes[SNAPSHOT_JOB_FILES] = (uint64_t)dag.job_file_count * sizeof(uint32_t);
+    fields[SNAPSHOT_TOPO_ORDER] = (void**)&dag.topo_order;
+    sizes[SNAPSHOT_TOPO_ORDER] = jobs * sizeof(int);
+    fields[SNAPSHOT_LEVELS] = (void**)&dag.levels;
+    sizes[SNAPSHOT_LEVELS] = jobs * sizeof(int);
+    fields[SNAPSHOT_EXEC_ARGV] = (void**)&dag.exec_argv;
+    sizes[SNAPSHOT_EXEC_ARGV] = (uint64_t)dag.exec_arg_count * sizeof(char*);
+    fields[SNAPSHOT_READY_QUEUE] = (void**)&dag.ready_queue;
+    sizes[SNAPSHOT_READY_QUEUE] = jobs * sizeof(int);
+    fields[SNAPSHOT_DEFERRED_JOBS] = (void**)&dag.deferred_jobs;
+    sizes[SNAPSHOT_DEFERRED_JOBS] = jobs * sizeof(int);
+}
+
+//Является ли файл снимком DAG (проверяется сигнатура в начале файла)
+bool is_snapshot_file(const char* path) {
+    char magic[4];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    bool is_snapshot = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                       memcmp(magic, SNAPSHOT_MAGIC, 4) == 0;
+    close(fd);
+    return is_snapshot;
+}
+
+//Запись снимка проверенного DAG: заголовок и массивы графа в том виде,
+//в котором они лежат в памяти. Пишется во временный файл и переименовывается
+bool write_snapshot(const char* path) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.job_size = sizeof(Job);
+    header.mutex_size = sizeof(Mutex);
+    header.symbol_size = sizeof(Symbol);
+    header.pointer_size = sizeof(char*);
+    header.job_count = dag.job_count;
+    header.mutex_count = dag.mutex_count;
+    header.dep_count = dag.dep_count;
+    header.job_mutex_count = dag.job_mutex_count;
+    header.exec_arg_count = dag.exec_arg_count;
+    header.job_file_count = dag.job_file_count;
+    header.symbol_count = dag.symtab.count;
+    header.slot_count = dag.symtab.slot_count;
+    header.max_concurrent = dag.max_concurrent;
+    header.level_count = dag.level_count;
+    header.start_job_count = dag.start_job_count;
+    header.string_size = dag.strings.size;
+    header.memory_limit_kb = dag.memory_limit_kb;
+    
+    void** fields[SNAPSHOT_SECTION_COUNT];
+    uint64_t sizes[SNAPSHOT_SECTION_COUNT];
+    snapshot_layout(fields, sizes);
+    
+    uint64_t offset = sizeof(header);
+    for (int i = 0; i < SNAPSHOT_SECTION_COUNT; i++) {
+        offset = (offset + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+        header.sections[i].offset = offset;
+        header.sections[i].size = sizes[i];
+        offset += sizes[i];
+    }
+    
+    size_t tmp_len = strlen(path) + 5;
+    char* tmp_path = malloc(tmp_len);
+    if (!tmp_path) {
+        fprintf(stderr, "Не удалось выделить память\n");
+        return false;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+    
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd != -1 && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    for (int i = 0; ok && i < SNAPSHOT_EXEC_ARGV; i++) {
+        const char* data = *fields[i];
+        uint64_t done = 0;
+        while (ok && done < sizes[i]) {
+            ssize_t written = pwrite(fd, data + done, sizes[i] - done,
+                                     header.sections[i].offset + done);
+            ok = written > 0;
+            done += written > 0 ? written : 0;
+        }
+    }
+    //Хвост с разделами, заполняемыми при выполнении, остается дырой
+    ok = ok && ftruncate(fd, offset) == 0;
+    if (fd != -1 && close(fd) != 0) ok = false;
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("Ошибка записи снимка DAG");
+        unlink(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+    free(tmp_path);
+    
+    printf("\nСнимок DAG записан в %s: %d задач, %d ребер, %.1f МБ\n",
+           path, dag.job_count, dag.dep_count, offset / (1024.0 * 1024.0));
+    return true;
+}
+
+//Проверка индексов загруженного снимка: размеры разделов уже сверены, но
+//поврежденный файл может содержать индексы за пределами массивов, а без
+//разбора и validate_dag их больше никто не проверит. Один проход по всем
+//массивам, O(задачи + ребра), без выделения памяти
+bool snapshot_indices_valid(void) {
+    uint64_t strings = dag.strings.size;
+    if (strings == 0 || dag.strings.data[strings - 1] != '\0' ||
+        dag.max_concurrent <= 0 || dag.level_count < 0 || dag.level_count > dag.job_count) {
+        return false;
+    }
+    
+    //Таблица символов: открытая адресация по маске, нужен хотя бы один пустой слот
+    uint32_t slots = dag.symtab.slot_count;
+    if (slots == 0 || (slots & (slots - 1)) != 0 || (uint32_t)dag.symtab.count >= slots) {
+        return false;
+    }
+    for (uint32_t i = 0; i < slots; i++) {
+        if (dag.symtab.slots[i] < -1 || dag.symtab.slots[i] >= dag.symtab.count) {
+            return false;
+        }
+    }
+    for (int i = 0; i < dag.symtab.count; i++) {
+        const Symbol* symbol = &dag.symtab.symbols[i];
+        if (symbol->name >= strings || symbol->job < -1 || symbol->job >= dag.job_count ||
+            symbol->mutex < -1 || symbol->mutex >= dag.mutex_count) {
+            return false;
+        }
+    }
+    
+    for (int i = 0; i < dag.mutex_count; i++) {
+        if (dag.mutexes[i].name >= strings || dag.mutexes[i].capacity < 1) {
+            return false;
+        }
+    }
+    for (int i = 0; i < dag.job_mutex_count; i++) {
+        int mutex = dag.job_mutexes[i];
+        if (mutex < 0 || mutex >= dag.mutex_count || dag.job_mutex_amounts[i] < 1 ||
+            dag.job_mutex_amounts[i] > dag.mutexes[mutex].capacity) {
+            return false;
+        }
+    }
+    for (int i = 0; i < dag.exec_arg_count; i++) {
+        if (dag.exec_args[i] != EXEC_ARGV_END && dag.exec_args[i] >= strings) {
+            return false;
+        }
+    }
+    for (int i = 0; i < dag.job_file_count; i++) {
+        if (dag.job_files[i] >= strings) {
+            return false;
+        }
+    }
+    
+    //Отрезки задач в общих массивах
+    for (int i = 0; i < dag.job_count; i++) {
+        const Job* job = &dag.jobs[i];
+        if (job->name >= strings || job->command >= strings ||
+            job->symbol < 0 || job->symbol >= dag.symtab.count ||
+            job->dependency_count < 0 || job->dep_start < 0 ||
+            job->dependency_count > dag.dep_count - job->dep_start ||
+            job->remaining_deps != job->dependency_count ||
+            job->mutex_count < 0 || job->mutex_start < 0 ||
+            job->mutex_count > dag.job_mutex_count - job->mutex_start ||
+            job->input_count < 0 || job->input_start < 0 ||
+            job->input_count > dag.job_file_count - job->input_start ||
+            job->output_count < 0 || job->output_start < 0 ||
+            job->output_count > dag.job_file_count - job->output_start) {
+            return false;
+        }
+        //argv задачи вместе с завершающим EXEC_ARGV_END
+        if (job->exec_start != -1 &&
+            (job->exec_start < 0 || job->exec_argc < 0 ||
+             job->exec_argc >= dag.exec_arg_count - job->exec_start ||
+             dag.exec_args[job->exec_start + job->exec_argc] != EXEC_ARGV_END)) {
+            return false;
+        }
+        if (dag.topo_order[i] < 0 || dag.topo_order[i] >= dag.job_count ||
+            dag.levels[i] < 0 || dag.levels[i] >= dag.level_count) {
+            return false;
+        }
+    }
+    
+    //Стартовые задачи - ровно первые start_job_count задач topo_order
+    if (dag.start_job_count < 0 || dag.start_job_count > dag.job_count) {
+        return false;
+    }
+    for (int k = 0; k < dag.job_count; k++) {
+        bool start = dag.jobs[dag.topo_order[k]].dependency_count == 0;
+        if (start != (k < dag.start_job_count)) {
+            return false;
+        }
+    }
+    
+    //Ребра: CSR последователей и списки зависимостей
+    if (dag.next_offsets[0] != 0 || dag.next_offsets[dag.job_count] != dag.dep_count) {
+        return false;
+    }
+    for (int i = 0; i < dag.job_count; i++) {
+        if (dag.next_offsets[i] > dag.next_offsets[i + 1]) {
+            return false;
+        }
+    }
+    for (int i = 0; i < dag.dep_count; i++) {
+        if (dag.deps[i] < 0 || dag.deps[i] >= dag.job_count ||
+            dag.next_jobs[i] < 0 || dag.next_jobs[i] >= dag.job_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//Загрузка снимка DAG: файл отображается в память (MAP_PRIVATE) и массивы
+//dag указывают прямо в отображение. Разбора, построения графа и выделения
+//памяти под граф нет; при выполнении изменяются только затронутые страницы
+bool load_snapshot(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Не удалось открыть файл %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        fprintf(stderr, "Снимок DAG %s поврежден\n", path);
+        close(fd);
+        return false;
+    }
+    char* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Ошибка отображения снимка DAG");
+        return false;
+    }
+    
+    const SnapshotHeader* header = (const SnapshotHeader*)data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, 4) != 0 || header->version != SNAPSHOT_VERSION ||
+        header->job_size != sizeof(Job) || header->mutex_size != sizeof(Mutex) ||
+        header->symbol_size != sizeof(Symbol) || header->pointer_size != sizeof(char*)) {
+        fprintf(stderr, "Снимок DAG %s записан другой версией исполнителя, "
+                "пересоберите его через --compile\n", path);
+        munmap(data, st.st_size);
+        return false;
+    }
+    
+    dag.job_count = dag.job_capacity = header->job_count;
+    dag.mutex_count = dag.mutex_capacity = header->mutex_count;
+    dag.dep_count = dag.dep_capacity = header->dep_count;
+    dag.job_mutex_count = dag.job_mutex_capacity = header->job_mutex_count;
+    dag.job_mutex_amount_capacity = header->job_mutex_count;
+    dag.exec_arg_count = dag.exec_arg_capacity = header->exec_arg_count;
+    dag.job_file_count = dag.job_file_capacity = header->job_file_count;
+    dag.symtab.count = dag.symtab.capacity = header->symbol_count;
+    dag.symtab.slot_count = header->slot_count;
+    dag.strings.size = dag.strings.capacity = header->string_size;
+    dag.max_concurrent = header->max_concurrent;
+    dag.level_count = header->level_count;
+    dag.start_job_count = header->start_job_count;
+    dag.memory_limit_kb = header->memory_limit_kb;
+    
+    void** fields[SNAPSHOT_SECTION_COUNT];
+    uint64_t sizes[SNAPSHOT_SECTION_COUNT];
+    snapshot_layout(fields, sizes);
+    for (int i = 0; i < SNAPSHOT_SECTION_COUNT; i++) {
+        const SnapshotSection* section = &header->sections[i];
+        if (section->size != sizes[i] || section->offset % SNAPSHOT_ALIGN != 0 ||
+            section->offset > (uint64_t)st.st_size ||
+            section->size > (uint64_t)st.st_size - section->offset) {
+            fprintf(stderr, "Снимок DAG %s поврежден\n", path);
+            munmap(data, st.st_size);
+            memset(&dag, 0, sizeof(dag));
+            return false;
+        }
+        *fields[i] = data + section->offset;
+    }
+    if (!snapshot_indices_valid()) {
+        fprintf(stderr, "Снимок DAG %s поврежден: индексы за пределами массивов\n", path);
+        munmap(data, st.st_size);
+        memset(&dag, 0, sizeof(dag));
+        return false;
+    }
+    //Состояние запуска в снимок не входит и заводится заново
+    dag.job_runtime = calloc(dag.job_count > 0 ? dag.job_count : 1, sizeof(JobRuntime));
+    if (!dag.job_runtime) {
+        fprintf(stderr, "Не удалось выделить память под граф\n");
+        munmap(data, st.st_size);
+        memset(&dag, 0, sizeof(dag));
+        return false;
+    }
+    dag.job_runtime_capacity = dag.job_count;
+    for (int i = 0; i < dag.job_count; i++) {
+        dag.jobs[i].completed = false;
+    }
+    
+    dag.graph_capacity = dag.job_count;
+    dag.resolved_dep_capacity = dag.dep_count;
+    dag.next_job_capacity = dag.next_offsets[dag.job_count];
+    dag.resolved_mutex_capacity = dag.job_mutex_count;
+    dag.exec_argv_capacity = dag.exec_arg_count;
+    dag.snapshot = data;
+    dag.snapshot_size = st.st_size;
+    printf("Загружен снимок DAG: %d задач, %d ребер, %d мьютексов, %d уровней\n",
+           dag.job_count, dag.dep_count, dag.mutex_count, dag.level_count);
+    return true;
+}
+
+//Перенос массивов графа из отображения снимка в кучу. Нужен, когда граф
+//начинает расти: задача с emits: true добавила новые задачи
+bool detach_snapshot(void) {
+    void** fields[SNAPSHOT_SECTION_COUNT];
+    uint64_t sizes[SNAPSHOT_SECTION_COUNT];
+    snapshot_layout(fields, sizes);
+    for (int i = 0; i < SNAPSHOT_SECTION_COUNT; i++) {
+        void* copy = malloc(sizes[i] > 0 ? sizes[i] : 1);
+        if (!copy) {
+            fprintf(stderr, "Не удалось выделить память под граф\n");
+            return false;
+        }
+        memcpy(copy, *fields[i], sizes[i]);
+        *fields[i] = copy;
+    }
+    munmap(dag.snapshot, dag.snapshot_size);
+    dag.snapshot = NULL;
+    dag.snapshot_size = 0;
+    return true;
+}
+
+//Загрузка истории запусков из <config>.history. Файл отображается в память
+//и читается одним проходом; каждая запись за O(1) находит свою задачу
+//через таблицу символов. Отсутствие файла - не ошибка
+bool load_history(const char* config_path) {
+    size_t path_len = strlen(config_path) + strlen(HISTORY_SUFFIX) + 1;
+    dag.history_path = malloc(path_len);
+    if (!dag.history_path) {
+        fprintf(stderr, "Не удалось выделить память\n");
+        return false;
+    }
+    snprintf(dag.history_path, path_len, "%s%s", config_path, HISTORY_SUFFIX);
+    dag.history_fd = -1;
+    dag.history_run_id = 1;
+    dag.history_jobs = 0;
+    
+    int fd = open(dag.history_path, O_RDONLY);
+    if (fd == -1) {
+        return true;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(HistoryHeader)) {
+        close(fd);
+        return true;
+    }
+    
+    const char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Ошибка отображения файла истории");
+        return true;
+    }
+    
+    const HistoryHeader* header = (const HistoryHeader*)data;
+    if (memcmp(header->magic, HISTORY_MAGIC, 4) != 0 || header->version != HISTORY_VERSION) {
+        fprintf(stderr, "Файл истории %s имеет неизвестный формат, игнорируем\n",
+                dag.history_path);
+        munmap((void*)data, st.st_size);
+        return true;
+    }
+    
+    size_t pos = sizeof(HistoryHeader);
+    char name[MAX_NAME_LEN];
+    while (pos + sizeof(HistoryRecord) <= (size_t)st.st_size) {
+        HistoryRecord record;
+        memcpy(&record, data + pos, sizeof(record));
+        pos += sizeof(record);
+        
+        //Недописанная запись в конце файла (например, после аварийного завершения)
+        if (pos + record.name_len > (size_t)st.st_size) {
+            break;
+        }
+        size_t len = record.name_len < MAX_NAME_LEN - 1 ? record.name_len : MAX_NAME_LEN - 1;
+        memcpy(name, data + pos, len);
+        name[len] = '\0';
+        pos += record.name_len;
+        
+        if (record.run_id >= dag.history_run_id) {
+            dag.history_run_id = record.run_id + 1;
+        }
+        
+        int symbol = lookup_symbol(name, hash_name(name));
+        if (symbol < 0 || dag.symtab.symbols[symbol].job < 0) {
+            continue; //Задача удалена из конфигурации
+        }
+        
+        Job* job = &dag.jobs[dag.symtab.symbols[symbol].job];
+        JobRuntime* run = job_runtime(job);
+        if (run->last_run.run_id == 0) {
+            dag.history_jobs++;
+        }
+        if (run->last_run.run_id != record.run_id) {
+            run->prev_run = run->last_run;
+        }
+        run->last_run.run_id = record.run_id;
+        run->last_run.failed = record.failed;
+        run->last_run.wall_time = record.wall_us / 1e6;
+        //Запуск в общем shell не измеряет CPU и память: остаются значения
+        //прошлого запуска, иначе прогноз памяти для допуска стал бы нулевым
+        if (record.cpu_us != HISTORY_NOT_MEASURED) {
+            run->last_run.cpu_time = record.cpu_us / 1e6;
+        }
+        if (record.max_rss_kb != HISTORY_NOT_MEASURED) {
+            run->last_run.max_rss_kb = record.max_rss_kb;
+        }
+    }
+    
+    munmap((void*)data, st.st_size);
+    printf("Загружена история запусков из %s: %d задач, следующий запуск #%u\n",
+           dag.history_path, dag.history_jobs, dag.history_run_id);
+    return true;
+}
+
+//Открытие файла истории на дозапись (создается с заголовком, если его нет)
+bool open_history_for_append(void) {
+    dag.history_fd = open(dag.history_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (dag.history_fd == -1) {
+        perror("Не удалось открыть файл истории");
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(dag.history_fd, &st) == 0 && st.st_size == 0) {
+        HistoryHeader header;
+        memcpy(header.magic, HISTORY_MAGIC, 4);
+        header.version = HISTORY_VERSION;
+        if (write(dag.history_fd, &header, sizeof(header)) != sizeof(header)) {
+            perror("Ошибка записи заголовка истории");
+        }
+    }
+    return true;
+}
+
+//Дозапись статистики завершившейся задачи (вызывается из цикла событий).
+//Запись уходит одним write() в файл с O_APPEND, поэтому при аварийном
+//завершении в конце файла остается не больше одной недописанной записи
+void append_history(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    if (dag.history_fd == -1) {
+        return;
+    }
+    
+    const char* name = pool_str(job->name);
+    size_t name_len = strlen(name);
+    char buffer[sizeof(HistoryRecord) + MAX_NAME_LEN];
+    if (name_len >= MAX_NAME_LEN) name_len = MAX_NAME_LEN - 1;
+    
+    HistoryRecord record = {0};
+    record.run_id = dag.history_run_id;
+    record.name_len = name_len;
+    record.failed = run->current_run.failed;
+    record.timestamp = time(NULL);
+    record.wall_us = run->current_run.wall_time * 1e6;
+    record.cpu_us = run->current_run.cpu_time < 0 ? HISTORY_NOT_MEASURED : run->current_run.cpu_time * 1e6;
+    record.max_rss_kb = run->current_run.max_rss_kb < 0 ? HISTORY_NOT_MEASURED : run->current_run.max_rss_kb;
+    
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), name, name_len);
+    ssize_t size = sizeof(record) + name_len;
+    if (write(dag.history_fd, buffer, size) != size) {
+        perror("Ошибка записи истории");
+    }
+}
+
+//Отчет по истории: сравнение последнего запуска каждой задачи с предыдущим
+void print_history_report(void) {
+    printf("\nОтчет по истории запусков (%s):\n", dag.history_path);
+    if (dag.history_jobs == 0) {
+        printf("  История пуста\n");
+        return;
+    }
+    
+    int regressions = 0;
+    for (int k = 0; k < dag.job_count; k++) {
+        Job* job = &dag.jobs[dag.topo_order[k]];
+        JobRuntime* run = job_runtime(job);
+        RunStats* last = &run->last_run;
+        RunStats* prev = &run->prev_run;
+        
+        if (last->run_id == 0) {
+            printf("  %s: нет данных\n", pool_str(job->name));
+            continue;
+        }
+        if (prev->run_id == 0) {
+            printf("  %s: запуск #%u, время %.3f с, CPU %.3f с, память %.1f МБ%s\n",
+                   pool_str(job->name), last->run_id, last->wall_time, last->cpu_time,
+                   last->max_rss_kb / 1024.0, last->failed ? ", ОШИБКА" : "");
+            continue;
+        }
+        
+        double change = prev->wall_time > 0 ? (last->wall_time - prev->wall_time) / prev->wall_time : 0;
+        bool regression = change > REGRESSION_THRESHOLD;
+        if (regression) regressions++;
+        
+        printf("  %s: #%u -> #%u, время %.3f -> %.3f с (%+.1f%%), CPU %.3f -> %.3f с, "
+               "память %.1f -> %.1f МБ%s%s\n",
+               pool_str(job->name), prev->run_id, last->run_id,
+               prev->wall_time, last->wall_time, change * 100,
+               prev->cpu_time, last->cpu_time,
+               prev->max_rss_kb / 1024.0, last->max_rss_kb / 1024.0,
+               last->failed ? ", ОШИБКА" : "",
+               regression ? ", РЕГРЕССИЯ" : "");
+    }
+    printf("  Регрессий (замедление больше %.0f%%): %d\n", REGRESSION_THRESHOLD * 100, regressions);
+}
+
+//Запуск процесса задачи. По умолчанию через posix_spawn: glibc создает процесс
+//через clone(CLONE_VM | CLONE_VFORK), не копируя таблицы страниц родителя, как
+//fork() из многопоточного процесса. Задачи с exec: запускаются напрямую, без
+///bin/sh. Каждая задача - лидер своей группы процессов, чтобы при отмене
+//сигнал дошел и до ее потомков. output_fd (если не -1) становится stdout и
+//stderr задачи. Возвращает pid или -1
+pid_t launch_job(Job* job, int output_fd, int emit_fd) {
+    JobRuntime* run = job_runtime(job);
+    char* shell_argv[] = { "sh", "-c", (char*)pool_str(job->command), NULL };
+    bool direct = job->exec_start >= 0;
+    char** argv = direct ? &dag.exec_argv[job->exec_start] : shell_argv;
+    for (int i = 0; direct && i <= job->exec_argc; i++) {
+        uint32_t arg = dag.exec_args[job->exec_start + i];
+        argv[i] = arg == EXEC_ARGV_END ? NULL : dag.strings.data + arg;
+    }
+    const char* path = direct ? argv[0] : "/bin/sh";
+    
+    //В лист cgroup процесс переходит сам до exec, чтобы ничего из задачи
+    //не успело выполниться вне него: posix_spawn так не умеет
+    if (fork_mode || run->cgroup_fd != -1) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            //Дочерний процесс: своя группа и обычная маска сигналов
+            sigset_t empty;
+            sigemptyset(&empty);
+            sigprocmask(SIG_SETMASK, &empty, NULL);
+            setpgid(0, 0);
+            if (run->cgroup_fd != -1 && !write_cgroup_file(run->cgroup_fd, "cgroup.procs", "0")) {
+                perror("Ошибка перехода в cgroup задачи");
+            }
+            if (output_fd != -1) {
+                dup2(output_fd, STDOUT_FILENO);
+                dup2(output_fd, STDERR_FILENO);
+            }
+            if (emit_fd != -1) {
+                dup2(emit_fd, EMIT_FD);
+            }
+            if (direct) {
+                execvp(path, argv);
+            } else {
+                execv(path, argv);
+            }
+            perror("Ошибка выполнения exec");
+            _exit(1); //Если exec не удался
+        }
+        if (pid < 0) {
+            perror("Ошибка fork");
+        } else {
+            setpgid(pid, pid); //Повтор из родителя: группа нужна до первого kill
+        }
+        return pid;
+    }
+    
+    //Перенаправление вывода: dup2 снимает O_CLOEXEC с копий, а сам канал закроется при exec
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (output_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, output_fd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, output_fd, STDERR_FILENO);
+    }
+    if (emit_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, emit_fd, EMIT_FD);
+    }
+    
+    //posix_spawnp ищет программу в PATH, как execvp
+    pid_t pid;
+    int err = direct ? posix_spawnp(&pid, path, &actions, &dag.spawn_attr, argv, environ)
+                     : posix_spawn(&pid, path, &actions, &dag.spawn_attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0) {
+        fprintf(stderr, "Ошибка запуска задачи %s (%s): %s\n",
+                pool_str(job->name), path, strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+//Запуск задачи из цикла событий (ее мьютексы и ресурсы уже захвачены):
+//процесс стартует, а его pidfd добавляется в epoll. Поток не ждет процесс -
+//о завершении сообщит epoll_wait
+void start_job(int job_idx) {
+    Job* job = &dag.jobs[job_idx];
+    JobRuntime* run = job_runtime(job);
+    
+    run->admitted_rss_kb = run->last_run.max_rss_kb;
+    dag.running_memory_kb += run->admitted_rss_kb;
+    dag.running_jobs++;
+    run->slot = dag.free_slots[--dag.free_slot_count];
+    if (dag.journal_fd != -1) {
+        journal_job(job, JOURNAL_STARTED);
+    }
+    dag.slot_jobs[run->slot]++;
+    if (stats_mode) {
+        double enabled_at = run->ready_at > dag.slot_freed_at[run->slot] ? run->ready_at
+                                                                          : dag.slot_freed_at[run->slot];
+        run->dispatch_latency = monotonic_seconds() - enabled_at;
+    }
+    if (dag.metrics_fd != -1) {
+        record_queue_wait(monotonic_seconds() - run->ready_at);
+    }
+    
+    //Входы не изменились с прошлого успешного запуска - задача не запускается,
+    //но ее последователи получают зависимость как обычно. Входы хеширует поток
+    //кэша, а задача держит слот до ответа (on_cache_event). Задачу с emits: true
+    //нельзя пропустить: без запуска не будет ее новых задач
+    if (dag.cache_dir != NULL && !job->emits && (job->input_count > 0 || job->output_count > 0) &&
+        cache_submit(cache_request(job, CACHE_LOOKUP))) {
+        run->cache_pending = true;
+        return;
+    }
+    launch_started_job(job);
+}
+
+//Запуск процесса задачи, уже занявшей слот, после проверки кэша
+void launch_started_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    const char* name = pool_str(job->name);
+    printf("Запускаем задачу %s (запущено: %d/%d)\n",
+           name, dag.running_jobs, dag.max_concurrent);
+    
+    if (job->exec_start >= 0) {
+        printf("Запуск задачи: %s (exec: %s, аргументов: %d)\n", name,
+               pool_str(dag.exec_args[job->exec_start]), job->exec_argc - 1);
+    } else {
+        printf("Запуск задачи: %s (команда: %s)\n", name, pool_str(job->command));
+    }
+    
+    //С воркерами процесс запускает воркер, а тайм-аут отсчитывает координатор
+    if (dag.worker_count > 0) {
+        run->started_at = monotonic_seconds();
+        if (!dispatch_job(job)) {
+            run->failed = true;
+            dag.dag_failed = true;
+            finish_job(job);
+            return;
+        }
+        if (job->timeout > 0 && !arm_job_timer(job, job->timeout)) {
+            dag.dag_failed = true;
+        }
+        return;
+    }
+    
+    //Короткую задачу с command: без своего канала вывода, emits и cgroup
+    //выполняет общий shell слота: без нового процесса /bin/sh и pidfd на каждую
+    //задачу. Задачи с exec: и так запускаются без /bin/sh
+    if (job->batchable && job->exec_start < 0 && log_dir == NULL && !prefix_output &&
+        !job->emits && !dag.cgroup_path) {
+        run->started_at = monotonic_seconds();
+        if (!run_batched_job(job)) {
+            run->failed = true;
+            dag.dag_failed = true;
+            finish_job(job);
+            return;
+        }
+        if (job->timeout > 0 && !arm_job_timer(job, job->timeout)) {
+            dag.dag_failed = true;
+        }
+        return;
+    }
+    
+    //Вывод задачи перехватывается в канал, если нужны журналы или префиксы
+    int write_fd = -1;
+    if ((log_dir != NULL || prefix_output) && !open_job_output(job, &write_fd)) {
+        run->failed = true;
+        dag.dag_failed = true;
+        finish_job(job);
+        return;
+    }
+    
+    //Задача с emits: true получает канал для описаний новых задач на EMIT_FD
+    int emit_write_fd = -1;
+    if (job->emits && !open_job_emits(job, &emit_write_fd)) {
+        if (write_fd != -1) {
+            close(write_fd);
+        }
+        close_job_output(job);
+        run->failed = true;
+        dag.dag_failed = true;
+        finish_job(job);
+        return;
+    }
+    
+    if (dag.cgroup_path) {
+        cgroup_create_job(job);
+    }
+    run->started_at = monotonic_seconds();
+    run->pid = launch_job(job, write_fd, emit_write_fd);
+    if (write_fd != -1) {
+        close(write_fd); //Пишущий конец остается только у задачи
+    }
+    if (emit_write_fd != -1) {
+        close(emit_write_fd);
+    }
+    if (run->pid <= 0) {
+        close_job_output(job);
+        close_job_emits(job);
+        if (run->cgroup_fd != -1) {
+            cgroup_release_job(job);
+        }
+        run->failed = true;
+        dag.dag_failed = true;
+        finish_job(job);
+        return;
+    }
+    
+    run->pidfd = syscall(SYS_pidfd_open, run->pid, 0);
+    struct epoll_event event = { .events = EPOLLIN,
+                                 .data.u64 = event_key(EVENT_EXIT, job - dag.jobs) };
+    if (run->pidfd == -1 || epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, run->pidfd, &event) == -1) {
+        //Без pidfd следить за процессом нечем: дожидаемся его здесь же
+        perror("Ошибка подписки на завершение процесса");
+        if (run->pidfd != -1) {
+            close(run->pidfd);
+            run->pidfd = -1;
+        }
+        dag.dag_failed = true;
+        reap_job(job);
+        return;
+    }
+    
+    if (job->timeout > 0 && !arm_job_timer(job, job->timeout)) {
+        dag.dag_failed = true;
+    }
+}
+
+//Ключ события для epoll_event.data.u64
+uint64_t event_key(int kind, int job_idx) {
+    return ((uint64_t)kind << 32) | (uint32_t)job_idx;
+}
+
+//Взвод таймера задачи на seconds секунд. timerfd создается при первом
+//использовании и живет до сбора процесса
+bool arm_job_timer(Job* job, double seconds) {
+    JobRuntime* run = job_runtime(job);
+    if (run->timerfd == -1) {
+        run->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct epoll_event event = { .events = EPOLLIN,
+                                     .data.u64 = event_key(EVENT_TIMER, job - dag.jobs) };
+        if (run->timerfd == -1 ||
+            epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, run->timerfd, &event) == -1) {
+            perror("Ошибка создания таймера задачи");
+            if (run->timerfd != -1) {
+                close(run->timerfd);
+                run->timerfd = -1;
+            }
+            return false;
+        }
+    }
+    
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = (time_t)seconds;
+    spec.it_value.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9);
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1; //Нулевое значение выключило бы таймер
+    }
+    if (timerfd_settime(run->timerfd, 0, &spec, NULL) == -1) {
+        perror("Ошибка взвода таймера задачи");
+        return false;
+    }
+    return true;
+}
+
+//SIGTERM всей группе процессов задачи; через KILL_GRACE_SECONDS ее таймер
+//сработает еще раз и группа получит SIGKILL
+void terminate_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    if (!job_active(job) || run->term_sent) {
+        return;
+    }
+    run->term_sent = true;
+    signal_job(job, SIGTERM);
+    if (!arm_job_timer(job, KILL_GRACE_SECONDS)) {
+        signal_job(job, SIGKILL);
+    }
+}
+
+//Срабатывание таймера задачи: первый раз - тайм-аут, после SIGTERM - SIGKILL
+void on_job_timer(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    uint64_t expirations;
+    if (read(run->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations) ||
+        !job_active(job)) {
+        return;
+    }
+    
+    if (!run->term_sent) {
+        printf("Задача %s превысила тайм-аут %.2f с, останавливаем\n",
+               pool_str(job->name), job->timeout);
+        run->timed_out = true;
+        terminate_job(job);
+    } else {
+        printf("Задача %s не завершилась после SIGTERM, отправляем SIGKILL\n",
+               pool_str(job->name));
+        signal_job(job, SIGKILL);
+    }
+}
+
+//Отмена всех запущенных задач после ошибки: новые задачи уже не запускаются,
+//а запущенным сразу уходит SIGTERM, не дожидаясь их естественного завершения
+void cancel_running_jobs(void) {
+    if (dag.cancelling) {
+        return;
+    }
+    dag.cancelling = true;
+    atomic_store(&dag.cache_abort, true);
+    
+    int cancelled = 0;
+    for (int i = 0; i < dag.job_count; i++) {
+        Job* job = &dag.jobs[i];
+        JobRuntime* run = job_runtime(job);
+        if (job_active(job) && !run->term_sent) {
+            run->cancelled = true;
+            terminate_job(job);
+            cancelled++;
+        }
+    }
+    if (cancelled > 0) {
+        printf("Отменяем запущенные задачи: %d\n", cancelled);
+    }
+}
+
+//Канал для вывода задачи (--log-dir и/или --prefix-output). Читающий конец
+//остается у исполнителя и слушается в epoll, пишущий возвращается в write_fd
+//для launch_job, и его нужно закрыть после запуска
+bool open_job_output(Job* job, int* write_fd) {
+    JobRuntime* run = job_runtime(job);
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("Ошибка создания канала вывода задачи");
+        return false;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    run->output_fd = fds[0];
+    *write_fd = fds[1];
+    
+    if (log_dir != NULL) {
+        char path[4096], name[MAX_NAME_LEN * 3];
+        snprintf(path, sizeof(path), "%s/%s.log", log_dir, job_file_name(job, name, sizeof(name)));
+        run->log_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (run->log_fd == -1) {
+            perror("Ошибка открытия журнала задачи");
+        }
+    }
+    
+    if (prefix_output) {
+        run->line_buffer = malloc(LINE_BUFFER_SIZE);
+        run->line_length = 0;
+    }
+    
+    struct epoll_event event = { .events = EPOLLIN,
+                                 .data.u64 = event_key(EVENT_OUTPUT, job - dag.jobs) };
+    if ((log_dir != NULL && run->log_fd == -1) || (prefix_output && !run->line_buffer) ||
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, run->output_fd, &event) == -1) {
+        close(*write_fd);
+        *write_fd = -1;
+        close_job_output(job);
+        return false;
+    }
+    return true;
+}
+
+//Вывод данных задачи в общий поток: только целые строки, каждая с префиксом
+//[имя], поэтому строки параллельных задач не перемешиваются. Целые строки
+//пишутся прямо из data, в line_buffer копируется только незавершенный хвост
+void emit_prefixed(Job* job, const char* data, size_t size) {
+    JobRuntime* run = job_runtime(job);
+    const char* name = pool_str(job->name);
+    while (size > 0) {
+        const char* newline = memchr(data, '\n', size);
+        size_t part = newline ? (size_t)(newline - data) + 1 : size;
+        
+        if (newline && run->line_length == 0) {
+            //Исполнитель однопоточный, блокировка stdout на каждую строку не нужна
+            putchar_unlocked('[');
+            fputs_unlocked(name, stdout);
+            fputs_unlocked("] ", stdout);
+            fwrite_unlocked(data, 1, part, stdout);
+        } else {
+            size_t room = LINE_BUFFER_SIZE - run->line_length;
+            if (part > room) {
+                part = room;
+            }
+            memcpy(run->line_buffer + run->line_length, data, part);
+            run->line_length += part;
+            
+            bool complete = run->line_buffer[run->line_length - 1] == '\n';
+            if (complete || run->line_length == LINE_BUFFER_SIZE) {
+                printf("[%s] %.*s%s", name, run->line_length, run->line_buffer,
+                       complete ? "" : "\n"); //Слишком длинная строка выводится частями
+                run->line_length = 0;
+            }
+        }
+        data += part;
+        size -= part;
+    }
+}
+
+//Перенос всего, что сейчас есть в канале задачи, в журнал и общий поток.
+//Журнал пишется через splice из канала прямо в файл, без копирования в память
+//исполнителя. Для префиксов данные нужно прочитать; если при этом ведется
+//журнал, tee дублирует их в tee_pipe, и читается уже копия, а оригинал уходит
+//в файл тем же splice. При конце данных канал закрывается
+void drain_job_output(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    static char chunk[OUTPUT_CHUNK];
+    
+    while (run->output_fd != -1) {
+        ssize_t size;
+        if (!prefix_output) {
+            size = splice(run->output_fd, NULL, run->log_fd, NULL, OUTPUT_CHUNK,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } else if (run->log_fd == -1) {
+            size = read(run->output_fd, chunk, sizeof(chunk));
+            if (size > 0) {
+                emit_prefixed(job, chunk, size);
+            }
+        } else {
+            size = tee(run->output_fd, dag.tee_pipe[1], OUTPUT_CHUNK, SPLICE_F_NONBLOCK);
+            if (size > 0) {
+                ssize_t copied = read(dag.tee_pipe[0], chunk, size);
+                if (copied > 0) {
+                    emit_prefixed(job, chunk, copied);
+                }
+                //Оригинал из канала задачи - в журнал
+                ssize_t left = size;
+                while (left > 0) {
+                    ssize_t moved = splice(run->output_fd, NULL, run->log_fd, NULL, left, SPLICE_F_MOVE);
+                    if (moved <= 0) {
+                        break;
+                    }
+                    left -= moved;
+                }
+            }
+        }
+        
+        if (size > 0) {
+            continue;
+        }
+        if (size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (size == -1 && errno == EAGAIN) {
+            return; //Данных пока нет, задача еще пишет
+        }
+        if (size == -1) {
+            perror("Ошибка переноса вывода задачи");
+        }
+        close_job_output(job);
+    }
+}
+
+//Закрытие канала и журнала задачи; недописанная строка выводится как есть
+void close_job_output(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    if (run->output_fd != -1) {
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, run->output_fd, NULL);
+        close(run->output_fd);
+        run->output_fd = -1;
+    }
+    if (run->log_fd != -1) {
+        close(run->log_fd);
+        run->log_fd = -1;
+    }
+    if (run->line_buffer) {
+        if (run->line_length > 0) {
+            printf("[%s] %.*s\n", pool_str(job->name), run->line_length, run->line_buffer);
+        }
+        free(run->line_buffer);
+        run->line_buffer = NULL;
+        run->line_length = 0;
+    }
+}
+
+//Канал EMIT_FD для задачи с emits: true. Читающий конец слушается в epoll,
+//пишущий возвращается в write_fd для launch_job, и его нужно закрыть после запуска
+bool open_job_emits(Job* job, int* write_fd) {
+    JobRuntime* run = job_runtime(job);
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("Ошибка создания канала для новых задач");
+        return false;
+    }
+    //dup2 на тот же номер не снял бы O_CLOEXEC, и задача осталась бы без EMIT_FD
+    if (fds[1] == EMIT_FD) {
+        int moved = fcntl(fds[1], F_DUPFD_CLOEXEC, EMIT_FD + 1);
+        close(fds[1]);
+        fds[1] = moved;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    run->emit_fd = fds[0];
+    run->emit_size = 0;
+    *write_fd = fds[1];
+    
+    struct epoll_event event = { .events = EPOLLIN,
+                                 .data.u64 = event_key(EVENT_EMIT, job - dag.jobs) };
+    if (*write_fd == -1 || epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, run->emit_fd, &event) == -1) {
+        perror("Ошибка создания канала для новых задач");
+        if (*write_fd != -1) {
+            close(*write_fd);
+            *write_fd = -1;
+        }
+        close_job_emits(job);
+        return false;
+    }
+    return true;
+}
+
+//Чтение описаний новых задач из канала EMIT_FD в emit_buffer. Разбираются
+//они только после успешного завершения задачи. При конце данных канал закрывается
+void drain_job_emits(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    while (run->emit_fd != -1) {
+        if (run->emit_capacity - run->emit_size < OUTPUT_CHUNK / 4) {
+            size_t capacity = run->emit_capacity > 0 ? run->emit_capacity * 2 : OUTPUT_CHUNK;
+            char* buffer = realloc(run->emit_buffer, capacity);
+            if (!buffer) {
+                fprintf(stderr, "Не удалось выделить память под описания задач от %s\n",
+                        pool_str(job->name));
+                dag.dag_failed = true;
+                close_job_emits(job);
+                return;
+            }
+            run->emit_buffer = buffer;
+            run->emit_capacity = capacity;
+        }
+        
+        ssize_t size = read(run->emit_fd, run->emit_buffer + run->emit_size,
+                            run->emit_capacity - run->emit_size);
+        if (size > 0) {
+            run->emit_size += size;
+            continue;
+        }
+        if (size == -1 && errno == EINTR) {
+            continue;
+        }
+        if (size == -1 && errno == EAGAIN) {
+            return; //Задача еще может дописать описания
+        }
+        if (size == -1) {
+            perror("Ошибка чтения описаний задач");
+        }
+        close_job_emits(job);
+    }
+}
+
+//Закрытие канала EMIT_FD (принятые описания остаются в emit_buffer)
+void close_job_emits(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    if (run->emit_fd != -1) {
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, run->emit_fd, NULL);
+        close(run->emit_fd);
+        run->emit_fd = -1;
+    }
+}
+
+//Добавление в граф задач, которые задача parent_idx описала в EMIT_FD
+//(вызывается после ее успешного завершения, до finish_job). Описания
+//разбираются тем же сканером, что и конфигурация. При ошибке новые задачи
+//отбрасываются целиком
+bool add_emitted_jobs(int parent_idx) {
+    int first = dag.job_count;
+    int first_dep = dag.dep_count;
+    int first_mutex = dag.job_mutex_count;
+    int first_exec_arg = dag.exec_arg_count;
+    int first_file = dag.job_file_count;
+    
+    //Граф из снимка лежит в отображении файла и расти не может
+    if (dag.snapshot && !detach_snapshot()) {
+        return false;
+    }
+    
+    char source[MAX_NAME_LEN + 16];
+    snprintf(source, sizeof(source), "%s:fd%d", pool_str(dag.jobs[parent_idx].name), EMIT_FD);
+    ConfigScanner sc = { .path = source, .verbose = dag.job_count < GRAPH_PRINT_LIMIT,
+                         .jobs_only = true };
+    bool ok = parse_config_data(&sc, dag.job_runtime[parent_idx].emit_buffer, dag.job_runtime[parent_idx].emit_size);
+    free(sc.scratch);
+    
+    for (int i = first; i < dag.job_count; i++) {
+        JobRuntime* run = &dag.job_runtime[i];
+        run->pidfd = -1;
+        run->timerfd = -1;
+        run->output_fd = -1;
+        run->log_fd = -1;
+        run->emit_fd = -1;
+        run->cgroup_fd = -1;
+    }
+    
+    if (!ok || !link_emitted_jobs(parent_idx, first)) {
+        for (int i = first; i < dag.job_count; i++) {
+            dag.symtab.symbols[dag.jobs[i].symbol].job = -1;
+        }
+        dag.job_count = first;
+        dag.dep_count = first_dep;
+        dag.job_mutex_count = first_mutex;
+        dag.exec_arg_count = first_exec_arg;
+        dag.job_file_count = first_file;
+        fprintf(stderr, "Задача %s прислала некорректное описание задач\n",
+                pool_str(dag.jobs[parent_idx].name));
+        return false;
+    }
+    
+    printf("Задача %s добавила задач: %d (всего задач: %d)\n",
+           pool_str(dag.jobs[parent_idx].name), dag.job_count - first, dag.job_count);
+    return true;
+}
+
+//Встраивание новых задач [first, job_count) в граф. Их отрезки в CSR
+//дописываются после всех прежних; зависеть они могут от задач того же
+//описания, от родителя и от уже завершенных задач (ребра из них не нужны).
+//Последователи родителя получают зависимость от каждой новой задачи. Готовые
+//задачи сразу попадают в очередь - прохода по всему dag.jobs нет
+bool link_emitted_jobs(int parent_idx, int first) {
+    int n = dag.job_count;
+    int count = n - first;
+    int parent_next_begin = dag.next_offsets[parent_idx];
+    int parent_next_count = dag.next_offsets[parent_idx + 1] - parent_next_begin;
+    
+    //Массивы, размер которых зависит от числа задач
+    if (n > dag.graph_capacity) {
+        int capacity = dag.graph_capacity * 2 > n ? dag.graph_capacity * 2 : n;
+        int* next_offsets = realloc(dag.next_offsets, (capacity + 1) * sizeof(int));
+        if (next_offsets) dag.next_offsets = next_offsets;
+        int* ready_queue = realloc(dag.ready_queue, capacity * sizeof(int));
+        if (ready_queue) dag.ready_queue = ready_queue;
+        int* deferred_jobs = realloc(dag.deferred_jobs, capacity * sizeof(int));
+        if (deferred_jobs) dag.deferred_jobs = deferred_jobs;
+        if (!next_offsets || !ready_queue || !deferred_jobs) {
+            fprintf(stderr, "Не удалось выделить память под граф\n");
+            return false;
+        }
+        dag.graph_capacity = capacity;
+    }
+    if (!grow_array((void**)&dag.deps, &dag.resolved_dep_capacity, dag.dep_count, sizeof(int)) ||
+        !grow_array((void**)&dag.job_mutexes, &dag.resolved_mutex_capacity, dag.job_mutex_count, sizeof(int)) ||
+        !grow_array((void**)&dag.exec_argv, &dag.exec_argv_capacity, dag.exec_arg_count, sizeof(char*))) {
+        return false;
+    }
+    
+    //cursor: сначала число ребер внутри описания из каждой новой задачи,
+    //потом позиция заполнения ее отрезка, потом остаток зависимостей для Кана
+    int* cursor = calloc(count, sizeof(int));
+    int* order = malloc(count * sizeof(int));
+    if (!cursor || !order) {
+        fprintf(stderr, "Не удалось выделить память под граф\n");
+        free(cursor);
+        free(order);
+        return false;
+    }
+    
+    //Разрешаем зависимости и ресурсы новых задач
+    bool ok = true;
+    for (int i = first; ok && i < n; i++) {
+        Job* job = &dag.jobs[i];
+        job->remaining_deps = 0;
+        for (int j = 0; ok && j < job->dependency_count; j++) {
+            Symbol* dep = &dag.symtab.symbols[dag.dep_symbols[job->dep_start + j]];
+            int dep_idx = dep->job;
+            if (dep_idx < 0) {
+                fprintf(stderr, "Зависимость %s не найдена для задачи %s\n",
+                        pool_str(dep->name), pool_str(job->name));
+                ok = false;
+            } else if (dep_idx < first && dep_idx != parent_idx && !dag.jobs[dep_idx].completed) {
+                fprintf(stderr, "Задача %s зависит от незавершенной задачи %s: новые задачи могут "
+                        "зависеть только друг от друга, от родителя и от завершенных задач\n",
+                        pool_str(job->name), pool_str(dep->name));
+                ok = false;
+            } else {
+                dag.deps[job->dep_start + j] = dep_idx;
+                if (dep_idx >= first) {
+                    cursor[dep_idx - first]++;
+                    job->remaining_deps++;
+                }
+            }
+        }
+        ok = ok && resolve_job_mutexes(job);
+    }
+    
+    //Отрезки новых задач в CSR: ребра внутри описания и ребра к последователям родителя
+    int edges = dag.next_offsets[first];
+    for (int i = first; ok && i < n; i++) {
+        dag.next_offsets[i] = edges;
+        edges += cursor[i - first] + parent_next_count;
+    }
+    if (ok) {
+        dag.next_offsets[n] = edges;
+        ok = grow_array((void**)&dag.next_jobs, &dag.next_job_capacity, edges, sizeof(int));
+    }
+    if (ok) {
+        for (int i = first; i < n; i++) {
+            cursor[i - first] = dag.next_offsets[i];
+        }
+        for (int i = first; i < n; i++) {
+            Job* job = &dag.jobs[i];
+            for (int j = 0; j < job->dependency_count; j++) {
+                int dep_idx = dag.deps[job->dep_start + j];
+                if (dep_idx >= first) {
+                    dag.next_jobs[cursor[dep_idx - first]++] = i;
+                }
+            }
+            for (int e = 0; e < parent_next_count; e++) {
+                dag.next_jobs[cursor[i - first]++] = dag.next_jobs[parent_next_begin + e];
+            }
+        }
+    }
+    
+    //Алгоритм Кана по новым задачам: проверка на циклы и порядок для приоритетов
+    int tail = 0;
+    for (int i = first; ok && i < n; i++) {
+        cursor[i - first] = dag.jobs[i].remaining_deps;
+        if (cursor[i - first] == 0) {
+            order[tail++] = i;
+        }
+    }
+    for (int head = 0; ok && head < tail; head++) {
+        int job_idx = order[head];
+        for (int e = dag.next_offsets[job_idx]; e < dag.next_offsets[job_idx + 1]; e++) {
+            int next_idx = dag.next_jobs[e];
+            if (next_idx >= first && --cursor[next_idx - first] == 0) {
+                order[tail++] = next_idx;
+            }
+        }
+    }
+    if (ok && tail < count) {
+        fprintf(stderr, "Обнаружен цикл среди задач от %s\n", pool_str(dag.jobs[parent_idx].name));
+        ok = false;
+    }
+    
+    if (ok) {
+        //Последователи родителя ждут каждую новую задачу
+        for (int e = parent_next_begin; e < parent_next_begin + parent_next_count; e++) {
+            dag.jobs[dag.next_jobs[e]].remaining_deps += count;
+        }
+        
+        //Приоритет - длина пути до завершающей задачи, как в compute_priorities
+        for (int k = count - 1; k >= 0; k--) {
+            Job* job = &dag.jobs[order[k]];
+            double next_max = 0;
+            for (int e = dag.next_offsets[order[k]]; e < dag.next_offsets[order[k] + 1]; e++) {
+                double next_priority = dag.jobs[dag.next_jobs[e]].priority;
+                if (next_priority > next_max) next_max = next_priority;
+            }
+            job->priority = job_weight(job) + next_max;
+        }
+        
+        //Задачи без зависимостей внутри описания идут первыми в order
+        for (int k = 0; k < count && dag.jobs[order[k]].remaining_deps == 0; k++) {
+            push_ready_job(order[k]);
+        }
+    }
+    
+    free(cursor);
+    free(order);
+    return ok;
+}
+
+//Сбор завершившегося процесса задачи. pidfd стал читаемым, поэтому wait4
+//не блокируется; заодно он возвращает процессорное время и пиковую память
+void reap_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    int status;
+    struct rusage usage;
+    
+    if (dag.trace_file) {
+        run->exited_at = monotonic_seconds();
+    }
+    
+    //Остановленная задача могла оставить потомков в своей группе. Процесс
+    //еще не собран, поэтому номер группы не мог достаться кому-то другому
+    if (run->term_sent) {
+        kill(-run->pid, SIGKILL);
+    }
+    
+    if (run->pidfd != -1) {
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, run->pidfd, NULL);
+        close(run->pidfd);
+        run->pidfd = -1;
+    }
+    if (run->timerfd != -1) {
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, run->timerfd, NULL);
+        close(run->timerfd);
+        run->timerfd = -1;
+    }
+    
+    //Забираем остаток вывода. Канал может держать открытым фоновый потомок
+    //задачи - то, что он напишет после завершения задачи, уже не сохраняется
+    drain_job_output(job);
+    close_job_output(job);
+    drain_job_emits(job);
+    close_job_emits(job);
+    
+    if (wait4(run->pid, &status, 0, &usage) == -1) {
+        perror("Ошибка wait4");
+        run->failed = true;
+        dag.dag_failed = true;
+        finish_job(job);
+        return;
+    }
+    
+    run->current_run.wall_time = monotonic_seconds() - run->started_at;
+    run->current_run.cpu_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                                usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    run->current_run.max_rss_kb = usage.ru_maxrss;
+    if (run->cgroup_fd != -1) {
+        cgroup_collect_job(job);
+    }
+    complete_job(job, status);
+}
+
+//Учет статуса завершения задачи, собранной локально или на воркере:
+//вывод результата, история, кэш, новые задачи и finish_job
+void complete_job(Job* job, int status) {
+    JobRuntime* run = job_runtime(job);
+    const char* name = pool_str(job->name);
+    
+    run->status = status;
+    if (WIFEXITED(status)) {
+        if (WEXITSTATUS(status) == 0) {
+            printf("Задача %s завершена успешно\n", name);
+            run->failed = false;
+        } else {
+            printf("Задача %s завершена с ошибкой (код: %d)\n", 
+                   name, WEXITSTATUS(status));
+            run->failed = true;
+            dag.dag_failed = true;
+        }
+    } else {
+        printf("Задача %s завершена с сигналом %d%s\n", name, WTERMSIG(status),
+               run->timed_out ? " (тайм-аут)" : run->cancelled ? " (отменена)" : "");
+        run->failed = true;
+        dag.dag_failed = true;
+    }
+    if (run->timed_out) {
+        run->failed = true;
+        dag.dag_failed = true;
+    }
+    
+    //Сохраняем статистику запуска в историю
+    run->current_run.run_id = dag.history_run_id;
+    run->current_run.failed = run->failed;
+    append_history(job);
+    
+    //Выходы хеширует и запись кэша пишет поток кэша. Каталог кэша создается
+    //при первой записи: конфигурации без inputs:/outputs: его не оставляют
+    if (!run->failed && dag.cache_dir != NULL && (job->input_count > 0 || job->output_count > 0)) {
+        if (!dag.cache_dir_created && mkdir(dag.cache_dir, 0755) == -1 && errno != EEXIST) {
+            perror("Кэш задач отключен");
+            free(dag.cache_dir);
+            dag.cache_dir = NULL;
+        } else {
+            dag.cache_dir_created = true;
+            cache_submit(cache_request(job, CACHE_STORE));
+        }
+    }
+    
+    //Новые задачи встраиваются до finish_job, чтобы последователи родителя
+    //успели получить зависимость от них. dag.jobs и dag.job_runtime при этом
+    //могут переехать
+    if (run->emit_size > 0 && !run->failed) {
+        int job_idx = job - dag.jobs;
+        bool added = add_emitted_jobs(job_idx);
+        job = &dag.jobs[job_idx];
+        run = &dag.job_runtime[job_idx];
+        if (!added) {
+            run->failed = true;
+            dag.dag_failed = true;
+        }
+    }
+    free(run->emit_buffer);
+    run->emit_buffer = NULL;
+    run->emit_size = run->emit_capacity = 0;
+    
+    finish_job(job);
+}
+
+//Учет завершения задачи: освобождаем мьютексы и память, ставим ставшие
+//готовыми задачи в очередь. Их запустит следующая итерация цикла событий
+void finish_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    const char* name = pool_str(job->name);
+    
+    release_job_mutexes(job);
+    job->completed = true;
+    dag.running_jobs--;
+    dag.free_slots[dag.free_slot_count++] = run->slot;
+    if (stats_mode) {
+        dag.slot_freed_at[run->slot] = monotonic_seconds();
+    }
+    dag.failed_jobs += run->failed;
+    dag.cached_jobs += run->cached;
+    if (dag.journal_fd != -1) {
+        journal_job(job, run->failed ? JOURNAL_FAILED : JOURNAL_COMPLETED);
+    }
+    if (dag.trace_file) {
+        trace_job(job);
+    }
+    dag.finished_jobs++;
+    dag.running_memory_kb -= run->admitted_rss_kb;
+    if (dag.memory_waits.count > 0) {
+        wake_memory_waiters();
+    }
+    printf("  %s: завершена. Осталось запущенных задач: %d\n", 
+           name, dag.running_jobs);
+    
+    int job_idx = job - dag.jobs;
+    for (int e = dag.next_offsets[job_idx]; e < dag.next_offsets[job_idx + 1]; e++) {
+        int next_idx = dag.next_jobs[e];
+        Job* next_job = &dag.jobs[next_idx];
+        next_job->remaining_deps--;
+        
+        printf("  %s: уменьшены зависимости для %s (осталось: %d)\n",
+               name, pool_str(next_job->name), next_job->remaining_deps);
+        
+        if (next_job->remaining_deps == 0) {
+            push_ready_job(next_idx);
+            printf("  %s: %s теперь готов к запуску\n", 
+                   name, pool_str(next_job->name));
+        }
+    }
+}
+
+//Трасса выполнения (--trace): запись о задаче складывается в заранее
+//выделенный буфер trace_records при ее завершении, а в JSON переводится
+//пачкой, когда буфер заполнен, и в конце выполнения
+bool trace_open(const char* path) {
+    dag.trace_records = malloc(TRACE_BUFFER_RECORDS * sizeof(TraceRecord));
+    dag.trace_file = fopen(path, "w");
+    if (!dag.trace_records || !dag.trace_file) {
+        perror("Ошибка открытия файла трассы");
+        free(dag.trace_records);
+        dag.trace_records = NULL;
+        if (dag.trace_file) {
+            fclose(dag.trace_file);
+            dag.trace_file = NULL;
+        }
+        return false;
+    }
+    setvbuf(dag.trace_file, NULL, _IOFBF, OUTPUT_CHUNK);
+    dag.trace_count = 0;
+    dag.trace_start = monotonic_seconds();
+    
+    //Метаданные: имя процесса и по дорожке на каждый слот max_concurrent
+    fprintf(dag.trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(dag.trace_file, "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\","
+            "\"args\":{\"name\":\"dag_executor\"}}");
+    for (int slot = 0; slot < dag.max_concurrent; slot++) {
+        fprintf(dag.trace_file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\","
+                "\"args\":{\"name\":\"слот %d\"}}", slot + 1, slot);
+    }
+    return true;
+}
+
+//Имя задачи как строка JSON
+void trace_write_name(const char* name) {
+    FILE* file = dag.trace_file;
+    putc_unlocked('"', file);
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            putc_unlocked('\\', file);
+            putc_unlocked(*p, file);
+        } else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            putc_unlocked(*p, file);
+        }
+    }
+    putc_unlocked('"', file);
+}
+
+//Отрезок трассы: асинхронный (очередь, ожидание ресурсов - своя дорожка
+//у каждой задачи) или полный на дорожке слота (выполнение, сбор)
+void trace_write_span(const TraceRecord* record, const char* category, double begin, double end,
+                      bool async) {
+    FILE* file = dag.trace_file;
+    double ts = (begin - dag.trace_start) * 1e6;
+    double dur = (end - begin) * 1e6;
+    const char* name = pool_str(dag.jobs[record->job].name);
+    
+    if (async) {
+        fprintf(file, ",\n{\"ph\":\"b\",\"pid\":1,\"tid\":0,\"cat\":\"%s\",\"id\":%d,\"ts\":%.3f,\"name\":",
+                category, record->job, ts);
+        trace_write_name(name);
+        fprintf(file, "}");
+        fprintf(file, ",\n{\"ph\":\"e\",\"pid\":1,\"tid\":0,\"cat\":\"%s\",\"id\":%d,\"ts\":%.3f,\"name\":",
+                category, record->job, ts + dur);
+        trace_write_name(name);
+        fprintf(file, "}");
+    } else {
+        fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"cat\":\"%s\",\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                record->slot + 1, category, ts, dur);
+        trace_write_name(name);
+        fprintf(file, ",\"args\":{\"status\":\"%s\"}}",
+                record->cached ? "cached" : record->failed ? "failed" : "ok");
+    }
+}
+
+//Перевод накопленных записей в JSON
+void trace_flush(void) {
+    for (int i = 0; i < dag.trace_count; i++) {
+        const TraceRecord* record = &dag.trace_records[i];
+        double waited_from = record->blocked_at > 0 ? record->blocked_at : record->started_at;
+        trace_write_span(record, "queued", record->ready_at, waited_from, true);
+        if (record->blocked_at > 0) {
+            trace_write_span(record, "waiting", record->blocked_at, record->started_at, true);
+        }
+        trace_write_span(record, "running", record->started_at, record->exited_at, false);
+        trace_write_span(record, "reap", record->exited_at, record->finished_at, false);
+    }
+    dag.trace_count = 0;
+}
+
+//Запись о завершившейся задаче (из finish_job)
+void trace_job(const Job* job) {
+    JobRuntime* run = job_runtime(job);
+    if (dag.trace_count == TRACE_BUFFER_RECORDS) {
+        trace_flush();
+    }
+    double now = monotonic_seconds();
+    TraceRecord* record = &dag.trace_records[dag.trace_count++];
+    record->job = job - dag.jobs;
+    record->slot = run->slot;
+    record->ready_at = run->ready_at;
+    record->blocked_at = run->blocked_at;
+    //Задача из кэша и задача, которая не запустилась, процесса не имели
+    record->started_at = run->started_at > 0 ? run->started_at : now;
+    record->exited_at = run->exited_at > 0 ? run->exited_at : now;
+    record->finished_at = now;
+    record->failed = run->failed;
+    record->cached = run->cached;
+}
+
+//Запись оставшихся событий и закрытие файла трассы
+void trace_close(void) {
+    trace_flush();
+    fprintf(dag.trace_file, "\n]}\n");
+    if (fclose(dag.trace_file) != 0) {
+        perror("Ошибка записи трассы");
+    }
+    dag.trace_file = NULL;
+    free(dag.trace_records);
+    dag.trace_records = NULL;
+}
+
+//Метрики (--metrics-socket): цикл событий принимает соединение на сокете
+//и сразу отдает снимок счетчиков в текстовом формате Prometheus.
+//Счетчики меняет только цикл событий, поэтому ответ ничего не блокирует
+bool metrics_open(const char* path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Ошибка: слишком длинный путь сокета метрик %s\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    
+    dag.metrics_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (dag.metrics_fd == -1) {
+        perror("Ошибка создания сокета метрик");
+        return false;
+    }
+    //Сокет, оставшийся от прошлого запуска, мешает bind
+    unlink(path);
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = event_key(EVENT_METRICS, 0) };
+    if (bind(dag.metrics_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(dag.metrics_fd, 16) == -1 ||
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, dag.metrics_fd, &event) == -1) {
+        perror("Ошибка открытия сокета метрик");
+        close(dag.metrics_fd);
+        dag.metrics_fd = -1;
+        return false;
+    }
+    dag.metrics_start = monotonic_seconds();
+    printf("Метрики доступны на сокете %s\n", path);
+    return true;
+}
+
+//Учет ожидания задачи в очереди готовых (от готовности до запуска)
+void record_queue_wait(double seconds) {
+    int bucket = 0;
+    while (bucket < QUEUE_WAIT_BUCKETS && seconds > queue_wait_bounds[bucket]) {
+        bucket++;
+    }
+    dag.queue_wait_counts[bucket]++;
+    dag.queue_wait_sum += seconds;
+}
+
+//Снимок метрик в текстовом формате Prometheus
+void write_metrics(FILE* out) {
+    //Готовые задачи, которым сейчас не хватает ресурсов или памяти, ждут
+    //в очередях ожидания
+    int blocked = dag.memory_waits.count;
+    for (int i = 0; i < dag.resource_wait_capacity; i++) {
+        blocked += dag.resource_waits[i].count;
+    }
+    
+    fprintf(out, "# HELP dag_jobs Задачи DAG по состояниям\n");
+    fprintf(out, "# TYPE dag_jobs gauge\n");
+    fprintf(out, "dag_jobs{state=\"running\"} %d\n", dag.running_jobs);
+    fprintf(out, "dag_jobs{state=\"ready\"} %d\n", dag.ready_count);
+    fprintf(out, "dag_jobs{state=\"blocked\"} %d\n", blocked);
+    fprintf(out, "dag_jobs{state=\"completed\"} %d\n", dag.finished_jobs - dag.failed_jobs);
+    fprintf(out, "dag_jobs{state=\"failed\"} %d\n", dag.failed_jobs);
+    fprintf(out, "dag_jobs{state=\"total\"} %d\n", dag.job_count);
+    
+    fprintf(out, "# HELP dag_jobs_finished_total Завершенные задачи (скорость - rate())\n");
+    fprintf(out, "# TYPE dag_jobs_finished_total counter\n");
+    fprintf(out, "dag_jobs_finished_total %d\n", dag.finished_jobs);
+    fprintf(out, "# HELP dag_jobs_cached_total Задачи, пропущенные по кэшу\n");
+    fprintf(out, "# TYPE dag_jobs_cached_total counter\n");
+    fprintf(out, "dag_jobs_cached_total %d\n", dag.cached_jobs);
+    fprintf(out, "# HELP dag_uptime_seconds Время с начала выполнения DAG\n");
+    fprintf(out, "# TYPE dag_uptime_seconds gauge\n");
+    fprintf(out, "dag_uptime_seconds %.3f\n", monotonic_seconds() - dag.metrics_start);
+    
+    fprintf(out, "# HELP dag_queue_wait_seconds Ожидание задачи от готовности до запуска\n");
+    fprintf(out, "# TYPE dag_queue_wait_seconds histogram\n");
+    long cumulative = 0;
+    for (int bucket = 0; bucket < QUEUE_WAIT_BUCKETS; bucket++) {
+        cumulative += dag.queue_wait_counts[bucket];
+        fprintf(out, "dag_queue_wait_seconds_bucket{le=\"%g\"} %ld\n",
+                queue_wait_bounds[bucket], cumulative);
+    }
+    cumulative += dag.queue_wait_counts[QUEUE_WAIT_BUCKETS];
+    fprintf(out, "dag_queue_wait_seconds_bucket{le=\"+Inf\"} %ld\n", cumulative);
+    fprintf(out, "dag_queue_wait_seconds_sum %.6f\n", dag.queue_wait_sum);
+    fprintf(out, "dag_queue_wait_seconds_count %ld\n", cumulative);
+    
+    fprintf(out, "# HELP dag_slot_jobs_total Задачи, запущенные в каждом слоте max_concurrent\n");
+    fprintf(out, "# TYPE dag_slot_jobs_total counter\n");
+    for (int slot = 0; slot < dag.max_concurrent; slot++) {
+        fprintf(out, "dag_slot_jobs_total{slot=\"%d\"} %ld\n", slot, dag.slot_jobs[slot]);
+    }
+    
+    if (dag.mutex_count > 0) {
+        fprintf(out, "# HELP dag_resource_deferred_jobs_total Сколько раз задача вставала в очередь ожидания ресурса\n");
+        fprintf(out, "# TYPE dag_resource_deferred_jobs_total counter\n");
+        for (int i = 0; i < dag.mutex_count; i++) {
+            fprintf(out, "dag_resource_deferred_jobs_total{resource=\"%s\"} %ld\n",
+                    pool_str(dag.mutexes[i].name), dag.mutexes[i].contended);
+        }
+        //Время ожидания: завершенные ожидания плюс текущие
+        double now = monotonic_seconds();
+        fprintf(out, "# HELP dag_resource_blocked_seconds_total Суммарное время ожидания ресурса задачами\n");
+        fprintf(out, "# TYPE dag_resource_blocked_seconds_total counter\n");
+        for (int i = 0; i < dag.mutex_count; i++) {
+            double blocked_seconds = 0;
+            if (i < dag.resource_wait_capacity) {
+                const WaitList* list = &dag.resource_waits[i];
+                blocked_seconds = list->blocked_seconds;
+                for (int j = 0; j < list->count; j++) {
+                    blocked_seconds += now - dag.job_runtime[list->jobs[j]].parked_at;
+                }
+            }
+            fprintf(out, "dag_resource_blocked_seconds_total{resource=\"%s\"} %.3f\n",
+                    pool_str(dag.mutexes[i].name), blocked_seconds);
+        }
+        fprintf(out, "# HELP dag_resource_waiting_jobs Задачи в очереди ожидания ресурса\n");
+        fprintf(out, "# TYPE dag_resource_waiting_jobs gauge\n");
+        for (int i = 0; i < dag.mutex_count; i++) {
+            fprintf(out, "dag_resource_waiting_jobs{resource=\"%s\"} %d\n", pool_str(dag.mutexes[i].name),
+                    i < dag.resource_wait_capacity ? dag.resource_waits[i].count : 0);
+        }
+        fprintf(out, "# HELP dag_resource_used Занятые единицы ресурса\n");
+        fprintf(out, "# TYPE dag_resource_used gauge\n");
+        for (int i = 0; i < dag.mutex_count; i++) {
+            fprintf(out, "dag_resource_used{resource=\"%s\"} %d\n",
+                    pool_str(dag.mutexes[i].name), dag.mutexes[i].used);
+        }
+        fprintf(out, "# HELP dag_resource_capacity Емкость ресурса\n");
+        fprintf(out, "# TYPE dag_resource_capacity gauge\n");
+        for (int i = 0; i < dag.mutex_count; i++) {
+            fprintf(out, "dag_resource_capacity{resource=\"%s\"} %d\n",
+                    pool_str(dag.mutexes[i].name), dag.mutexes[i].capacity);
+        }
+    }
+}
+
+//Ответ на все ожидающие соединения сокета метрик (вызывается из цикла событий)
+void serve_metrics(void) {
+    int client;
+    while ((client = accept4(dag.metrics_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        char* text = NULL;
+        size_t size = 0;
+        FILE* out = open_memstream(&text, &size);
+        if (out) {
+            write_metrics(out);
+            fclose(out);
+            //Ответ обычно целиком помещается в буфер сокета. Клиент, который
+            //его не принимает (EAGAIN) или уже отключился, просто закрывается:
+            //ждать его в цикле событий нельзя
+            size_t written = 0;
+            while (written < size) {
+                ssize_t n = send(client, text + written, size - written, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    break;
+                }
+                written += n;
+            }
+            free(text);
+        }
+        close(client);
+    }
+}
+
+//Закрытие сокета метрик
+void metrics_close(const char* path) {
+    close(dag.metrics_fd);
+    dag.metrics_fd = -1;
+    unlink(path);
+}
+
+//Распределенное выполнение (--workers/--worker). Координатор сам ведет
+//очередь готовых задач, мьютексы и ресурсы, а воркерам отправляет только
+//запуск уже допущенной задачи, поэтому семантика mutexes: остается общей.
+//Адрес воркера: "хост:порт" - TCP, иначе путь Unix-сокета. Пустой хост
+//(":порт") - 127.0.0.1, а не все интерфейсы: протокол не аутентифицирует
+//координатора, и любой подключившийся выполняет произвольные команды, поэтому
+//TCP-воркер нельзя открывать в сеть - только loopback, VPN или SSH-туннель.
+//listening - слушающий сокет воркера, иначе подключение координатора.
+//Возвращает дескриптор или -1 (errno сохраняется для повторных попыток)
+int open_endpoint(const char* endpoint, bool listening) {
+    struct sockaddr_storage storage;
+    socklen_t length;
+    const char* colon = strrchr(endpoint, ':');
+    
+    if (colon == NULL || strchr(endpoint, '/') != NULL) {
+        struct sockaddr_un* addr = (struct sockaddr_un*)&storage;
+        if (strlen(endpoint) >= sizeof(addr->sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memset(addr, 0, sizeof(*addr));
+        addr->sun_family = AF_UNIX;
+        strcpy(addr->sun_path, endpoint);
+        length = sizeof(*addr);
+        if (listening) {
+            unlink(endpoint); //Сокет, оставшийся от прошлого запуска, мешает bind
+        }
+    } else {
+        char host[256];
+        int host_length = colon - endpoint;
+        if (host_length >= (int)sizeof(host)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(host, endpoint, host_length);
+        host[host_length] = '\0';
+        struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+        struct addrinfo* found;
+        if (getaddrinfo(host_length > 0 ? host : "127.0.0.1", colon + 1, &hints, &found) != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        memcpy(&storage, found->ai_addr, found->ai_addrlen);
+        length = found->ai_addrlen;
+        freeaddrinfo(found);
+    }
+    
+    int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    int on = 1;
+    if (storage.ss_family != AF_UNIX) {
+        //Сообщения короткие: без Nagle запуск не ждет подтверждения предыдущего
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        }
+    }
+    bool ok = listening ? bind(fd, (struct sockaddr*)&storage, length) == 0 && listen(fd, 4) == 0
+                        : connect(fd, (struct sockaddr*)&storage, length) == 0;
+    if (!ok) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+//Отправка сообщения протокола целиком. Данные дополняются нулями до
+//кратного 8 размера, чтобы заголовки в буфере получателя были выровнены
+bool send_message(int fd, uint32_t type, uint32_t job, int32_t value, const void* data, uint32_t size) {
+    WireHeader header = { .type = type, .size = (size + 7) & ~7u, .job = job, .value = value };
+    size_t total = sizeof(header) + header.size;
+    char stack_buffer[256];
+    char* message = total <= sizeof(stack_buffer) ? stack_buffer : malloc(total);
+    if (!message) {
+        return false;
+    }
+    memcpy(message, &header, sizeof(header));
+    if (size > 0) {
+        memcpy(message + sizeof(header), data, size);
+    }
+    memset(message + sizeof(header) + size, 0, header.size - size);
+    
+    size_t written = 0;
+    while (written < total) {
+        ssize_t n = send(fd, message + written, total - written, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    if (message != stack_buffer) {
+        free(message);
+    }
+    return written == total;
+}
+
+//Чтение из сокета в буфер сообщений, не больше WIRE_READ_LIMIT байт за раз:
+//остальное дочитается на следующем событии epoll, и один собеседник не
+//займет цикл событий. false - соединение закрыто или ошибка (прочитанное
+//остается в буфере)
+bool fill_message_buffer(int fd, MessageBuffer* buffer) {
+    size_t limit = buffer->size + WIRE_READ_LIMIT;
+    while (buffer->size < limit) {
+        if (buffer->capacity - buffer->size < OUTPUT_CHUNK) {
+            size_t capacity = buffer->capacity * 2 + OUTPUT_CHUNK;
+            char* data = realloc(buffer->data, capacity);
+            if (!data) {
+                return false;
+            }
+            buffer->data = data;
+            buffer->capacity = capacity;
+        }
+        size_t room = buffer->capacity - buffer->size;
+        if (room > limit - buffer->size) {
+            room = limit - buffer->size;
+        }
+        ssize_t n = recv(fd, buffer->data + buffer->size, room, MSG_DONTWAIT);
+        if (n > 0) {
+            buffer->size += n;
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else {
+            return n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return true;
+}
+
+//Следующее полностью пришедшее сообщение, начиная с *offset, или NULL.
+//Размер из заголовка больше WIRE_MAX_PAYLOAD - ошибка протокола (*invalid):
+//иначе собеседник заставил бы копить в буфере сколько угодно данных
+const WireHeader* next_message(const MessageBuffer* buffer, size_t* offset, bool* invalid) {
+    if (buffer->size - *offset < sizeof(WireHeader)) {
+        return NULL;
+    }
+    const WireHeader* header = (const WireHeader*)(buffer->data + *offset);
+    if (header->size > WIRE_MAX_PAYLOAD) {
+        *invalid = true;
+        return NULL;
+    }
+    if (buffer->size - *offset - sizeof(WireHeader) < header->size) {
+        return NULL;
+    }
+    *offset += sizeof(WireHeader) + header->size;
+    return header;
+}
+
+//Удаление обработанных сообщений из начала буфера
+void consume_messages(MessageBuffer* buffer, size_t offset) {
+    memmove(buffer->data, buffer->data + offset, buffer->size - offset);
+    buffer->size -= offset;
+}
+
+//Подключение координатора к воркерам из списка через запятую. Воркер сразу
+//сообщает свою емкость; max_concurrent становится суммой емкостей
+bool connect_workers(const char* list) {
+    for (int i = 0; i < dag.job_count; i++) {
+        if (dag.jobs[i].emits) {
+            fprintf(stderr, "Ошибка: задача %s с emits: true не может выполняться на воркере\n",
+                    pool_str(dag.jobs[i].name));
+            return false;
+        }
+    }
+    
+    dag.worker_list = strdup(list);
+    if (!dag.worker_list) {
+        return false;
+    }
+    int max_workers = 1;
+    for (const char* p = list; *p; p++) {
+        max_workers += *p == ',';
+    }
+    dag.workers = calloc(max_workers, sizeof(Worker));
+    if (!dag.workers) {
+        return false;
+    }
+    
+    dag.max_concurrent = 0;
+    char* saveptr;
+    for (char* endpoint = strtok_r(dag.worker_list, ",", &saveptr); endpoint != NULL;
+         endpoint = strtok_r(NULL, ",", &saveptr)) {
+        Worker* worker = &dag.workers[dag.worker_count++];
+        worker->endpoint = endpoint;
+        
+        //Воркер мог быть запущен только что и еще не открыть сокет
+        int fd;
+        for (int attempt = 0; (fd = open_endpoint(endpoint, false)) == -1 &&
+                              (errno == ENOENT || errno == ECONNREFUSED) &&
+                              attempt < WORKER_CONNECT_ATTEMPTS; attempt++) {
+            usleep(WORKER_CONNECT_DELAY_US);
+        }
+        worker->fd = fd;
+        if (fd == -1) {
+            fprintf(stderr, "Ошибка подключения к воркеру %s: %s\n", endpoint, strerror(errno));
+            return false;
+        }
+        
+        WireHeader hello;
+        size_t received = 0;
+        while (received < sizeof(hello)) {
+            ssize_t n = recv(fd, (char*)&hello + received, sizeof(hello) - received, 0);
+            if (n <= 0) {
+                break;
+            }
+            received += n;
+        }
+        if (received < sizeof(hello) || hello.type != WIRE_HELLO || hello.value <= 0) {
+            fprintf(stderr, "Ошибка: %s не ответил как воркер (занят другим координатором?)\n",
+                    endpoint);
+            return false;
+        }
+        worker->capacity = hello.value;
+        dag.max_concurrent += worker->capacity;
+        printf("Воркер %s: емкость %d\n", endpoint, worker->capacity);
+    }
+    printf("Воркеров: %d, задач одновременно: %d\n", dag.worker_count, dag.max_concurrent);
+    return true;
+}
+
+//Отправка допущенной задачи наименее загруженному воркеру
+bool dispatch_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    int best = -1;
+    for (int w = 0; w < dag.worker_count; w++) {
+        Worker* worker = &dag.workers[w];
+        if (worker->fd != -1 && worker->running < worker->capacity &&
+            (best < 0 || worker->capacity - worker->running >
+                         dag.workers[best].capacity - dag.workers[best].running)) {
+            best = w;
+        }
+    }
+    if (best < 0) {
+        fprintf(stderr, "Ошибка: нет свободного воркера для задачи %s\n", pool_str(job->name));
+        return false;
+    }
+    
+    //Команда для /bin/sh или аргументы exec: - строки подряд через \0
+    const char* command = pool_str(job->command);
+    size_t size = 0;
+    int argc = job->exec_start >= 0 ? job->exec_argc : 0;
+    for (int i = 0; i < argc; i++) {
+        size += strlen(pool_str(dag.exec_args[job->exec_start + i])) + 1;
+    }
+    if (argc == 0) {
+        size = strlen(command) + 1;
+    }
+    if (size > WIRE_MAX_PAYLOAD) {
+        fprintf(stderr, "Ошибка: команда задачи %s длиннее %d байт и не может быть отправлена воркеру\n",
+                pool_str(job->name), WIRE_MAX_PAYLOAD);
+        return false;
+    }
+    char* payload = malloc(size);
+    if (!payload) {
+        return false;
+    }
+    if (argc == 0) {
+        memcpy(payload, command, size);
+    }
+    char* p = payload;
+    for (int i = 0; i < argc; i++) {
+        const char* arg = pool_str(dag.exec_args[job->exec_start + i]);
+        size_t length = strlen(arg) + 1;
+        memcpy(p, arg, length);
+        p += length;
+    }
+    
+    Worker* worker = &dag.workers[best];
+    bool sent = send_message(worker->fd, WIRE_RUN, job - dag.jobs, argc, payload, size);
+    free(payload);
+    if (!sent) {
+        fprintf(stderr, "Ошибка отправки задачи %s воркеру %s\n", pool_str(job->name),
+                worker->endpoint);
+        return false;
+    }
+    worker->running++;
+    run->worker = best + 1;
+    printf("  %s: отправлена воркеру %s (занято %d/%d)\n", pool_str(job->name),
+           worker->endpoint, worker->running, worker->capacity);
+    return true;
+}
+
+//Выполняется ли задача: локальный процесс, общий shell слота или воркер
+bool job_active(const Job* job) {
+    JobRuntime* run = job_runtime(job);
+    return run->pidfd != -1 || run->batched || run->worker > 0;
+}
+
+//Сигнал группе процессов задачи, локальной или на воркере. У задачи в общем
+//shell pid - это pid shell, и сигнал завершает его вместе с задачей
+void signal_job(Job* job, int signo) {
+    JobRuntime* run = job_runtime(job);
+    if (run->worker > 0) {
+        send_message(dag.workers[run->worker - 1].fd, WIRE_SIGNAL, job - dag.jobs, signo, NULL, 0);
+    } else {
+        kill(-run->pid, signo);
+    }
+}
+
+//Задача на воркере завершилась (или воркер пропал - тогда status < 0)
+void finish_remote_job(Job* job, int status, const WireUsage* usage) {
+    JobRuntime* run = job_runtime(job);
+    Worker* worker = &dag.workers[run->worker - 1];
+    worker->running--;
+    run->worker = 0;
+    if (dag.trace_file) {
+        run->exited_at = monotonic_seconds();
+    }
+    if (run->timerfd != -1) {
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, run->timerfd, NULL);
+        close(run->timerfd);
+        run->timerfd = -1;
+    }
+    
+    if (status < 0) {
+        printf("Задача %s потеряна вместе с воркером %s\n", pool_str(job->name), worker->endpoint);
+        run->failed = true;
+        dag.dag_failed = true;
+        finish_job(job);
+        return;
+    }
+    run->current_run.wall_time = monotonic_seconds() - run->started_at;
+    run->current_run.cpu_time = usage->cpu_time;
+    run->current_run.max_rss_kb = usage->max_rss_kb;
+    complete_job(job, status);
+}
+
+//Сообщения от воркера (вызывается из цикла событий)
+void on_worker_message(int worker_idx) {
+    Worker* worker = &dag.workers[worker_idx];
+    bool open = fill_message_buffer(worker->fd, &worker->input);
+    
+    size_t offset = 0;
+    bool invalid = false;
+    const WireHeader* header;
+    while ((header = next_message(&worker->input, &offset, &invalid)) != NULL) {
+        if (header->type != WIRE_DONE || header->size < sizeof(WireUsage) ||
+            header->job >= (uint32_t)dag.job_count ||
+            dag.job_runtime[header->job].worker != worker_idx + 1) {
+            fprintf(stderr, "Ошибка: неверное сообщение от воркера %s\n", worker->endpoint);
+            open = false;
+            break;
+        }
+        WireUsage usage;
+        memcpy(&usage, header + 1, sizeof(usage));
+        finish_remote_job(&dag.jobs[header->job], header->value, &usage);
+    }
+    if (invalid) {
+        fprintf(stderr, "Ошибка: неверное сообщение от воркера %s\n", worker->endpoint);
+        open = false;
+    }
+    consume_messages(&worker->input, offset);
+    if (open) {
+        return;
+    }
+    
+    //Воркер отключился: его задачи считаются проваленными, слоты пропадают
+    fprintf(stderr, "Воркер %s отключился\n", worker->endpoint);
+    epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, worker->fd, NULL);
+    for (int i = 0; i < dag.job_count; i++) {
+        if (dag.job_runtime[i].worker == worker_idx + 1) {
+            finish_remote_job(&dag.jobs[i], -1, NULL);
+        }
+    }
+    close(worker->fd);
+    worker->fd = -1;
+    dag.max_concurrent -= worker->capacity;
+}
+
+//Отключение от воркеров: сами воркеры продолжают ждать следующего координатора
+void disconnect_workers(void) {
+    for (int w = 0; w < dag.worker_count; w++) {
+        if (dag.workers[w].fd != -1) {
+            close(dag.workers[w].fd);
+        }
+        free(dag.workers[w].input.data);
+    }
+    free(dag.workers);
+    free(dag.worker_list);
+    dag.workers = NULL;
+    dag.worker_list = NULL;
+    dag.worker_count = 0;
+}
+
+//Запуск задачи на воркере по сообщению WIRE_RUN. Возвращает pid или -1
+pid_t spawn_worker_job(const WireHeader* header, posix_spawnattr_t* attr) {
+    const char* payload = (const char*)(header + 1);
+    int argc = header->value;
+    char* shell_argv[] = { "sh", "-c", (char*)payload, NULL };
+    char** argv = shell_argv;
+    
+    if (argc > 0) {
+        argv = malloc((argc + 1) * sizeof(char*));
+        if (!argv) {
+            return -1;
+        }
+        const char* p = payload;
+        const char* end = payload + header->size;
+        for (int i = 0; i < argc; i++) {
+            argv[i] = (char*)p;
+            p = memchr(p, '\0', end - p);
+            if (p == NULL) {
+                free(argv);
+                return -1;
+            }
+            p++;
+        }
+        argv[argc] = NULL;
+    } else if (memchr(payload, '\0', header->size) == NULL) {
+        return -1;
+    }
+    
+    pid_t pid;
+    int err = argc > 0 ? posix_spawnp(&pid, argv[0], NULL, attr, argv, environ)
+                       : posix_spawn(&pid, "/bin/sh", NULL, attr, argv, environ);
+    if (err != 0) {
+        fprintf(stderr, "Ошибка запуска задачи #%u (%s): %s\n", header->job, argv[0], strerror(err));
+        pid = -1;
+    }
+    if (argv != shell_argv) {
+        free(argv);
+    }
+    return pid;
+}
+
+//Режим воркера (--worker): слушает адрес, принимает одного координатора за раз,
+//запускает присланные задачи (до capacity одновременно) и сообщает об их
+//завершении. Отключение координатора останавливает его задачи.
+//Завершается по SIGINT/SIGTERM
+int run_worker(const char* endpoint, int capacity) {
+    int listen_fd = open_endpoint(endpoint, true);
+    if (listen_fd == -1) {
+        fprintf(stderr, "Ошибка открытия адреса воркера %s: %s\n", endpoint, strerror(errno));
+        return 1;
+    }
+    
+    WorkerSlot* slots = calloc(capacity, sizeof(WorkerSlot));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sigset_t stop_signals, empty_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigemptyset(&empty_mask);
+    sigprocmask(SIG_BLOCK, &stop_signals, NULL);
+    int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = event_key(EVENT_ACCEPT, 0) };
+    struct epoll_event signal_event = { .events = EPOLLIN, .data.u64 = event_key(EVENT_SIGNAL, 0) };
+    if (!slots || epoll_fd == -1 || signal_fd == -1 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == -1 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &signal_event) == -1) {
+        perror("Ошибка запуска воркера");
+        return 1;
+    }
+    for (int s = 0; s < capacity; s++) {
+        slots[s].pidfd = -1;
+    }
+    
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setsigmask(&attr, &empty_mask);
+    
+    printf("Воркер слушает %s, емкость %d\n", endpoint, capacity);
+    fflush(stdout);
+    
+    int coordinator_fd = -1;
+    MessageBuffer input = {0};
+    bool stopping = false;
+    struct epoll_event events[EPOLL_BATCH];
+    while (!stopping) {
+        int ready = epoll_wait(epoll_fd, events, EPOLL_BATCH, -1);
+        if (ready == -1 && errno != EINTR) {
+            perror("Ошибка epoll_wait");
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            int kind = events[i].data.u64 >> 32;
+            int slot_idx = (uint32_t)events[i].data.u64;
+            
+            if (kind == EVENT_SIGNAL) {
+                stopping = true;
+            } else if (kind == EVENT_ACCEPT) {
+                int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+                if (fd == -1) {
+                    continue;
+                }
+                if (coordinator_fd != -1) {
+                    close(fd); //Координатор уже подключен: новый не получит HELLO
+                    continue;
+                }
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                struct epoll_event conn_event = { .events = EPOLLIN,
+                                                  .data.u64 = event_key(EVENT_WORKER, 0) };
+                if (!send_message(fd, WIRE_HELLO, 0, capacity, NULL, 0) ||
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &conn_event) == -1) {
+                    close(fd);
+                    continue;
+                }
+                coordinator_fd = fd;
+                input.size = 0;
+                printf("Воркер: подключился координатор\n");
+                fflush(stdout);
+            } else if (kind == EVENT_WORKER) {
+                bool open = fill_message_buffer(coordinator_fd, &input);
+                size_t offset = 0;
+                bool invalid = false;
+                const WireHeader* header;
+                while ((header = next_message(&input, &offset, &invalid)) != NULL) {
+                    WorkerSlot* slot = NULL;
+                    for (int s = 0; s < capacity; s++) {
+                        bool match = header->type == WIRE_RUN ? slots[s].pidfd == -1
+                                                              : slots[s].pidfd != -1 &&
+                                                                slots[s].job == header->job;
+                        if (match) {
+                            slot = &slots[s];
+                            break;
+                        }
+                    }
+                    if (header->type == WIRE_SIGNAL) {
+                        if (slot != NULL) {
+                            slot->term_sent = true;
+                            kill(-slot->pid, header->value);
+                        }
+                        continue;
+                    }
+                    if (header->type != WIRE_RUN || slot == NULL) {
+                        fprintf(stderr, "Воркер: неверное сообщение координатора\n");
+                        open = false;
+                        break;
+                    }
+                    
+                    //Задача, которую не удалось запустить, завершается с кодом 127, как в sh
+                    WireUsage usage = {0};
+                    pid_t pid = spawn_worker_job(header, &attr);
+                    int pidfd = pid > 0 ? syscall(SYS_pidfd_open, pid, 0) : -1;
+                    struct epoll_event exit_event = { .events = EPOLLIN,
+                                                      .data.u64 = event_key(EVENT_EXIT, slot - slots) };
+                    if (pidfd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &exit_event) == -1) {
+                        if (pid > 0) {
+                            kill(-pid, SIGKILL);
+                            waitpid(pid, NULL, 0);
+                        }
+                        if (pidfd != -1) {
+                            close(pidfd);
+                        }
+                        send_message(coordinator_fd, WIRE_DONE, header->job, 127 << 8,
+                                     &usage, sizeof(usage));
+                        continue;
+                    }
+                    slot->pid = pid;
+                    slot->pidfd = pidfd;
+                    slot->job = header->job;
+                    slot->term_sent = false;
+                }
+                if (invalid) {
+                    fprintf(stderr, "Воркер: неверное сообщение координатора\n");
+                    open = false;
+                }
+                consume_messages(&input, offset);
+                
+                //Координатор ушел: его задачи больше никому не нужны
+                if (!open) {
+                    printf("Воркер: координатор отключился\n");
+                    fflush(stdout);
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, coordinator_fd, NULL);
+                    close(coordinator_fd);
+                    coordinator_fd = -1;
+                    for (int s = 0; s < capacity; s++) {
+                        if (slots[s].pidfd != -1) {
+                            kill(-slots[s].pid, SIGKILL);
+                        }
+                    }
+                }
+            } else if (kind == EVENT_EXIT) {
+                WorkerSlot* slot = &slots[slot_idx];
+                int status;
+                struct rusage rusage;
+                if (slot->term_sent) {
+                    kill(-slot->pid, SIGKILL);
+                }
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, slot->pidfd, NULL);
+                close(slot->pidfd);
+                slot->pidfd = -1;
+                if (wait4(slot->pid, &status, 0, &rusage) == -1) {
+                    status = 127 << 8;
+                    memset(&rusage, 0, sizeof(rusage));
+                }
+                WireUsage usage = {
+                    .cpu_time = rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec / 1e6 +
+                                rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec / 1e6,
+                    .max_rss_kb = rusage.ru_maxrss
+                };
+                if (coordinator_fd != -1) {
+                    send_message(coordinator_fd, WIRE_DONE, slot->job, status, &usage, sizeof(usage));
+                }
+            }
+        }
+    }
+    
+    //Остановка: задачи не переживают воркер
+    printf("Воркер остановлен\n");
+    for (int s = 0; s < capacity; s++) {
+        if (slots[s].pidfd != -1) {
+            kill(-slots[s].pid, SIGKILL);
+            waitpid(slots[s].pid, NULL, 0);
+            close(slots[s].pidfd);
+        }
+    }
+    if (coordinator_fd != -1) {
+        close(coordinator_fd);
+    }
+    if (strchr(endpoint, ':') == NULL || strchr(endpoint, '/') != NULL) {
+        unlink(endpoint);
+    }
+    posix_spawnattr_destroy(&attr);
+    close(signal_fd);
+    close(epoll_fd);
+    close(listen_fd);
+    free(input.data);
+    free(slots);
+    return 0;
+}
+
+//cgroup v2 (--cgroups): каждая задача запускается в своем листе
+//<cgroup исполнителя>/dag_executor.<pid>/job<индекс> с лимитами cpu_max и
+//memory_max_mb из YAML, а при сборе из него читается расход задачи вместе
+//со всеми ее потомками. Без cgroup v2 или без прав задачи запускаются как обычно.
+//Исходный cgroup исполнителя не меняется: контроллеры включаются только в
+//своем dag_executor.<pid>, а сам исполнитель на время работы переходит в его
+//лист executor, чтобы в dag_executor.<pid> не было процессов. Доступны те
+//контроллеры, которые делегировавший cgroup (например, systemd с Delegate=yes)
+//уже включил для потомков
+bool cgroup_setup(void) {
+    //Точка монтирования cgroup2 (в гибридной схеме - /sys/fs/cgroup/unified)
+    char mount_point[1024] = "";
+    char line[4096];
+    FILE* mountinfo = fopen("/proc/self/mountinfo", "r");
+    while (mountinfo && fgets(line, sizeof(line), mountinfo)) {
+        char* separator = strstr(line, " - cgroup2 ");
+        char path[1024];
+        if (separator && sscanf(line, "%*s %*s %*s %*s %1023s", path) == 1) {
+            strcpy(mount_point, path);
+            break;
+        }
+    }
+    if (mountinfo) {
+        fclose(mountinfo);
+    }
+    
+    //Свой cgroup в иерархии v2: строка "0::/путь"
+    char own[4096] = "";
+    FILE* cgroup = fopen("/proc/self/cgroup", "r");
+    while (cgroup && fgets(line, sizeof(line), cgroup)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(own, sizeof(own), "%s", line + 3);
+            break;
+        }
+    }
+    if (cgroup) {
+        fclose(cgroup);
+    }
+    if (mount_point[0] == '\0' || own[0] == '\0') {
+        printf("cgroup v2 недоступны: задачи запускаются без изоляции\n");
+        return false;
+    }
+    
+    char home[sizeof(mount_point) + sizeof(own)];
+    snprintf(home, sizeof(home), "%s%s", mount_point, strcmp(own, "/") == 0 ? "" : own);
+    if (asprintf(&dag.cgroup_path, "%s/dag_executor.%d", home, getpid()) == -1) {
+        dag.cgroup_path = NULL;
+        return false;
+    }
+    dag.cgroup_home_fd = -1;
+    if (mkdir(dag.cgroup_path, 0755) == -1 ||
+        (dag.cgroup_fd = open(dag.cgroup_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        printf("cgroup v2 недоступны (%s: %s): задачи запускаются без изоляции\n",
+               dag.cgroup_path, strerror(errno));
+        rmdir(dag.cgroup_path);
+        free(dag.cgroup_path);
+        dag.cgroup_path = NULL;
+        return false;
+    }
+    
+    //Исполнитель уходит в лист executor; если перейти не удалось, он
+    //остается в исходном cgroup, а dag_executor.<pid> все равно без процессов
+    int executor_fd = -1;
+    if (mkdirat(dag.cgroup_fd, "executor", 0755) == 0) {
+        executor_fd = openat(dag.cgroup_fd, "executor", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        dag.cgroup_home_fd = open(home, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (executor_fd == -1 || dag.cgroup_home_fd == -1 ||
+            !write_cgroup_file(executor_fd, "cgroup.procs", "0")) {
+            if (dag.cgroup_home_fd != -1) {
+                close(dag.cgroup_home_fd);
+                dag.cgroup_home_fd = -1;
+            }
+            unlinkat(dag.cgroup_fd, "executor", AT_REMOVEDIR);
+        }
+        if (executor_fd != -1) {
+            close(executor_fd);
+        }
+    }
+    
+    //Контроллеры для листов задач - из доступных dag_executor.<pid>
+    static const char* controllers[] = { "cpu", "memory", "io" };
+    char available[256] = "";
+    read_cgroup_file(dag.cgroup_fd, "cgroup.controllers", available, sizeof(available));
+    for (size_t i = 0; i < sizeof(controllers) / sizeof(controllers[0]); i++) {
+        if (cgroup_has_controller(available, controllers[i])) {
+            char request[16];
+            snprintf(request, sizeof(request), "+%s", controllers[i]);
+            write_cgroup_file(dag.cgroup_fd, "cgroup.subtree_control", request);
+        }
+    }
+    char enabled[256] = "";
+    read_cgroup_file(dag.cgroup_fd, "cgroup.subtree_control", enabled, sizeof(enabled));
+    enabled[strcspn(enabled, "\n")] = '\0';
+    dag.cgroup_cpu = cgroup_has_controller(enabled, "cpu");
+    dag.cgroup_memory = cgroup_has_controller(enabled, "memory");
+    printf("cgroup задач: %s (контроллеры: %s)\n", dag.cgroup_path,
+           enabled[0] ? enabled : "нет, лимиты не применяются");
+    return true;
+}
+
+//Есть ли контроллер в списке через пробел (cgroup.controllers,
+//cgroup.subtree_control): "cpu" не совпадает с "cpuset"
+bool cgroup_has_controller(const char* list, const char* controller) {
+    size_t length = strlen(controller);
+    for (const char* p = list; (p = strstr(p, controller)) != NULL; p += length) {
+        if ((p == list || p[-1] == ' ') && (p[length] == '\0' || p[length] == ' ' || p[length] == '\n')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Запись строки в файл cgroup (относительно каталога dir_fd)
+bool write_cgroup_file(int dir_fd, const char* file, const char* value) {
+    int fd = openat(dir_fd, file, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    bool written = write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+    close(fd);
+    return written;
+}
+
+//Чтение файла cgroup в buffer. Возвращает длину или -1
+int read_cgroup_file(int dir_fd, const char* file, char* buffer, size_t size) {
+    int fd = openat(dir_fd, file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t length = read(fd, buffer, size - 1);
+    close(fd);
+    if (length < 0) {
+        return -1;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+//Сумма значений ключа key ("usage_usec ", "rbytes=") по всему файлу cgroup;
+//пустой key - файл из одного числа. -1, если файла нет
+long long sum_cgroup_key(int dir_fd, const char* file, const char* key) {
+    char buffer[4096];
+    if (read_cgroup_file(dir_fd, file, buffer, sizeof(buffer)) < 0) {
+        return -1;
+    }
+    size_t key_len = strlen(key);
+    if (key_len == 0) {
+        return atoll(buffer);
+    }
+    long long sum = 0;
+    for (const char* p = buffer; (p = strstr(p, key)) != NULL; p += key_len) {
+        if (p == buffer || p[-1] == ' ' || p[-1] == '\n') {
+            sum += atoll(p + key_len);
+        }
+    }
+    return sum;
+}
+
+//Лист cgroup для задачи перед запуском, с ее лимитами. Без листа задача
+//запускается в cgroup исполнителя
+void cgroup_create_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    char name[32];
+    snprintf(name, sizeof(name), "job%d", (int)(job - dag.jobs));
+    if (mkdirat(dag.cgroup_fd, name, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Ошибка создания cgroup задачи %s: %s\n", pool_str(job->name), strerror(errno));
+        return;
+    }
+    run->cgroup_fd = openat(dag.cgroup_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (run->cgroup_fd == -1) {
+        return;
+    }
+    
+    char value[64];
+    if (job->cpu_max > 0) {
+        snprintf(value, sizeof(value), "%ld %d", (long)(job->cpu_max * CGROUP_CPU_PERIOD_US),
+                 CGROUP_CPU_PERIOD_US);
+        if (!dag.cgroup_cpu || !write_cgroup_file(run->cgroup_fd, "cpu.max", value)) {
+            printf("  %s: cpu_max не применен (нет контроллера cpu)\n", pool_str(job->name));
+        }
+    }
+    if (job->memory_max_kb > 0) {
+        snprintf(value, sizeof(value), "%ld", job->memory_max_kb * 1024);
+        if (!dag.cgroup_memory || !write_cgroup_file(run->cgroup_fd, "memory.max", value)) {
+            printf("  %s: memory_max_mb не применен (нет контроллера memory)\n", pool_str(job->name));
+        } else {
+            //Лимит должен останавливать задачу, а не выталкивать хост в swap
+            write_cgroup_file(run->cgroup_fd, "memory.swap.max", "0");
+        }
+    }
+}
+
+//Расход задачи по ее cgroup (после wait4): процессорное время и пиковая
+//память всех процессов листа, включая не дождавшихся потомков, и объем IO
+void cgroup_collect_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    long long usage_usec = sum_cgroup_key(run->cgroup_fd, "cpu.stat", "usage_usec ");
+    long long peak = sum_cgroup_key(run->cgroup_fd, "memory.peak", "");
+    long long read_bytes = sum_cgroup_key(run->cgroup_fd, "io.stat", "rbytes=");
+    long long write_bytes = sum_cgroup_key(run->cgroup_fd, "io.stat", "wbytes=");
+    long long oom_kills = sum_cgroup_key(run->cgroup_fd, "memory.events", "oom_kill ");
+    
+    printf("  %s: cgroup: CPU %.3f с", pool_str(job->name), usage_usec >= 0 ? usage_usec / 1e6 : 0);
+    if (usage_usec >= 0) {
+        run->current_run.cpu_time = usage_usec / 1e6;
+    }
+    if (peak > 0) {
+        run->current_run.max_rss_kb = peak / 1024;
+        printf(", память %.1f МБ (пик)", peak / (1024.0 * 1024.0));
+    }
+    if (read_bytes >= 0) {
+        printf(", IO чтение %.1f МБ, запись %.1f МБ", read_bytes / (1024.0 * 1024.0),
+               write_bytes / (1024.0 * 1024.0));
+    }
+    if (oom_kills > 0) {
+        printf(", остановлена по memory_max_mb");
+    }
+    printf("\n");
+    cgroup_release_job(job);
+}
+
+//Удаление листа задачи. Оставшиеся в нем фоновые потомки задачи
+//завершаются через cgroup.kill, иначе каталог не удалить
+void cgroup_release_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    char name[32];
+    snprintf(name, sizeof(name), "job%d", (int)(job - dag.jobs));
+    write_cgroup_file(run->cgroup_fd, "cgroup.kill", "1");
+    close(run->cgroup_fd);
+    run->cgroup_fd = -1;
+    if (unlinkat(dag.cgroup_fd, name, AT_REMOVEDIR) == -1) {
+        dag.cgroup_leftovers++;
+    }
+}
+
+//Удаление cgroup исполнителя. Листы, которые не удалось удалить сразу
+//(процессы после cgroup.kill еще завершались), удаляются здесь. Исполнитель
+//возвращается в исходный cgroup
+void cgroup_teardown(void) {
+    if (dag.cgroup_home_fd != -1) {
+        if (!write_cgroup_file(dag.cgroup_home_fd, "cgroup.procs", "0")) {
+            perror("Ошибка возврата в исходный cgroup");
+        }
+        close(dag.cgroup_home_fd);
+        dag.cgroup_home_fd = -1;
+        unlinkat(dag.cgroup_fd, "executor", AT_REMOVEDIR);
+    }
+    for (int i = 0; dag.cgroup_leftovers > 0 && i < dag.job_count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "job%d", i);
+        for (int attempt = 0; unlinkat(dag.cgroup_fd, name, AT_REMOVEDIR) == -1 && errno == EBUSY &&
+                              attempt < CGROUP_RMDIR_ATTEMPTS; attempt++) {
+            usleep(CGROUP_RMDIR_DELAY_US);
+        }
+    }
+    close(dag.cgroup_fd);
+    dag.cgroup_fd = -1;
+    if (rmdir(dag.cgroup_path) == -1) {
+        fprintf(stderr, "Не удалось удалить cgroup %s: %s\n", dag.cgroup_path, strerror(errno));
+    }
+    free(dag.cgroup_path);
+    dag.cgroup_path = NULL;
+}
+
+//Журнал переходов задач (<config>.journal): запуск и завершение каждой
+//задачи. Без --resume журнал начинается заново, с --resume дописывается,
+//а выполненные в прошлый раз задачи не запускаются. После успешного
+//выполнения всего DAG журнал удаляется
+bool open_journal(const char* config_path) {
+    size_t path_len = strlen(config_path) + strlen(JOURNAL_SUFFIX) + 1;
+    dag.journal_path = malloc(path_len);
+    if (!dag.journal_path) {
+        fprintf(stderr, "Не удалось выделить память\n");
+        return false;
+    }
+    snprintf(dag.journal_path, path_len, "%s%s", config_path, JOURNAL_SUFFIX);
+    dag.journal_count = 0;
+    dag.journal_dirty = false;
+    dag.resumed_jobs = 0;
+    
+    off_t valid_length = 0;
+    if (resume_mode) {
+        valid_length = replay_journal();
+    }
+    
+    dag.journal_fd = open(dag.journal_path, O_WRONLY | O_CREAT | O_CLOEXEC |
+                          (resume_mode ? O_APPEND : O_TRUNC), 0644);
+    if (dag.journal_fd == -1) {
+        perror("Не удалось открыть журнал");
+        return false;
+    }
+    //Недописанная запись в конце (или журнал неизвестного формата) отрезается,
+    //иначе новые записи легли бы со сдвигом и следующий --resume их не прочитал
+    if (resume_mode && ftruncate(dag.journal_fd, valid_length) == -1) {
+        perror("Не удалось обрезать журнал");
+        close(dag.journal_fd);
+        dag.journal_fd = -1;
+        return false;
+    }
+    struct stat st;
+    if (fstat(dag.journal_fd, &st) == 0 && st.st_size == 0) {
+        JournalHeader header;
+        memcpy(header.magic, JOURNAL_MAGIC, 4);
+        header.version = JOURNAL_VERSION;
+        if (write(dag.journal_fd, &header, sizeof(header)) != sizeof(header)) {
+            perror("Ошибка записи заголовка журнала");
+        }
     }
-    
+    dag.journal_synced_at = monotonic_seconds();
     return true;
 }
 
-//Проверка на наличие циклов (DFS) - вспомогательная функция
-bool has_cycle_util(int job_idx, bool visited[], bool rec_stack[]) {
-    if (!visited[job_idx]) {
-        visited[job_idx] = true;
-        rec_stack[job_idx] = true;
-        
-        Job* job = &dag.jobs[job_idx];
-        for (int i = 0; i < job->next_job_count; i++) {
-            //Находим индекс следующей задачи
-            int next_idx = -1;
-            for (int j = 0; j < dag.job_count; j++) {
-                if (&dag.jobs[j] == job->next_jobs[i]) {
-                    next_idx = j;
-                    break;
-                }
-            }
-            
-            if (next_idx != -1) {
-                if (!visited[next_idx] && has_cycle_util(next_idx, visited, rec_stack)) {
-                    return true;
-                } else if (rec_stack[next_idx]) {
-                    return true;
-                }
-            }
+//Чтение журнала прошлого запуска (--resume): задача считается выполненной,
+//если ее последняя запись - COMPLETED и выполнены все ее зависимости.
+//Записи о задачах, которых в конфигурации больше нет (или они переехали), и
+//недописанная запись в конце файла пропускаются.
+//Возвращает длину прочитанной части журнала (0 - журнала нет или он не читается)
+off_t replay_journal(void) {
+    int fd = open(dag.journal_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        printf("Журнал %s не найден: выполняем DAG с начала\n", dag.journal_path);
+        return 0;
+    }
+    struct stat st;
+    const char* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(JournalHeader)) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    
+    const JournalHeader* header = (const JournalHeader*)data;
+    if (memcmp(header->magic, JOURNAL_MAGIC, 4) != 0 || header->version != JOURNAL_VERSION) {
+        fprintf(stderr, "Журнал %s имеет неизвестный формат, игнорируем\n", dag.journal_path);
+        munmap((void*)data, st.st_size);
+        return 0;
+    }
+    
+    long records = 0;
+    for (size_t pos = sizeof(JournalHeader); pos + sizeof(JournalRecord) <= (size_t)st.st_size;
+         pos += sizeof(JournalRecord)) {
+        JournalRecord record;
+        memcpy(&record, data + pos, sizeof(record));
+        records++;
+        if (record.job >= (uint32_t)dag.job_count ||
+            dag.symtab.symbols[dag.jobs[record.job].symbol].hash != record.name_hash) {
+            continue;
         }
+        dag.jobs[record.job].completed = record.state == JOURNAL_COMPLETED;
     }
+    munmap((void*)data, st.st_size);
     
-    rec_stack[job_idx] = false;
-    return false;
+    //Задача с невыполненной зависимостью перезапускается, как и задача с
+    //emits: true - добавленных ею задач в конфигурации нет
+    for (int k = 0; k < dag.job_count; k++) {
+        Job* job = &dag.jobs[dag.topo_order[k]];
+        if (!job->completed) {
+            continue;
+        }
+        bool ready = !job->emits;
+        for (int j = 0; ready && j < job->dependency_count; j++) {
+            ready = dag.jobs[dag.deps[job->dep_start + j]].completed;
+        }
+        job->completed = ready;
+        dag.resumed_jobs += ready;
+    }
+    printf("Журнал %s: %ld записей, уже выполнено задач: %d из %d\n",
+           dag.journal_path, records, dag.resumed_jobs, dag.job_count);
+    return sizeof(JournalHeader) + records * sizeof(JournalRecord);
 }
 
-//Проверка на наличие циклов
-bool has_cycles(void) {
-    bool visited[MAX_JOBS] = {false};
-    bool rec_stack[MAX_JOBS] = {false};
-    
+//Фронт возобновленного DAG: выполненные по журналу задачи снимают свою
+//зависимость с последователей, а готовые невыполненные задачи встают в очередь
+void push_resumed_frontier(void) {
     for (int i = 0; i < dag.job_count; i++) {
-        if (has_cycle_util(i, visited, rec_stack)) {
-            return true;
+        if (!dag.jobs[i].completed) {
+            continue;
+        }
+        dag.finished_jobs++;
+        for (int e = dag.next_offsets[i]; e < dag.next_offsets[i + 1]; e++) {
+            dag.jobs[dag.next_jobs[e]].remaining_deps--;
+        }
+    }
+    for (int k = 0; k < dag.job_count; k++) {
+        int job_idx = dag.topo_order[k];
+        if (!dag.jobs[job_idx].completed && dag.jobs[job_idx].remaining_deps == 0) {
+            push_ready_job(job_idx);
         }
     }
-    
-    return false;
 }
 
-//Проверка корректности DAG
-bool validate_dag(void) {
-    //Проверка на циклы
-    if (has_cycles()) {
-        fprintf(stderr, "Обнаружен цикл в DAG\n");
-        return false;
+//Переход задачи в журнал. Записи копятся в буфере и уходят одним write
+//за итерацию цикла событий (journal_sync)
+void journal_job(const Job* job, uint32_t state) {
+    if (dag.journal_count == JOURNAL_BUFFER_RECORDS) {
+        journal_write();
     }
-    
-    //Проверка на наличие задач
-    if (dag.job_count == 0) {
-        fprintf(stderr, "DAG не содержит задач\n");
+    JournalRecord* record = &dag.journal_buffer[dag.journal_count++];
+    record->job = job - dag.jobs;
+    record->name_hash = dag.symtab.symbols[job->symbol].hash;
+    record->state = state;
+}
+
+//Запись буфера журнала. После write запись переживает падение исполнителя,
+//а падение системы - только после fdatasync в journal_sync
+void journal_write(void) {
+    if (dag.journal_count == 0) {
+        return;
+    }
+    ssize_t size = dag.journal_count * sizeof(JournalRecord);
+    if (write(dag.journal_fd, dag.journal_buffer, size) != size) {
+        perror("Ошибка записи журнала");
+    }
+    dag.journal_count = 0;
+    dag.journal_dirty = true;
+}
+
+//Сброс журнала (вызывается из цикла событий): write на каждой итерации,
+//fdatasync не чаще раза в JOURNAL_SYNC_SECONDS. Возвращает тайм-аут для
+//epoll_wait в миллисекундах до следующего fdatasync или -1
+int journal_sync(bool force) {
+    journal_write();
+    if (!dag.journal_dirty) {
+        return -1;
+    }
+    double now = monotonic_seconds();
+    double due = dag.journal_synced_at + JOURNAL_SYNC_SECONDS;
+    if (force || now >= due) {
+        fdatasync(dag.journal_fd);
+        dag.journal_dirty = false;
+        dag.journal_synced_at = now;
+        return -1;
+    }
+    return (int)((due - now) * 1000) + 1;
+}
+
+//Закрытие журнала. Успешно выполненному DAG журнал больше не нужен
+void close_journal(bool success) {
+    journal_sync(true);
+    close(dag.journal_fd);
+    dag.journal_fd = -1;
+    if (success) {
+        unlink(dag.journal_path);
+    } else {
+        printf("Журнал сохранен в %s: продолжить выполнение можно с --resume\n", dag.journal_path);
+    }
+}
+
+//Дописывание текста в строку для общего shell. quoted: слово в одинарных
+//кавычках, каждая кавычка внутри заменяется на '\''
+bool append_batch_script(const char* text, bool quoted) {
+    size_t len = strlen(text);
+    int needed = dag.batch_script_length + (quoted ? len * 4 + 2 : len) + 1;
+    if (!grow_array((void**)&dag.batch_script, &dag.batch_script_capacity, needed, 1)) {
         return false;
     }
     
-    //Проверка на наличие стартовых задач (задачи без зависимостей)
-    int start_jobs = 0;
-    for (int i = 0; i < dag.job_count; i++) {
-        if (dag.jobs[i].dependency_count == 0) {
-            start_jobs++;
+    char* out = dag.batch_script + dag.batch_script_length;
+    if (quoted) {
+        *out++ = '\'';
+        for (const char* c = text; *c; c++) {
+            if (*c == '\'') {
+                memcpy(out, "'\\''", 4);
+                out += 4;
+            } else {
+                *out++ = *c;
+            }
         }
+        *out++ = '\'';
+    } else {
+        memcpy(out, text, len);
+        out += len;
     }
-    
-    if (start_jobs == 0) {
-        fprintf(stderr, "Нет стартовых задач (задач без зависимостей)\n");
+    *out = '\0';
+    dag.batch_script_length = out - dag.batch_script;
+    return true;
+}
+
+//Запуск общего shell слота: /bin/sh читает команды из сокета на stdin и
+//пишет коды завершения в тот же сокет на BATCH_STATUS_FD
+bool spawn_batch_shell(int slot) {
+    BatchShell* shell = &dag.batch_shells[slot];
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        perror("Ошибка создания сокета общего shell");
         return false;
     }
     
-    //Проверка на наличие завершающих задач (задачи, от которых никто не зависит)
-    int end_jobs = 0;
-    for (int i = 0; i < dag.job_count; i++) {
-        if (dag.jobs[i].next_job_count == 0) {
-            end_jobs++;
-        }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], BATCH_STATUS_FD);
+    char* argv[] = { "sh", NULL };
+    int err = posix_spawn(&shell->pid, "/bin/sh", &actions, &dag.spawn_attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        fprintf(stderr, "Ошибка запуска общего shell: %s\n", strerror(err));
+        shell->pid = 0;
+        close(fds[0]);
+        return false;
     }
     
-    if (end_jobs == 0) {
-        fprintf(stderr, "Нет завершающих задач\n");
+    shell->fd = fds[0];
+    shell->job = -1;
+    shell->status_length = 0;
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = event_key(EVENT_BATCH, slot) };
+    if (epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, shell->fd, &event) == -1) {
+        perror("Ошибка подписки на сокет общего shell");
+        close(shell->fd);
+        shell->fd = -1;
+        kill(-shell->pid, SIGKILL);
+        waitpid(shell->pid, NULL, 0);
+        shell->pid = 0;
+        return false;
+    }
+    printf("  Слот %d: запущен общий shell (pid %d)\n", slot, shell->pid);
+    return true;
+}
+
+//Отправка задачи общему shell ее слота. Задача выполняется в подоболочке:
+//cd, exit и переменные не влияют на следующие задачи, stdin - /dev/null,
+//чтобы задача не прочитала чужие команды, а сокет shell ей не достается.
+//Команда передается через eval, поэтому незакрытая кавычка в ней - ошибка
+//этой задачи, а не поломка всего shell
+bool run_batched_job(Job* job) {
+    JobRuntime* run = job_runtime(job);
+    BatchShell* shell = &dag.batch_shells[run->slot];
+    if (shell->pid == 0 && !spawn_batch_shell(run->slot)) {
         return false;
     }
     
-    //Визуализация графа
-    printf("\nСтруктура графа:\n");
-    printf("  1 → 4  →  6\n");
-    printf("  2 ↗     ↗\n");
-    printf("  3 → 5 ↗\n");
+    dag.batch_script_length = 0;
+    if (!append_batch_script("(eval ", false) || !append_batch_script(pool_str(job->command), true) ||
+        !append_batch_script(") </dev/null 3>&-; echo $? >&3\n", false)) {
+        return false;
+    }
     
-    printf("\nDAG корректен:\n");
-    printf("  Всего задач: %d\n", dag.job_count);
-    printf("  Стартовых задач: %d\n", start_jobs);
-    printf("  Завершающих задач: %d\n", end_jobs);
-    printf("  Максимально параллельных задач: %d\n", dag.max_concurrent);
-    printf("  Всего мьютексов: %d\n", dag.mutex_count);
+    int written = 0;
+    while (written < dag.batch_script_length) {
+        ssize_t n = send(shell->fd, dag.batch_script + written,
+                         dag.batch_script_length - written, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            //Shell завершился: о его смерти еще сообщит epoll, а задачу
+            //исполнитель учтет сам
+            perror("Ошибка отправки задачи общему shell");
+            return false;
+        }
+        written += n;
+    }
     
+    shell->job = job - dag.jobs;
+    run->pid = shell->pid;
+    run->batched = true;
     return true;
 }
 
-//Функция для запуска задачи
-void* execute_job(void* arg) {
-    Job* job = (Job*)arg;
+//Код завершения задачи от общего shell или завершение самого shell
+//(вызывается из цикла событий). Процессорное время и память задачи в общем
+//shell не измеряются: wait4 ее подоболочки делает shell, а не исполнитель
+void on_batch_status(int slot) {
+    BatchShell* shell = &dag.batch_shells[slot];
+    ssize_t n = recv(shell->fd, shell->status + shell->status_length,
+                     sizeof(shell->status) - 1 - shell->status_length, MSG_DONTWAIT);
+    if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
     
-    //Блокируем мьютексы, если они есть
-    for (int i = 0; i < job->mutex_count; i++) {
-        pthread_mutex_lock(job->mutex_ptrs[i]);
-        printf("  %s: заблокирован мьютекс %s\n", job->name, job->mutexes[i]);
-    }
-    
-    printf("Запуск задачи: %s (команда: %s)\n", job->name, job->command);
-    
-    //Запускаем команду
-    job->pid = fork();
-    if (job->pid == 0) {
-        //Дочерний процесс
-        execl("/bin/sh", "sh", "-c", job->command, NULL);
-        perror("Ошибка выполнения execl");
-        exit(1); //Если execl не удался
-    } else if (job->pid > 0) {
-        //Родительский процесс
-        int status;
-        waitpid(job->pid, &status, 0);
-        
-        job->status = status;
-        job->completed = true;
-        
-        if (WIFEXITED(status)) {
-            if (WEXITSTATUS(status) == 0) {
-                printf("Задача %s завершена успешно\n", job->name);
-                job->failed = false;
-            } else {
-                printf("Задача %s завершена с ошибкой (код: %d)\n", 
-                       job->name, WEXITSTATUS(status));
-                job->failed = true;
-                
-                //Устанавливаем флаг ошибки DAG
-                pthread_mutex_lock(&dag.running_mutex);
-                dag.dag_failed = true;
-                pthread_mutex_unlock(&dag.running_mutex);
-            }
-        } else {
-            printf("Задача %s завершена с сигналом\n", job->name);
-            job->failed = true;
-            
-            pthread_mutex_lock(&dag.running_mutex);
-            dag.dag_failed = true;
-            pthread_mutex_unlock(&dag.running_mutex);
+    Job* job = shell->job >= 0 ? &dag.jobs[shell->job] : NULL;
+    JobRuntime* run = shell->job >= 0 ? &dag.job_runtime[shell->job] : NULL;
+    int status;
+    if (n > 0) {
+        shell->status_length += n;
+        shell->status[shell->status_length] = '\0';
+        if (!memchr(shell->status, '\n', shell->status_length)) {
+            return;
         }
+        //$? равен 128 + номер сигнала, если команду завершил сигнал
+        int code = atoi(shell->status);
+        status = code > 128 && code - 128 < NSIG ? W_EXITCODE(0, code - 128) : W_EXITCODE(code, 0);
+        shell->status_length = 0;
     } else {
-        perror("Ошибка fork");
-        job->failed = true;
-        
-        pthread_mutex_lock(&dag.running_mutex);
-        dag.dag_failed = true;
-        pthread_mutex_unlock(&dag.running_mutex);
+        //Shell завершился: задачу в нем остановили сигналом или он упал сам.
+        //Остатки группы добиваются, как в reap_job
+        if (run && run->term_sent) {
+            kill(-shell->pid, SIGKILL);
+        }
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, shell->fd, NULL);
+        close(shell->fd);
+        shell->fd = -1;
+        if (waitpid(shell->pid, &status, 0) == -1) {
+            status = W_EXITCODE(1, 0);
+        }
+        shell->pid = 0;
+        shell->status_length = 0;
     }
     
-    //Разблокируем мьютексы
-    for (int i = job->mutex_count - 1; i >= 0; i--) {
-        pthread_mutex_unlock(job->mutex_ptrs[i]);
-        printf("  %s: разблокирован мьютекс %s\n", job->name, job->mutexes[i]);
+    shell->job = -1;
+    if (!job) {
+        return;
+    }
+    run->batched = false;
+    if (dag.trace_file) {
+        run->exited_at = monotonic_seconds();
+    }
+    if (run->timerfd != -1) {
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_DEL, run->timerfd, NULL);
+        close(run->timerfd);
+        run->timerfd = -1;
+    }
+    run->current_run.wall_time = monotonic_seconds() - run->started_at;
+    //rusage общего shell копится за все его задачи, поэтому CPU и память
+    //задачи не измерены и в историю не попадают
+    run->current_run.cpu_time = HISTORY_NOT_MEASURED;
+    run->current_run.max_rss_kb = HISTORY_NOT_MEASURED;
+    complete_job(job, status);
+}
+
+//Остановка общих shell в конце выполнения: конец stdin завершает shell.
+//Задача в shell к этому моменту может остаться только после ошибки epoll
+void close_batch_shells(void) {
+    for (int slot = 0; dag.batch_shells && slot < dag.max_concurrent; slot++) {
+        BatchShell* shell = &dag.batch_shells[slot];
+        if (shell->pid == 0) {
+            continue;
+        }
+        if (shell->job >= 0) {
+            kill(-shell->pid, SIGKILL);
+        }
+        close(shell->fd);
+        waitpid(shell->pid, NULL, 0);
+    }
+    free(dag.batch_shells);
+    dag.batch_shells = NULL;
+    free(dag.batch_script);
+    dag.batch_script = NULL;
+    dag.batch_script_length = dag.batch_script_capacity = 0;
+}
+
+//Сравнение задержек для qsort
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+//Пиковая память исполнителя в МБ
+double peak_rss_mb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+//Статистика планировщика (--stats): загрузка графа, задержка диспетчера
+//и ожидание готовых задач в очереди, время выполнения против нижней границы и память исполнителя.
+//Нижняя граница считается по фактическим длительностям задач из
+//конфигурации: самый длинный путь, вся работа, поделенная на max_concurrent,
+//и работа под каждым мьютексом или ресурсом, поделенная на его емкость
+void print_run_stats(double parse_time, double validate_time, double makespan, int config_jobs) {
+    double* resource_work = calloc(dag.mutex_count > 0 ? dag.mutex_count : 1, sizeof(double));
+    double* waits = malloc((dag.job_count > 0 ? dag.job_count : 1) * sizeof(double));
+    double* latencies = malloc((dag.job_count > 0 ? dag.job_count : 1) * sizeof(double));
+    double* finish = calloc(config_jobs > 0 ? config_jobs : 1, sizeof(double));
+    if (!resource_work || !waits || !latencies || !finish) {
+        free(resource_work);
+        free(waits);
+        free(latencies);
+        free(finish);
+        return;
     }
     
-    //Уменьшаем счетчик выполняющихся задач
-    pthread_mutex_lock(&dag.running_mutex);
-    dag.running_jobs--;
-    printf("  %s: завершена. Осталось запущенных задач: %d\n", 
-           job->name, dag.running_jobs);
-    
-    //Уведомляем ожидающие потоки о завершении задачи
-    for (int i = 0; i < job->next_job_count; i++) {
-        Job* next_job = job->next_jobs[i];
-        next_job->remaining_deps--;
-        
-        printf("  %s: уменьшены зависимости для %s (осталось: %d)\n",
-               job->name, next_job->name, next_job->remaining_deps);
-        
-        if (next_job->remaining_deps == 0) {
-            pthread_cond_signal(&dag.job_completed_cond);
-            printf("  %s: %s теперь готов к запуску\n", 
-                   job->name, next_job->name);
+    //Ожидание в очереди включает нехватку слотов и мьютексов, задержка
+    //диспетчера - только собственное время планировщика
+    int count = 0;
+    for (int i = 0; i < dag.job_count; i++) {
+        const Job* job = &dag.jobs[i];
+        JobRuntime* run = job_runtime(job);
+        if (run->started_at > 0 && run->ready_at > 0 && !run->cached) {
+            waits[count] = run->started_at - run->ready_at;
+            latencies[count++] = run->dispatch_latency;
         }
     }
+    qsort(waits, count, sizeof(double), compare_doubles);
+    qsort(latencies, count, sizeof(double), compare_doubles);
     
-    pthread_cond_signal(&dag.job_completed_cond);
-    pthread_mutex_unlock(&dag.running_mutex);
+    double critical_path = 0, total_work = 0;
+    for (int k = 0; k < config_jobs; k++) {
+        int job_idx = dag.topo_order[k];
+        const Job* job = &dag.jobs[job_idx];
+        JobRuntime* run = job_runtime(job);
+        double start = 0;
+        for (int j = 0; j < job->dependency_count; j++) {
+            int dep = dag.deps[job->dep_start + j];
+            if (finish[dep] > start) start = finish[dep];
+        }
+        double duration = run->cached ? 0 : run->current_run.wall_time;
+        finish[job_idx] = start + duration;
+        total_work += duration;
+        if (finish[job_idx] > critical_path) critical_path = finish[job_idx];
+        for (int j = 0; j < job->mutex_count; j++) {
+            resource_work[dag.job_mutexes[job->mutex_start + j]] +=
+                duration * dag.job_mutex_amounts[job->mutex_start + j];
+        }
+    }
+    double lower_bound = total_work / dag.max_concurrent;
+    if (lower_bound < critical_path) lower_bound = critical_path;
+    for (int i = 0; i < dag.mutex_count; i++) {
+        double bound = resource_work[i] / dag.mutexes[i].capacity;
+        if (lower_bound < bound) lower_bound = bound;
+    }
     
-    return NULL;
+    printf("\nСтатистика планировщика:\n");
+    printf("  Разбор: %.3f с, граф и проверка: %.3f с\n", parse_time, validate_time);
+    if (count > 0) {
+        printf("  Задержка диспетчера, мкс: p50 %.0f, p90 %.0f, p99 %.0f, макс %.0f (задач: %d)\n",
+               latencies[(int)(0.50 * (count - 1))] * 1e6, latencies[(int)(0.90 * (count - 1))] * 1e6,
+               latencies[(int)(0.99 * (count - 1))] * 1e6, latencies[count - 1] * 1e6, count);
+        printf("  Ожидание в очереди, мс: p50 %.1f, p90 %.1f, p99 %.1f, макс %.1f\n",
+               waits[(int)(0.50 * (count - 1))] * 1e3, waits[(int)(0.90 * (count - 1))] * 1e3,
+               waits[(int)(0.99 * (count - 1))] * 1e3, waits[count - 1] * 1e3);
+    }
+    printf("  Время выполнения: %.3f с, нижняя граница: %.3f с (критический путь %.3f с), "
+           "отношение: %.2f\n", makespan, lower_bound, critical_path,
+           lower_bound > 0 ? makespan / lower_bound : 0);
+    printf("  Пиковая память исполнителя: %.1f МБ\n", peak_rss_mb());
+    free(resource_work);
+    free(waits);
+    free(latencies);
+    free(finish);
 }
 
-//Основная функция выполнения DAG
+//Основная функция выполнения DAG.
+//Все дочерние процессы обслуживает один цикл событий: на каждую запущенную
+//задачу приходится pidfd в epoll, а не поток в блокирующем waitpid. Очередь
+//готовых пополняется только внутри цикла (в finish_job), поэтому перед каждым
+//epoll_wait она просто разбирается до исчерпания свободных слотов
 bool execute_dag(void) {
     //Инициализация
-    pthread_mutex_init(&dag.running_mutex, NULL);
-    pthread_cond_init(&dag.job_completed_cond, NULL);
     dag.running_jobs = 0;
+    dag.running_memory_kb = 0;
+    dag.finished_jobs = 0;
+    dag.failed_jobs = 0;
+    dag.cached_jobs = 0;
+    dag.metrics_fd = -1;
+    dag.ready_count = 0;
+    dag.ready_seq = 0;
     dag.dag_failed = false;
+    dag.cancelling = false;
+    dag.cache_thread_started = false;
+    dag.cache_event_fd = -1;
+    atomic_store(&dag.cache_abort, false);
+    for (int i = 0; i < dag.job_count; i++) {
+        JobRuntime* run = &dag.job_runtime[i];
+        run->pidfd = -1;
+        run->timerfd = -1;
+        run->output_fd = -1;
+        run->log_fd = -1;
+        run->emit_fd = -1;
+        run->cgroup_fd = -1;
+        run->slot = -1;
+        run->worker = 0;
+        run->batched = false;
+        run->woken_by = 0;
+        run->cache_pending = false;
+    }
+    
+    //Слоты max_concurrent раздаются из стека: номер слота - дорожка задачи в трассе
+    dag.free_slots = malloc(dag.max_concurrent * sizeof(int));
+    dag.slot_jobs = calloc(dag.max_concurrent, sizeof(long));
+    dag.slot_freed_at = calloc(dag.max_concurrent, sizeof(double));
+    if (!dag.free_slots || !dag.slot_jobs || !dag.slot_freed_at) {
+        perror("Ошибка выделения памяти для слотов");
+        return false;
+    }
+    for (int slot = 0; slot < dag.max_concurrent; slot++) {
+        dag.free_slots[slot] = dag.max_concurrent - 1 - slot;
+    }
+    dag.free_slot_count = dag.max_concurrent;
     
-    pthread_t threads[MAX_JOBS];
-    int thread_count = 0;
-    bool thread_created[MAX_JOBS] = {false};
+    //Общие shell запускаются по первой задаче с batchable: true в слоте
+    dag.batch_shells = calloc(dag.max_concurrent, sizeof(BatchShell));
+    if (!dag.batch_shells) {
+        perror("Ошибка выделения памяти для общих shell");
+        return false;
+    }
+    for (int slot = 0; slot < dag.max_concurrent; slot++) {
+        dag.batch_shells[slot].fd = -1;
+        dag.batch_shells[slot].job = -1;
+    }
     
-    printf("\nНачало выполнения DAG\n");
+    dag.cgroup_fd = -1;
+    if (cgroups_mode) {
+        cgroup_setup();
+    }
     
-    //Начальный запуск задач без зависимостей
-    pthread_mutex_lock(&dag.running_mutex);
+    if (log_dir != NULL && mkdir(log_dir, 0755) == -1 && errno != EEXIST) {
+        perror("Ошибка создания каталога журналов");
+        return false;
+    }
     
-    for (int i = 0; i < dag.job_count; i++) {
-        Job* job = &dag.jobs[i];
-        if (job->remaining_deps == 0 && !job->completed && !thread_created[i]) {
-            //Ждем, если достигнут лимит параллельных задач
-            while (dag.running_jobs >= dag.max_concurrent && !dag.dag_failed) {
-                printf("Достигнут лимит параллельных задач (%d), ожидаем...\n", 
-                       dag.max_concurrent);
-                pthread_cond_wait(&dag.job_completed_cond, &dag.running_mutex);
-            }
-            
-            if (dag.dag_failed) {
-                printf("DAG остановлен из-за ошибки\n");
-                pthread_mutex_unlock(&dag.running_mutex);
-                break;
-            }
-            
-            dag.running_jobs++;
-            thread_created[i] = true;
-            printf("Создаем поток для задачи %s (запущено: %d/%d)\n", 
-                   job->name, dag.running_jobs, dag.max_concurrent);
-            pthread_create(&threads[thread_count++], NULL, execute_job, job);
+    //Промежуточный канал для tee нужен, только когда вывод идет и в журналы,
+    //и в общий поток
+    dag.tee_pipe[0] = dag.tee_pipe[1] = -1;
+    if (log_dir != NULL && prefix_output && pipe2(dag.tee_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("Ошибка создания канала для tee");
+        return false;
+    }
+    
+    dag.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (dag.epoll_fd == -1) {
+        perror("Ошибка создания epoll");
+        return false;
+    }
+    
+    //SIGINT/SIGTERM исполнителю приходят через signalfd и отменяют DAG так же,
+    //как ошибка задачи. Задачи живут в своих группах процессов, поэтому Ctrl+C
+    //в терминале до них напрямую не доходит
+    sigset_t stop_signals, old_mask;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop_signals, &old_mask);
+    dag.signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct epoll_event signal_event = { .events = EPOLLIN, .data.u64 = event_key(EVENT_SIGNAL, 0) };
+    if (dag.signal_fd == -1 ||
+        epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, dag.signal_fd, &signal_event) == -1) {
+        perror("Ошибка создания signalfd");
+    }
+    
+    for (int w = 0; w < dag.worker_count; w++) {
+        struct epoll_event worker_event = { .events = EPOLLIN, .data.u64 = event_key(EVENT_WORKER, w) };
+        if (epoll_ctl(dag.epoll_fd, EPOLL_CTL_ADD, dag.workers[w].fd, &worker_event) == -1) {
+            perror("Ошибка подписки на сообщения воркера");
+            return false;
         }
     }
     
-    pthread_mutex_unlock(&dag.running_mutex);
+    //Задачи запускаются лидерами новых групп и с обычной маской сигналов
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    posix_spawnattr_init(&dag.spawn_attr);
+    posix_spawnattr_setflags(&dag.spawn_attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&dag.spawn_attr, 0);
+    posix_spawnattr_setsigmask(&dag.spawn_attr, &empty_mask);
     
-    //Основной цикл ожидания и запуска новых задач
-    bool active = true;
-    while (active && !dag.dag_failed) {
-        //Проверяем, остались ли задачи для запуска
-        pthread_mutex_lock(&dag.running_mutex);
-        
-        bool new_tasks = false;
-        for (int i = 0; i < dag.job_count; i++) {
-            Job* job = &dag.jobs[i];
-            if (!job->completed && job->remaining_deps == 0 && !thread_created[i]) {
-                new_tasks = true;
-                
-                //Запускаем следующую задачу
-                while (dag.running_jobs >= dag.max_concurrent && !dag.dag_failed) {
-                    pthread_cond_wait(&dag.job_completed_cond, &dag.running_mutex);
-                }
-                
-                if (!dag.dag_failed) {
-                    dag.running_jobs++;
-                    thread_created[i] = true;
-                    printf("Запускаем отложенную задачу %s (запущено: %d/%d)\n", 
-                           job->name, dag.running_jobs, dag.max_concurrent);
-                    pthread_create(&threads[thread_count++], NULL, execute_job, job);
-                }
-            }
+    //Без файла трассы выполнение идет как обычно
+    if (trace_path != NULL && !trace_open(trace_path)) {
+        trace_path = NULL;
+    }
+    if (metrics_path != NULL && !metrics_open(metrics_path)) {
+        metrics_path = NULL;
+    }
+    
+    printf("\nНачало выполнения DAG (порядок запуска: %s)\n",
+           priority_mode ? "по критическому пути" : "как в конфигурации");
+    printf("Цикл событий: до %d задач одновременно\n", dag.max_concurrent);
+    
+    //Стартовые задачи (без зависимостей) сразу попадают в очередь готовых.
+    //validate_dag уже собрал их в начале topo_order
+    if (dag.resumed_jobs > 0) {
+        push_resumed_frontier();
+    } else {
+        for (int k = 0; k < dag.start_job_count; k++) {
+            push_ready_job(dag.topo_order[k]);
         }
-        
-        //Проверяем, все ли задачи завершены
-        bool all_done = true;
-        for (int i = 0; i < dag.job_count; i++) {
-            if (!dag.jobs[i].completed) {
-                all_done = false;
+    }
+    
+    //Выполнение заканчивается, когда ничего не запущено и либо очередь пуста
+    //(все выполнено или граф больше не может продвинуться), либо случилась ошибка
+    struct epoll_event events[EPOLL_BATCH];
+    while (true) {
+        //Запускаем готовые задачи, пока есть свободные слоты. Задачи с занятыми
+        //ресурсами уходят в очереди ожидания, а слот достается следующей
+        while (!dag.dag_failed && dag.running_jobs < dag.max_concurrent) {
+            int job_idx = pick_ready_job();
+            if (job_idx < 0) {
                 break;
             }
+            start_job(job_idx);
+        }
+        
+        //Ошибка одной задачи сразу останавливает все остальные
+        if (dag.dag_failed) {
+            cancel_running_jobs();
         }
         
-        if (all_done || dag.dag_failed || (!new_tasks && dag.running_jobs == 0)) {
-            active = false;
+        if (dag.running_jobs == 0) {
+            break;
         }
         
-        pthread_mutex_unlock(&dag.running_mutex);
+        int timeout = dag.journal_fd != -1 ? journal_sync(false) : -1;
+        int ready = epoll_wait(dag.epoll_fd, events, EPOLL_BATCH, timeout);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Ошибка epoll_wait");
+            dag.dag_failed = true;
+            //Дожидаемся оставшихся процессов без epoll
+            for (int i = 0; i < dag.job_count; i++) {
+                if (dag.job_runtime[i].pidfd != -1) {
+                    reap_job(&dag.jobs[i]);
+                }
+            }
+            break;
+        }
         
-        //Небольшая задержка для уменьшения нагрузки на CPU
-        if (active) {
-            usleep(10000); //10ms
+        for (int i = 0; i < ready; i++) {
+            int kind = events[i].data.u64 >> 32;
+            Job* job = &dag.jobs[(uint32_t)events[i].data.u64];
+            if (kind == EVENT_EXIT) {
+                reap_job(job);
+            } else if (kind == EVENT_TIMER) {
+                on_job_timer(job);
+            } else if (kind == EVENT_OUTPUT) {
+                drain_job_output(job);
+            } else if (kind == EVENT_EMIT) {
+                drain_job_emits(job);
+            } else if (kind == EVENT_METRICS) {
+                serve_metrics();
+            } else if (kind == EVENT_WORKER) {
+                on_worker_message((uint32_t)events[i].data.u64);
+            } else if (kind == EVENT_BATCH) {
+                on_batch_status((uint32_t)events[i].data.u64);
+            } else if (kind == EVENT_CACHE) {
+                on_cache_event();
+            } else {
+                struct signalfd_siginfo info;
+                if (read(dag.signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    printf("Получен сигнал %u, отменяем DAG\n", info.ssi_signo);
+                    dag.dag_failed = true;
+                }
+            }
         }
     }
-    
-    //Ожидаем завершения всех потоков
-    printf("\nОжидаем завершения всех потоков...\n");
-    for (int i = 0; i < thread_count; i++) {
-        pthread_join(threads[i], NULL);
+    if (dag.dag_failed) {
+        printf("DAG остановлен из-за ошибки\n");
     }
     
     //Очистка
-    pthread_mutex_destroy(&dag.running_mutex);
-    pthread_cond_destroy(&dag.job_completed_cond);
+    cache_thread_stop();
+    close_batch_shells();
+    posix_spawnattr_destroy(&dag.spawn_attr);
+    if (dag.tee_pipe[0] != -1) {
+        close(dag.tee_pipe[0]);
+        close(dag.tee_pipe[1]);
+    }
+    if (dag.signal_fd != -1) {
+        close(dag.signal_fd);
+        dag.signal_fd = -1;
+    }
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    close(dag.epoll_fd);
+    dag.epoll_fd = -1;
+    if (dag.metrics_fd != -1) {
+        metrics_close(metrics_path);
+    }
+    free(dag.free_slots);
+    dag.free_slots = NULL;
+    free(dag.slot_jobs);
+    dag.slot_jobs = NULL;
+    free(dag.slot_freed_at);
+    dag.slot_freed_at = NULL;
+    free_wait_lists();
+    if (dag.cgroup_path) {
+        cgroup_teardown();
+    }
+    if (dag.trace_file) {
+        trace_close();
+        printf("Трасса выполнения записана в %s\n", trace_path);
+    }
     
-    //Освобождаем мьютексы
+    //Статистика конкуренции за мьютексы
     for (int i = 0; i < dag.mutex_count; i++) {
-        pthread_mutex_destroy(&dag.mutexes[i].mutex);
+        if (dag.mutexes[i].contended > 0) {
+            printf("Мьютекс %s: задачи откладывались %ld раз\n",
+                   pool_str(dag.mutexes[i].name), dag.mutexes[i].contended);
+        }
     }
     
     //Проверка результатов
@@ -773,7 +6119,7 @@ bool execute_dag(void) {
     //Проверяем, что все задачи завершены
     for (int i = 0; i < dag.job_count; i++) {
         if (!dag.jobs[i].completed) {
-            printf("\nОшибка: задача %s не была выполнена\n", dag.jobs[i].name);
+            printf("\nОшибка: задача %s не была выполнена\n", pool_str(dag.jobs[i].name));
             return false;
         }
     }
@@ -782,40 +6128,288 @@ bool execute_dag(void) {
     return true;
 }
 
+//Освобождение памяти графа
+void free_dag(void) {
+    disconnect_workers();
+    free(dag.journal_path);
+    if (dag.history_fd > 0) {
+        close(dag.history_fd);
+    }
+    free(dag.history_path);
+    free(dag.cache_dir);
+    free(dag.job_runtime);
+    
+    //Массивы графа из снимка лежат в его отображении
+    if (dag.snapshot) {
+        munmap(dag.snapshot, dag.snapshot_size);
+        memset(&dag, 0, sizeof(dag));
+        return;
+    }
+    
+    free(dag.jobs);
+    free(dag.strings.data);
+    free(dag.symtab.symbols);
+    free(dag.symtab.slots);
+    free(dag.dep_symbols);
+    free(dag.deps);
+    free(dag.topo_order);
+    free(dag.levels);
+    free(dag.next_offsets);
+    free(dag.next_jobs);
+    free(dag.job_mutex_symbols);
+    free(dag.exec_args);
+    free(dag.exec_argv);
+    free(dag.job_files);
+    free(dag.job_mutex_amounts);
+    free(dag.job_mutexes);
+    free(dag.mutexes);
+    free(dag.ready_queue);
+    free(dag.deferred_jobs);
+    memset(&dag, 0, sizeof(dag));
+}
+
+//Вывод справки
+void print_usage(const char* program_name) {
+    fprintf(stderr, "Использование: %s [ОПЦИИ] <config.yaml | config.dagbin>\n", program_name);
+    fprintf(stderr, "               %s --compile <config.yaml> -o <config.dagbin>\n", program_name);
+    fprintf(stderr, "Опции:\n");
+    fprintf(stderr, "  --priority   Запускать первыми задачи с самым длинным оставшимся путем\n");
+    fprintf(stderr, "  --simulate   Предсказать время выполнения, не запуская команды\n");
+    fprintf(stderr, "  --report     Сравнить два последних запуска каждой задачи по истории\n");
+    fprintf(stderr, "  --no-history Не читать и не записывать историю запусков\n");
+    fprintf(stderr, "  --fork       Запускать задачи через fork + exec вместо posix_spawn\n");
+    fprintf(stderr, "  --no-cache   Запускать все задачи, даже если их входы не изменились\n");
+    fprintf(stderr, "  --log-dir DIR   Сохранять вывод каждой задачи в DIR/<задача>.log\n");
+    fprintf(stderr, "  --prefix-output Выводить строки задач в общий поток с префиксом [задача]\n");
+    fprintf(stderr, "  --parse-only    Только разобрать конфигурацию и проверить граф, вывести скорость разбора\n");
+    fprintf(stderr, "  --compile -o F  Записать проверенный граф в снимок F, который загружается без разбора\n");
+    fprintf(stderr, "  --trace F       Записать трассу выполнения в F (chrome://tracing, Perfetto)\n");
+    fprintf(stderr, "  --metrics-socket S  Отдавать метрики Prometheus на Unix-сокете S во время выполнения\n");
+    fprintf(stderr, "  --workers A,B,...   Выполнять задачи на воркерах (адрес: путь Unix-сокета или хост:порт)\n");
+    fprintf(stderr, "  --cgroups       Запускать задачи в своих cgroup v2 с лимитами cpu_max и memory_max_mb\n");
+    fprintf(stderr, "  --resume        Продолжить прерванное выполнение по журналу <config>.journal\n");
+    fprintf(stderr, "  --no-journal    Не вести журнал переходов задач\n");
+    fprintf(stderr, "  --stats         Вывести статистику планировщика: задержки запуска, нижняя граница, память\n");
+    fprintf(stderr, "Режим воркера:  %s --worker <адрес> [--capacity N]\n", program_name);
+    fprintf(stderr, "  Воркер выполняет команды любого подключившегося: TCP-адрес без хоста (:порт)\n");
+    fprintf(stderr, "  слушает только 127.0.0.1, открывать воркер в сеть нельзя\n");
+    fprintf(stderr, "Пример: %s config.yaml\n", program_name);
+}
+
 //Основная функция
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Использование: %s <config.yaml>\n", argv[0]);
-        fprintf(stderr, "Пример: %s config.yaml\n", argv[0]);
-        return 1;
+    const char* config_path = NULL;
+    const char* worker_endpoint = NULL;
+    int worker_capacity = DEFAULT_WORKER_CAPACITY;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--priority") == 0) {
+            priority_mode = true;
+        } else if (strcmp(argv[i], "--simulate") == 0) {
+            simulate_mode = true;
+        } else if (strcmp(argv[i], "--report") == 0) {
+            report_mode = true;
+        } else if (strcmp(argv[i], "--no-history") == 0) {
+            history_enabled = false;
+        } else if (strcmp(argv[i], "--fork") == 0) {
+            fork_mode = true;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            cache_enabled = false;
+        } else if (strcmp(argv[i], "--prefix-output") == 0) {
+            prefix_output = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_mode = true;
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            resume_mode = true;
+        } else if (strcmp(argv[i], "--no-journal") == 0) {
+            journal_enabled = false;
+        } else if (strcmp(argv[i], "--cgroups") == 0) {
+            cgroups_mode = true;
+        } else if (strcmp(argv[i], "--parse-only") == 0) {
+            parse_only = true;
+        } else if (strcmp(argv[i], "--log-dir") == 0 && i + 1 < argc) {
+            log_dir = argv[++i];
+        } else if (strcmp(argv[i], "--worker") == 0 && i + 1 < argc) {
+            worker_endpoint = argv[++i];
+        } else if (strcmp(argv[i], "--capacity") == 0 && i + 1 < argc) {
+            worker_capacity = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers_list = argv[++i];
+        } else if (strcmp(argv[i], "--metrics-socket") == 0 && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--compile") == 0) {
+            compile_path = "";
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            compile_path = argv[++i];
+        } else if (argv[i][0] == '-' || config_path != NULL) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            config_path = argv[i];
+        }
+    }
+    
+    //Воркеру конфигурация не нужна: задачи присылает координатор
+    if (worker_endpoint != NULL) {
+        if (worker_capacity <= 0 || config_path != NULL) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return run_worker(worker_endpoint, worker_capacity);
     }
     
-    printf("Загрузка конфигурации из %s...\n", argv[1]);
+    //Вывод задач на воркерах остается у воркеров
+    if (workers_list != NULL && (log_dir != NULL || prefix_output)) {
+        fprintf(stderr, "Ошибка: --log-dir и --prefix-output не поддерживаются с --workers\n");
+        return 1;
+    }
     
-    //
-    if (!parse_yaml_config_simple(argv[1])) {
-        fprintf(stderr, "Ошибка парсинга конфигурации\n");
+    //--compile требует -o: compile_path == "" - путь снимка не указан
+    if (config_path == NULL || (compile_path != NULL && compile_path[0] == '\0')) {
+        print_usage(argv[0]);
         return 1;
     }
     
-    //Построение графа зависимостей
-    if (!build_dependency_graph()) {
-        fprintf(stderr, "Ошибка построения графа зависимостей\n");
+    printf("Загрузка конфигурации из %s...\n", config_path);
+    
+    //Снимок из --compile уже содержит проверенный граф; иначе разбор
+    //конфигурации, построение графа и валидация
+    double parse_start = monotonic_seconds();
+    double parse_time;
+    double validate_time = 0;
+    if (is_snapshot_file(config_path)) {
+        if (!load_snapshot(config_path)) {
+            return 1;
+        }
+        parse_time = monotonic_seconds() - parse_start;
+    } else {
+        if (!parse_yaml_config_simple(config_path)) {
+            fprintf(stderr, "Ошибка парсинга конфигурации\n");
+            return 1;
+        }
+        parse_time = monotonic_seconds() - parse_start;
+        double validate_start = monotonic_seconds();
+        
+        //Построение графа зависимостей
+        if (!build_dependency_graph()) {
+            fprintf(stderr, "Ошибка построения графа зависимостей\n");
+            return 1;
+        }
+        
+        //Валидация DAG
+        if (!validate_dag()) {
+            fprintf(stderr, "DAG некорректен\n");
+            return 1;
+        }
+        validate_time = monotonic_seconds() - validate_start;
+    }
+    
+    if (compile_path != NULL) {
+        bool written = write_snapshot(compile_path);
+        free_dag();
+        return written ? 0 : 1;
+    }
+    
+    //Только разбор: скорость загрузки конфигурации в МБ/с
+    if (parse_only) {
+        struct stat st;
+        double size_mb = stat(config_path, &st) == 0 ? st.st_size / (1024.0 * 1024.0) : 0;
+        printf("\n%s: %.1f МБ, %d задач, %d зависимостей за %.3f с (%.1f МБ/с)\n",
+               dag.snapshot ? "Загрузка снимка" : "Разбор конфигурации", size_mb, dag.job_count, dag.dep_count, parse_time,
+               parse_time > 0 ? size_mb / parse_time : 0);
+        if (stats_mode) {
+            printf("Граф и проверка: %.3f с, пиковая память исполнителя: %.1f МБ\n",
+                   validate_time, peak_rss_mb());
+        }
+        free_dag();
+        return 0;
+    }
+    
+    //История запусков: веса задач для приоритетов и прогноз памяти
+    dag.history_fd = -1;
+    if (history_enabled || report_mode) {
+        if (!load_history(config_path)) {
+            free_dag();
+            return 1;
+        }
+    }
+    
+    if (report_mode) {
+        print_history_report();
+        free_dag();
+        return 0;
+    }
+    
+    //Приоритеты задач по критическому пути
+    compute_priorities();
+    printf("  Критический путь: %.2f с\n", dag.critical_path);
+    
+    //Режим симуляции: только прогноз, команды не запускаются
+    if (simulate_mode) {
+        double total_work = 0;
+        for (int i = 0; i < dag.job_count; i++) {
+            total_work += job_weight(&dag.jobs[i]);
+        }
+        double lower_bound = total_work / dag.max_concurrent;
+        if (lower_bound < dag.critical_path) lower_bound = dag.critical_path;
+        
+        double fifo_makespan = simulate_dag(false);
+        double priority_makespan = simulate_dag(true);
+        
+        printf("\nСимуляция выполнения (max_concurrent: %d):\n", dag.max_concurrent);
+        printf("  Суммарная работа: %.2f с\n", total_work);
+        printf("  Нижняя граница времени выполнения: %.2f с\n", lower_bound);
+        printf("  Прогноз, порядок из конфигурации: %.2f с\n", fifo_makespan);
+        printf("  Прогноз, приоритет по критическому пути: %.2f с\n", priority_makespan);
+        
+        free_dag();
+        return (fifo_makespan < 0 || priority_makespan < 0) ? 1 : 0;
+    }
+    
+    if (history_enabled) {
+        open_history_for_append();
+    }
+    
+    //Кэш результатов задач с inputs:/outputs: лежит рядом с конфигурацией
+    if (cache_enabled) {
+        size_t path_len = strlen(config_path) + strlen(CACHE_SUFFIX) + 1;
+        dag.cache_dir = malloc(path_len);
+        if (dag.cache_dir) {
+            snprintf(dag.cache_dir, path_len, "%s%s", config_path, CACHE_SUFFIX);
+        } else {
+            perror("Кэш задач отключен");
+        }
+    }
+    
+    dag.journal_fd = -1;
+    if ((journal_enabled || resume_mode) && !open_journal(config_path)) {
+        free_dag();
         return 1;
     }
     
-    //Валидация DAG
-    if (!validate_dag()) {
-        fprintf(stderr, "DAG некорректен\n");
+    if (workers_list != NULL && !connect_workers(workers_list)) {
+        free_dag();
         return 1;
     }
     
     //Выполнение DAG
-    if (!execute_dag()) {
+    int config_jobs = dag.job_count;
+    double run_start = monotonic_seconds();
+    bool success = execute_dag();
+    if (stats_mode) {
+        print_run_stats(parse_time, validate_time, monotonic_seconds() - run_start, config_jobs);
+    }
+    if (dag.journal_fd != -1) {
+        close_journal(success);
+    }
+    if (!success) {
         printf("Выполнение DAG завершилось с ошибкой\n");
+        free_dag();
         return 1;
     }
     
+    free_dag();
     printf("\nПрограмма завершена успешно\n");
     return 0;
 }
\ No newline at end of file
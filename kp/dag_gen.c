@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+//Генератор синтетических DAG для бенчмарков dag_executor. Пишет YAML
+//в stdout; одинаковые параметры и --seed дают один и тот же граф
+#define DEFAULT_SEED 1
+#define DEFAULT_CONCURRENT 8
+#define DEFAULT_MUTEXES 4
+#define MAX_LAYER_DEPS 3 //Зависимостей у задачи слоистого DAG на предыдущий слой
+
+//Форма графа
+typedef enum {
+    SHAPE_LAYERED,        //Слои случайной ширины, связи только с предыдущим слоем
+    SHAPE_FANOUT,         //Одна задача -> N параллельных -> одна задача
+    SHAPE_CHAIN,          //Цепочка: каждая задача зависит от предыдущей
+    SHAPE_MUTEX           //Независимые задачи, делящие несколько мьютексов
+} Shape;
+
+static const char* shape_names[] = { "layered", "fanout", "chain", "mutex" };
+
+//Параметры генерации
+static Shape shape;
+static long job_count;
+static double sleep_seconds = 0; //0 - задачи exec: [true], иначе sleep со средним значением
+static uint64_t rng_state = DEFAULT_SEED;
+static int max_concurrent = DEFAULT_CONCURRENT;
+static long layer_width = 0;     //0 - корень из числа задач
+static int mutex_count = DEFAULT_MUTEXES;
+static bool batchable = false;   //batchable: true у всех задач
+
+//Прототипы функций
+uint64_t next_random(void);
+long random_below(long bound);
+void print_job(long index);
+void print_dependency_list(const long* deps, int count);
+void generate_layered(void);
+void generate_fanout(void);
+void generate_chain(void);
+void generate_mutex(void);
+void print_usage(const char* program_name);
+
+//xorshift64*: свой генератор, чтобы граф не зависел от реализации rand()
+uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+//Случайное число в [0, bound)
+long random_below(long bound) {
+    return (long)(next_random() % (uint64_t)bound);
+}
+
+//Начало описания задачи: имя и команда. С --sleep длительность случайна
+//в [0.5, 1.5] от среднего и сразу указывается как estimated_duration.
+//С --batchable задачи задаются через command:, только им нужен /bin/sh
+void print_job(long index) {
+    printf("job%ld:\n", index);
+    if (sleep_seconds > 0) {
+        double duration = sleep_seconds * (0.5 + (next_random() % 1001) / 1000.0);
+        printf(batchable ? "  command: \"sleep %.4f\"\n" : "  exec: [sleep, \"%.4f\"]\n", duration);
+        printf("  estimated_duration: %.4f\n", duration);
+    } else {
+        printf(batchable ? "  command: \"true\"\n" : "  exec: [true]\n");
+    }
+    if (batchable) {
+        printf("  batchable: true\n");
+    }
+}
+
+//dependencies: [jobA, jobB, ...]
+void print_dependency_list(const long* deps, int count) {
+    printf("  dependencies: [");
+    for (int i = 0; i < count; i++) {
+        printf(i ? ", job%ld" : "job%ld", deps[i]);
+    }
+    printf("]\n\n");
+}
+
+//Слоистый DAG: ширина слоя случайна в [width/2, 3*width/2], каждая задача
+//зависит от 1..MAX_LAYER_DEPS случайных задач предыдущего слоя
+void generate_layered(void) {
+    long width = layer_width > 0 ? layer_width : (long)sqrt((double)job_count);
+    if (width < 1) width = 1;
+    long prev_start = 0, prev_count = 0;
+    long index = 1;
+    while (index <= job_count) {
+        long count = width / 2 + random_below(width + 1);
+        if (count < 1) count = 1;
+        if (index + count - 1 > job_count) count = job_count - index + 1;
+
+        for (long i = 0; i < count; i++, index++) {
+            long deps[MAX_LAYER_DEPS];
+            int dep_count = 0;
+            int wanted = prev_count > 0 ? 1 + (int)random_below(MAX_LAYER_DEPS) : 0;
+            while (dep_count < wanted) {
+                long dep = prev_start + random_below(prev_count);
+                bool duplicate = false;
+                for (int d = 0; d < dep_count; d++) {
+                    duplicate |= deps[d] == dep;
+                }
+                if (duplicate && prev_count <= MAX_LAYER_DEPS) {
+                    break; //Маленький слой: все различные зависимости уже взяты
+                }
+                if (!duplicate) {
+                    deps[dep_count++] = dep;
+                }
+            }
+            print_job(index);
+            print_dependency_list(deps, dep_count);
+        }
+        prev_start = index - count;
+        prev_count = count;
+    }
+}
+
+//Широкий веер: job1 -> job2..job(N-1) -> jobN
+void generate_fanout(void) {
+    long first = 1;
+    print_job(first);
+    print_dependency_list(NULL, 0);
+    for (long index = 2; index < job_count; index++) {
+        print_job(index);
+        print_dependency_list(&first, 1);
+    }
+    if (job_count > 1) {
+        print_job(job_count);
+        printf("  dependencies: [");
+        for (long dep = 2; dep < job_count; dep++) {
+            printf(dep > 2 ? ", job%ld" : "job%ld", dep);
+        }
+        if (job_count == 2) {
+            printf("job1");
+        }
+        printf("]\n\n");
+    }
+}
+
+//Длинная цепочка
+void generate_chain(void) {
+    for (long index = 1; index <= job_count; index++) {
+        long prev = index - 1;
+        print_job(index);
+        print_dependency_list(&prev, index > 1 ? 1 : 0);
+    }
+}
+
+//Конкуренция за мьютексы: все задачи готовы сразу, каждая держит один из
+//mutex_count мьютексов, поэтому одновременно выполняется не больше mutex_count
+void generate_mutex(void) {
+    for (long index = 1; index <= job_count; index++) {
+        print_job(index);
+        printf("  mutexes: [lock%ld]\n", random_below(mutex_count) + 1);
+        print_dependency_list(NULL, 0);
+    }
+}
+
+//Вывод справки
+void print_usage(const char* program_name) {
+    fprintf(stderr, "Использование: %s <layered|fanout|chain|mutex> <число_задач> [ОПЦИИ]\n", program_name);
+    fprintf(stderr, "Опции:\n");
+    fprintf(stderr, "  --sleep S       Задачи спят в среднем S секунд (по умолчанию exec: [true])\n");
+    fprintf(stderr, "  --seed N        Начальное значение генератора (по умолчанию %d)\n", DEFAULT_SEED);
+    fprintf(stderr, "  --concurrent N  max_concurrent графа (по умолчанию %d)\n", DEFAULT_CONCURRENT);
+    fprintf(stderr, "  --width N       Средняя ширина слоя для layered (по умолчанию корень из числа задач)\n");
+    fprintf(stderr, "  --mutexes N     Число мьютексов для mutex (по умолчанию %d)\n", DEFAULT_MUTEXES);
+    fprintf(stderr, "  --batchable     Задачи command: с batchable: true (общий shell слота)\n");
+    fprintf(stderr, "Пример: %s layered 100000 --sleep 0.01 > dag.yaml\n", program_name);
+}
+
+//Основная функция
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    int shape_count = sizeof(shape_names) / sizeof(shape_names[0]);
+    int found = -1;
+    for (int i = 0; i < shape_count; i++) {
+        if (strcmp(argv[1], shape_names[i]) == 0) {
+            found = i;
+        }
+    }
+    job_count = atol(argv[2]);
+    if (found < 0 || job_count <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    shape = (Shape)found;
+
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--sleep") == 0 && i + 1 < argc) {
+            sleep_seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            rng_state = strtoull(argv[++i], NULL, 10);
+            if (rng_state == 0) rng_state = DEFAULT_SEED; //xorshift не выходит из нуля
+        } else if (strcmp(argv[i], "--concurrent") == 0 && i + 1 < argc) {
+            max_concurrent = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            layer_width = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--mutexes") == 0 && i + 1 < argc) {
+            mutex_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batchable") == 0) {
+            batchable = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (max_concurrent <= 0 || mutex_count <= 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    printf("# dag_gen %s %ld, seed %llu\n", shape_names[shape], job_count,
+           (unsigned long long)rng_state);
+    printf("max_concurrent: %d\n\n", max_concurrent);
+    if (shape == SHAPE_MUTEX) {
+        printf("mutexes:\n");
+        for (int m = 1; m <= mutex_count; m++) {
+            printf("  - lock%d\n", m);
+        }
+        printf("\n");
+    }
+
+    switch (shape) {
+        case SHAPE_LAYERED: generate_layered(); break;
+        case SHAPE_FANOUT:  generate_fanout(); break;
+        case SHAPE_CHAIN:   generate_chain(); break;
+        case SHAPE_MUTEX:   generate_mutex(); break;
+    }
+    return 0;
+}
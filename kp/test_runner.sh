@@ -0,0 +1,706 @@
+#!/bin/bash
+# test_runner.sh
+# Тесты исполнителя DAG. Тесты ресурсов: каждая задача пишет в общий журнал
+# моменты старта и завершения и сколько единиц ресурса она держит, после чего
+# журнал проверяется на превышение емкости и на упаковку задач. Тесты отмены
+# проверяют время работы исполнителя и оставшиеся процессы.
+
+EXECUTOR=${EXECUTOR:-./dag_executor}
+GEN=${GEN:-./dag_gen}
+DIR=$(mktemp -d /tmp/dag_tests_XXXXXX)
+FAILED=0
+
+trap 'rm -rf "$DIR"' EXIT
+
+echo "Запуск тестов"
+
+#Команда задачи: отметки S/E с временем в наносекундах
+job_command() {
+    local name=$1 resource=$2 amount=$3 duration=$4
+    echo "echo S $name $resource $amount \$(date +%s%N) >> $DIR/trace.log && sleep $duration && echo E $name $resource $amount \$(date +%s%N) >> $DIR/trace.log"
+}
+
+#Пиковая занятость ресурса по журналу
+peak_usage() {
+    sort -k5,5n "$DIR/trace.log" | awk -v res="$1" '
+        $3 == res { used += ($1 == "S") ? $4 : -$4; if (used > peak) peak = used }
+        END { print peak + 0 }'
+}
+
+#Пересекались ли по времени две задачи
+overlapped() {
+    awk -v a="$1" -v b="$2" '
+        $1 == "S" { start[$2] = $5 } $1 == "E" { finish[$2] = $5 }
+        END { exit !(start[a] < finish[b] && start[b] < finish[a]) }' "$DIR/trace.log"
+}
+
+check() {
+    if eval "$2"; then
+        echo "  OK: $1"
+    else
+        echo "  ОШИБКА: $1"
+        FAILED=1
+    fi
+}
+
+# Тест 1: Упаковка задач по весу
+echo -e "\nТест 1: Упаковка задач в ресурс емкостью 64"
+rm -f "$DIR/trace.log"
+cat > "$DIR/packing.yaml" << EOF
+max_concurrent: 4
+
+resources:
+  ram_gb: 64
+
+job_big:
+  command: "$(job_command job_big ram_gb 48 0.4)"
+  dependencies: []
+  resources: {ram_gb: 48}
+
+job_small1:
+  command: "$(job_command job_small1 ram_gb 16 0.4)"
+  dependencies: []
+  resources: {ram_gb: 16}
+
+job_small2:
+  command: "$(job_command job_small2 ram_gb 16 0.4)"
+  dependencies: []
+  resources: {ram_gb: 16}
+
+job_mid:
+  command: "$(job_command job_mid ram_gb 32 0.4)"
+  dependencies: []
+  resources: {ram_gb: 32}
+EOF
+"$EXECUTOR" --no-history "$DIR/packing.yaml" > "$DIR/out.log"
+check "выполнение завершилось успешно" "[ $? -eq 0 ]"
+check "занятость не превышает 64 (пик: $(peak_usage ram_gb))" "[ $(peak_usage ram_gb) -le 64 ]"
+check "ресурс заполнен полностью" "[ $(peak_usage ram_gb) -eq 64 ]"
+check "задача на 48 выполняется вместе с задачей на 16" "overlapped job_big job_small1"
+check "задачи на 16 и 32 выполняются вместе" "overlapped job_small2 job_mid"
+
+# Тест 2: Обычный мьютекс - ресурс емкостью 1
+echo -e "\nТест 2: Мьютекс не захватывается дважды"
+rm -f "$DIR/trace.log"
+cat > "$DIR/mutex.yaml" << EOF
+max_concurrent: 3
+
+mutexes:
+  - db_access
+
+job_a:
+  command: "$(job_command job_a db_access 1 0.3)"
+  dependencies: []
+  mutexes: [db_access]
+
+job_b:
+  command: "$(job_command job_b db_access 1 0.3)"
+  dependencies: []
+  mutexes: [db_access]
+
+job_c:
+  command: "$(job_command job_c db_access 1 0.3)"
+  dependencies: []
+  resources: {db_access: 1}
+EOF
+"$EXECUTOR" --no-history "$DIR/mutex.yaml" > "$DIR/out.log"
+check "выполнение завершилось успешно" "[ $? -eq 0 ]"
+check "мьютекс держит одна задача (пик: $(peak_usage db_access))" "[ $(peak_usage db_access) -eq 1 ]"
+
+# Тест 3: Повторный ресурс в задаче складывается
+echo -e "\nТест 3: Повторы ресурса в задаче суммируются"
+rm -f "$DIR/trace.log"
+cat > "$DIR/sum.yaml" << EOF
+max_concurrent: 2
+
+resources:
+  db_connections: 4
+
+job_x:
+  command: "$(job_command job_x db_connections 4 0.3)"
+  dependencies: []
+  resources: {db_connections: 2, db_connections: 2}
+
+job_y:
+  command: "$(job_command job_y db_connections 1 0.3)"
+  dependencies: []
+  resources: {db_connections: 1}
+EOF
+"$EXECUTOR" --no-history "$DIR/sum.yaml" > "$DIR/out.log"
+check "выполнение завершилось успешно" "[ $? -eq 0 ]"
+check "задачи не выполняются одновременно" "! overlapped job_x job_y"
+
+# Тест 4: Запрос больше емкости отклоняется
+echo -e "\nТест 4: Запрос больше емкости ресурса"
+cat > "$DIR/over.yaml" << EOF
+resources:
+  gpu: 2
+
+job_train:
+  command: "true"
+  dependencies: []
+  resources: {gpu: 3}
+EOF
+"$EXECUTOR" --no-history "$DIR/over.yaml" > "$DIR/out.log" 2> "$DIR/err.log"
+check "конфигурация отклонена" "[ $? -ne 0 ]"
+check "в ошибке указан ресурс" "grep -q gpu '$DIR/err.log'"
+
+# Тест 5: Ресурс без емкости
+echo -e "\nТест 5: Ресурс без объявления"
+cat > "$DIR/undeclared.yaml" << EOF
+job_train:
+  command: "true"
+  dependencies: []
+  resources: {gpu: 1}
+EOF
+"$EXECUTOR" --no-history "$DIR/undeclared.yaml" > "$DIR/out.log" 2>&1
+check "конфигурация отклонена" "[ $? -ne 0 ]"
+cat > "$DIR/typo.yaml" << EOF
+job_a:
+  command: "true"
+  dependencies: []
+
+job_b:
+  command: "true"
+  dependecies: [job_a]
+EOF
+"$EXECUTOR" --no-history "$DIR/typo.yaml" > "$DIR/out.log" 2>&1
+check "опечатка в ключе задачи - ошибка разбора" \
+    "[ $? -ne 0 ] && grep -q 'typo.yaml:7: неизвестный ключ задачи job_b: dependecies' '$DIR/out.log'"
+
+#Время работы исполнителя в миллисекундах, код возврата - в $DIR/rc
+timed_run() {
+    local start end
+    start=$(date +%s%N)
+    "$EXECUTOR" --no-history "$@" > "$DIR/out.log" 2>&1
+    echo $? > "$DIR/rc"
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+# Тест 6: Ошибка задачи останавливает остальные
+echo -e "\nТест 6: Отмена запущенных задач после ошибки"
+cat > "$DIR/failfast.yaml" << EOF
+max_concurrent: 4
+
+job_fail:
+  command: "sleep 0.2; exit 3"
+  dependencies: []
+
+job_long:
+  command: "sleep 41.1 & sleep 41.2; wait"
+  dependencies: []
+
+job_stubborn:
+  command: "trap '' TERM; sleep 41.3"
+  dependencies: []
+
+job_after:
+  command: "touch $DIR/after_ran"
+  dependencies: [job_long]
+EOF
+elapsed=$(timed_run "$DIR/failfast.yaml")
+check "DAG завершился с ошибкой" "[ $(cat "$DIR/rc") -ne 0 ]"
+check "исполнитель не ждал задачи по 41 с (${elapsed} мс)" "[ $elapsed -lt 5000 ]"
+check "не осталось процессов отмененных задач" "! pgrep -f '^sleep 41\.' > /dev/null"
+check "зависимая задача не запускалась" "[ ! -e '$DIR/after_ran' ]"
+check "упрямая задача получила SIGKILL" "grep -q 'завершена с сигналом 9' '$DIR/out.log'"
+
+# Тест 7: Тайм-аут задачи
+echo -e "\nТест 7: Тайм-аут задачи"
+cat > "$DIR/timeout.yaml" << EOF
+job_slow:
+  command: "sleep 42"
+  timeout: 0.3
+  dependencies: []
+
+job_fast:
+  command: "sleep 0.1"
+  timeout: 5
+  dependencies: []
+EOF
+elapsed=$(timed_run "$DIR/timeout.yaml")
+check "DAG завершился с ошибкой" "[ $(cat "$DIR/rc") -ne 0 ]"
+check "задача остановлена по тайм-ауту (${elapsed} мс)" "[ $elapsed -lt 2000 ]"
+check "тайм-аут указан в выводе" "grep -q 'превысила тайм-аут' '$DIR/out.log'"
+check "задача с запасом по времени завершилась успешно" "grep -q 'job_fast завершена успешно' '$DIR/out.log'"
+
+# Тест 8: SIGINT исполнителю отменяет DAG
+echo -e "\nТест 8: Прерывание исполнителя"
+cat > "$DIR/interrupt.yaml" << EOF
+job_sleep:
+  command: "sleep 43"
+  dependencies: []
+EOF
+"$EXECUTOR" --no-history "$DIR/interrupt.yaml" > "$DIR/out.log" 2>&1 &
+pid=$!
+sleep 0.3
+kill -INT $pid
+wait $pid
+check "DAG завершился с ошибкой" "[ $? -ne 0 ]"
+check "не осталось процессов задачи" "! pgrep -f '^sleep 43' > /dev/null"
+
+# Тест 9: Журналы задач и общий поток с префиксами
+echo -e "\nТест 9: Перехват вывода задач"
+cat > "$DIR/output.yaml" << EOF
+max_concurrent: 3
+
+job_a:
+  command: "for i in \$(seq 1 500); do echo a-out-\$i; echo a-err-\$i >&2; done"
+  dependencies: []
+
+job_b:
+  command: "for i in \$(seq 1 500); do echo b-out-\$i; done; printf tail"
+  dependencies: []
+
+job_big:
+  command: "seq 1 200000"
+  dependencies: []
+EOF
+"$EXECUTOR" --no-history --log-dir "$DIR/logs" --prefix-output "$DIR/output.yaml" > "$DIR/out.log" 2>&1
+check "выполнение завершилось успешно" "[ $? -eq 0 ]"
+check "в журнале job_a stdout и stderr" "[ \$(grep -c '^a-' '$DIR/logs/job_a.log') -eq 1000 ]"
+check "в журнале job_b только ее строки" "[ \$(grep -vc '^b-out-' '$DIR/logs/job_b.log') -eq 1 ]"
+check "большой вывод сохранен без потерь" "seq 1 200000 | cmp -s - '$DIR/logs/job_big.log'"
+check "строки задач в общем потоке не перемешаны" \
+      "[ \$(grep -c '^\[job_a\] a-\(out\|err\)-[0-9]*$' '$DIR/out.log') -eq 1000 ]"
+check "большой вывод в общем потоке цел" \
+      "grep '^\[job_big\] ' '$DIR/out.log' | cut -c11- | cmp -s - <(seq 1 200000)"
+check "строка без перевода строки выведена" "grep -q '^\[job_b\] tail$' '$DIR/out.log'"
+cat > "$DIR/escape.yaml" << EOF
+../escaped:
+  command: "echo escaped"
+  dependencies: []
+EOF
+mkdir -p "$DIR/escape/logs"
+"$EXECUTOR" --no-history --log-dir "$DIR/escape/logs" "$DIR/escape.yaml" > "$DIR/out.log" 2>&1
+check "журнал задачи с / в имени остается в --log-dir" \
+      "[ ! -e '$DIR/escape/escaped.log' ] && grep -q '^escaped$' '$DIR/escape/logs/%2e.%2fescaped.log'"
+
+# Тест 10: Кэш задач по входам и выходам
+echo -e "\nТест 10: Повторный запуск с кэшем"
+echo "1 2 3" > "$DIR/input.txt"
+cat > "$DIR/cached.yaml" << EOF
+job_prep:
+  command: "tr ' ' '\n' < $DIR/input.txt > $DIR/numbers.txt; echo prep >> $DIR/runs.log"
+  inputs: [$DIR/input.txt]
+  outputs: [$DIR/numbers.txt]
+  dependencies: []
+
+job_sum:
+  command: "awk '{s+=\$1} END {print s}' $DIR/numbers.txt > $DIR/sum.txt; echo sum >> $DIR/runs.log"
+  inputs: [$DIR/numbers.txt]
+  outputs: [$DIR/sum.txt]
+  dependencies: [job_prep]
+
+job_report:
+  command: "echo report >> $DIR/runs.log"
+  dependencies: [job_sum]
+EOF
+runs() { grep -c "^$1$" "$DIR/runs.log"; }
+"$EXECUTOR" --no-history "$DIR/cached.yaml" > "$DIR/out.log" 2>&1
+"$EXECUTOR" --no-history "$DIR/cached.yaml" > "$DIR/out.log" 2>&1
+check "повторный запуск успешен" "[ $? -eq 0 ]"
+check "задачи с неизменными входами пропущены" "[ $(runs prep) -eq 1 ] && [ $(runs sum) -eq 1 ]"
+check "задача без inputs/outputs запускается всегда" "[ $(runs report) -eq 2 ]"
+echo "1 2 4" > "$DIR/input.txt"
+"$EXECUTOR" --no-history "$DIR/cached.yaml" > "$DIR/out.log" 2>&1
+check "изменение входа перезапускает цепочку" "[ $(runs prep) -eq 2 ] && [ $(runs sum) -eq 2 ]"
+check "результат пересчитан" "[ \$(cat '$DIR/sum.txt') -eq 7 ]"
+rm "$DIR/sum.txt"
+"$EXECUTOR" --no-history "$DIR/cached.yaml" > "$DIR/out.log" 2>&1
+check "удаленный выход восстанавливается только своей задачей" "[ $(runs prep) -eq 2 ] && [ $(runs sum) -eq 3 ]"
+"$EXECUTOR" --no-history --no-cache "$DIR/cached.yaml" > "$DIR/out.log" 2>&1
+check "--no-cache запускает все задачи" "[ $(runs prep) -eq 3 ] && [ $(runs sum) -eq 4 ]"
+check "без inputs/outputs каталог кэша не создается" "[ ! -e '$DIR/mutex.yaml.cache' ]"
+truncate -s 2G "$DIR/big_input.bin"
+cat > "$DIR/big_input.yaml" << EOF
+max_concurrent: 2
+
+job_big:
+  command: "true"
+  inputs: [$DIR/big_input.bin]
+  dependencies: []
+
+job_quick:
+  command: "date +%s%N > $DIR/quick.txt"
+  dependencies: []
+EOF
+start=$(date +%s%N)
+"$EXECUTOR" --no-history "$DIR/big_input.yaml" > "$DIR/out.log" 2>&1
+check "хеширование большого входа не задерживает другие задачи" \
+    "[ $? -eq 0 ] && [ \$(( (\$(cat '$DIR/quick.txt') - $start) / 1000000 )) -lt 500 ]"
+rm -f "$DIR/big_input.bin"
+
+# Тест 11: Разбор конфигурации: CRLF, комментарии, кавычки, длинные строки
+echo -e "\nТест 11: Разбор конфигурации"
+LONG_ARG=$(printf 'x%.0s' {1..5000})
+cat > "$DIR/syntax.yaml" << EOF
+# Комментарий в начале файла
+max_concurrent: 2   # и после значения
+
+prepare:
+  command: "echo '#1 \"quoted\"' > $DIR/hash.txt"  # '#' внутри кавычек - не комментарий
+  dependencies: []
+
+long_line:
+  command: "echo $LONG_ARG > $DIR/long.txt"
+  dependencies: ["prepare"]
+
+argv:
+  exec: [/bin/sh, -c, 'echo "it''s, fine" > $DIR/argv.txt']
+  dependencies: [prepare, long_line]
+EOF
+sed -i 's/$/\r/' "$DIR/syntax.yaml"
+"$EXECUTOR" --no-history "$DIR/syntax.yaml" > "$DIR/out.log" 2>&1
+check "конфигурация с CRLF выполнена" "[ $? -eq 0 ]"
+check "'#' в кавычках сохранен, \\\" раскрыт" "[ \"\$(cat '$DIR/hash.txt')\" = '#1 \"quoted\"' ]"
+check "длинная команда не обрезана" "[ \$(tr -d '\n' < '$DIR/long.txt' | wc -c) -eq 5000 ]"
+check "'' в одинарных кавычках и запятая внутри аргумента" "[ \"\$(cat '$DIR/argv.txt')\" = \"it's, fine\" ]"
+printf 'job_a:\n  command: true\n  dependencies: job_b\n' > "$DIR/broken.yaml"
+"$EXECUTOR" --parse-only "$DIR/broken.yaml" > /dev/null 2>&1
+check "список без скобок отклонен" "[ $? -ne 0 ]"
+"$EXECUTOR" --parse-only "$DIR/syntax.yaml" > "$DIR/out.log" 2>&1
+check "--parse-only выводит скорость разбора" "grep -q 'МБ/с' '$DIR/out.log'"
+
+# Тест 12: Скомпилированный снимок DAG
+echo -e "\nТест 12: Запуск из снимка .dagbin"
+rm -f "$DIR/trace.log" "$DIR/argv.txt"
+"$EXECUTOR" --compile "$DIR/mutex.yaml" -o "$DIR/mutex.dagbin" > "$DIR/out.log" 2>&1
+check "снимок записан" "[ $? -eq 0 ] && [ -s '$DIR/mutex.dagbin' ]"
+"$EXECUTOR" --no-history "$DIR/mutex.dagbin" > "$DIR/out.log" 2>&1
+check "DAG из снимка выполнен" "[ $? -eq 0 ] && grep -q 'Загружен снимок DAG' '$DIR/out.log'"
+check "мьютекс из снимка держит одна задача (пик: $(peak_usage db_access))" "[ $(peak_usage db_access) -eq 1 ]"
+"$EXECUTOR" --compile "$DIR/syntax.yaml" -o "$DIR/syntax.dagbin" > /dev/null 2>&1
+"$EXECUTOR" --no-history "$DIR/syntax.dagbin" > "$DIR/out.log" 2>&1
+check "argv exec: восстановлен из снимка" "[ \"\$(cat '$DIR/argv.txt')\" = \"it's, fine\" ]"
+#Первый мьютекс задачи (раздел SNAPSHOT_JOB_MUTEXES, смещение - в заголовке по адресу 208)
+#указывает за пределы массива мьютексов
+cp "$DIR/mutex.dagbin" "$DIR/corrupt.dagbin"
+offset=$(od -An -t u8 -j 208 -N 8 "$DIR/corrupt.dagbin" | tr -d ' ')
+printf '\xff\xff\xff\x7f' | dd of="$DIR/corrupt.dagbin" bs=1 seek="$offset" conv=notrunc status=none
+"$EXECUTOR" --no-history "$DIR/corrupt.dagbin" > /dev/null 2> "$DIR/err.log"
+check "снимок с индексом вне массива отклонен" "[ $? -ne 0 ] && grep -q 'индексы за пределами' '$DIR/err.log'"
+#Число стартовых задач (start_job_count, смещение 64 в заголовке) больше числа задач
+cp "$DIR/mutex.dagbin" "$DIR/corrupt.dagbin"
+printf '\x00\xe1\xf5\x05' | dd of="$DIR/corrupt.dagbin" bs=1 seek=64 conv=notrunc status=none
+"$EXECUTOR" --no-history "$DIR/corrupt.dagbin" > /dev/null 2> "$DIR/err.log"
+check "снимок с неверным числом стартовых задач отклонен" "[ $? -ne 0 ] && grep -q 'поврежден' '$DIR/err.log'"
+printf 'DAGB\x63\x00\x00\x00' | dd of="$DIR/mutex.dagbin" conv=notrunc status=none
+"$EXECUTOR" --no-history "$DIR/mutex.dagbin" > /dev/null 2> "$DIR/err.log"
+check "снимок другой версии отклонен" "[ $? -ne 0 ] && grep -q 'пересоберите' '$DIR/err.log'"
+"$EXECUTOR" --compile "$DIR/mutex.yaml" > /dev/null 2>&1
+check "--compile без -o отклонен" "[ $? -ne 0 ]"
+
+# Тест 13: Задача добавляет новые задачи через fd 3
+echo -e "\nТест 13: Динамические задачи"
+rm -f "$DIR/order.log"
+cat > "$DIR/fanout.yaml" << EOF
+max_concurrent: 4
+
+resources:
+  db: 2
+
+job_split:
+  command: "for i in 1 2 3 4 5; do printf 'shard%s:\\\\n  command: \"sleep 0.2; echo shard >> $DIR/order.log\"\\\\n  resources: {db: 1}\\\\n' \$i >&3; done; printf 'merge:\\\\n  command: \"echo merge >> $DIR/order.log\"\\\\n  dependencies: [shard1, shard2, shard3, shard4, shard5]\\\\n' >&3"
+  emits: true
+  dependencies: []
+
+job_report:
+  command: "echo report >> $DIR/order.log"
+  dependencies: [job_split]
+EOF
+elapsed=$(timed_run "$DIR/fanout.yaml")
+check "DAG с динамическими задачами выполнен" "[ $(cat "$DIR/rc") -eq 0 ]"
+check "выполнены все 5 новых задач" "[ \$(grep -c '^shard$' '$DIR/order.log') -eq 5 ]"
+check "зависимость между новыми задачами соблюдена" "[ \"\$(sed -n 6p '$DIR/order.log')\" = merge ]"
+check "последователь родителя ждал все новые задачи" "[ \"\$(tail -n 1 '$DIR/order.log')\" = report ]"
+check "ресурс db ограничил новые задачи (${elapsed} мс)" "[ $elapsed -ge 600 ]"
+cat > "$DIR/fanout_cycle.yaml" << EOF
+job_split:
+  command: "printf 'a:\\\\n  command: true\\\\n  dependencies: [b]\\\\nb:\\\\n  command: true\\\\n  dependencies: [a]\\\\n' >&3"
+  emits: true
+EOF
+"$EXECUTOR" --no-history "$DIR/fanout_cycle.yaml" > /dev/null 2> "$DIR/err.log"
+check "цикл среди новых задач отклонен" "[ $? -ne 0 ] && grep -q 'цикл' '$DIR/err.log'"
+
+# Тест 14: Трасса выполнения в формате Chrome trace
+echo -e "\nТест 14: Трасса --trace"
+rm -f "$DIR/trace.log"
+"$EXECUTOR" --no-history --trace "$DIR/trace.json" "$DIR/mutex.yaml" > /dev/null
+check "DAG с трассой выполнен" "[ $? -eq 0 ] && [ -s '$DIR/trace.json' ]"
+if command -v python3 > /dev/null; then
+    check "трасса - корректный JSON" "python3 -m json.tool '$DIR/trace.json' > /dev/null"
+fi
+check "у каждой задачи отрезки выполнения и сбора" "[ \$(grep -c '\"cat\":\"running\"' '$DIR/trace.json') -eq 3 ] && [ \$(grep -c '\"cat\":\"reap\"' '$DIR/trace.json') -eq 3 ]"
+check "ожидание мьютекса видно в трассе" "[ \$(grep -c '\"ph\":\"b\",.*\"cat\":\"waiting\"' '$DIR/trace.json') -eq 2 ]"
+check "дорожки названы по слотам" "[ \$(grep -c 'thread_name' '$DIR/trace.json') -eq 3 ]"
+
+# Тест 15: Метрики на Unix-сокете во время выполнения
+echo -e "\nТест 15: Метрики --metrics-socket"
+if command -v python3 > /dev/null; then
+    rm -f "$DIR/trace.log"
+    #Задачи длиннее, чем в mutex.yaml: снимок метрик не должен попасть на смену задач
+    sed 's/sleep 0\.3/sleep 1/' "$DIR/mutex.yaml" > "$DIR/metrics.yaml"
+    "$EXECUTOR" --no-history --metrics-socket "$DIR/metrics.sock" "$DIR/metrics.yaml" > /dev/null &
+    EXECUTOR_PID=$!
+    sleep 0.3
+    python3 -c "
+import socket, sys
+client = socket.socket(socket.AF_UNIX)
+client.connect(sys.argv[1])
+data = b''
+while chunk := client.recv(4096):
+    data += chunk
+sys.stdout.write(data.decode())" "$DIR/metrics.sock" > "$DIR/metrics.txt" 2>&1
+    #Клиенты, отключившиеся до ответа, не должны останавливать исполнитель
+    python3 -c "
+import socket, sys
+for _ in range(20):
+    client = socket.socket(socket.AF_UNIX)
+    client.connect(sys.argv[1])
+    client.close()" "$DIR/metrics.sock" 2>/dev/null
+    wait $EXECUTOR_PID
+    check "DAG с метриками выполнен" "[ $? -eq 0 ]"
+    check "одна задача выполняется" "grep -q '^dag_jobs{state=\"running\"} 1$' '$DIR/metrics.txt'"
+    check "две задачи ждут мьютекс" "grep -q '^dag_jobs{state=\"blocked\"} 2$' '$DIR/metrics.txt'"
+    check "отложенные из-за мьютекса задачи посчитаны" "grep -q '^dag_resource_deferred_jobs_total{resource=\"db_access\"} [1-9]' '$DIR/metrics.txt'"
+    check "время ожидания мьютекса посчитано" "grep -q '^dag_resource_blocked_seconds_total{resource=\"db_access\"} [0-9.]*[1-9]' '$DIR/metrics.txt'"
+    check "гистограмма ожидания в очереди" "grep -q '^dag_queue_wait_seconds_count 1$' '$DIR/metrics.txt'"
+    check "сокет удален после выполнения" "[ ! -e '$DIR/metrics.sock' ]"
+else
+    echo "  Пропущен: нет python3 для чтения сокета"
+fi
+
+# Тест 16: Координатор и воркеры на Unix- и TCP-сокетах
+echo -e "\nТест 16: Выполнение на воркерах"
+rm -f "$DIR/trace.log"
+PORT=$(( 20000 + RANDOM % 20000 ))
+"$EXECUTOR" --worker "$DIR/worker.sock" --capacity 2 > "$DIR/worker1.log" 2>&1 &
+WORKER1=$!
+"$EXECUTOR" --worker "127.0.0.1:$PORT" --capacity 2 > "$DIR/worker2.log" 2>&1 &
+WORKER2=$!
+cat > "$DIR/workers.yaml" << EOF
+max_concurrent: 1
+
+mutexes:
+  - db_access
+
+job_a:
+  command: "$(job_command job_a none 0 0.4)"
+  dependencies: []
+
+job_b:
+  command: "$(job_command job_b none 0 0.4)"
+  dependencies: []
+
+job_c:
+  command: "$(job_command job_c db_access 1 0.4)"
+  dependencies: []
+  mutexes: [db_access]
+
+job_d:
+  command: "$(job_command job_d db_access 1 0.4)"
+  dependencies: []
+  mutexes: [db_access]
+EOF
+elapsed=$(timed_run --workers "$DIR/worker.sock,127.0.0.1:$PORT" "$DIR/workers.yaml")
+check "DAG выполнен на воркерах" "[ $(cat "$DIR/rc") -eq 0 ]"
+check "задачи шли параллельно сверх max_concurrent (${elapsed} мс)" "[ $elapsed -lt 1200 ] && overlapped job_a job_b"
+check "мьютекс общий для воркеров (пик: $(peak_usage db_access))" "[ $(peak_usage db_access) -eq 1 ]"
+check "задачи получили оба воркера" "grep -q 'воркеру $DIR/worker.sock' '$DIR/out.log' && grep -q 'воркеру 127.0.0.1:$PORT' '$DIR/out.log'"
+cat > "$DIR/workers_fail.yaml" << EOF
+job_fail:
+  command: "sleep 0.2; exit 3"
+  dependencies: []
+
+job_stubborn:
+  command: "trap '' TERM; sleep 45.1"
+  dependencies: []
+EOF
+elapsed=$(timed_run --workers "$DIR/worker.sock" "$DIR/workers_fail.yaml")
+check "ошибка отменяет задачи на воркере (${elapsed} мс)" "[ $(cat "$DIR/rc") -ne 0 ] && [ $elapsed -lt 5000 ]"
+check "на воркере не осталось процессов" "! pgrep -f '^sleep 45\.1' > /dev/null"
+if command -v python3 > /dev/null; then
+    #Заголовок RUN с размером почти 4 ГБ: воркер не ждет таких данных, а отключает собеседника
+    python3 -c "
+import socket, struct, sys
+client = socket.socket(socket.AF_UNIX)
+client.settimeout(2)
+client.connect(sys.argv[1])
+client.recv(16)
+client.sendall(struct.pack('IIIi', 1, 0xfffffff8, 0, 0) + bytes(4096))
+print('closed' if client.recv(16) == b'' else 'open')" "$DIR/worker.sock" > "$DIR/frame.txt" 2>&1
+    check "слишком большое сообщение отклонено, воркер работает" "grep -q '^closed$' '$DIR/frame.txt' && kill -0 $WORKER1"
+fi
+kill $WORKER1 $WORKER2
+wait $WORKER1 $WORKER2 2> /dev/null
+check "воркер удалил свой сокет" "[ ! -e '$DIR/worker.sock' ]"
+
+# Тест 17: Лимиты и учет через cgroup v2 (без cgroup - обычный запуск)
+echo -e "\nТест 17: Задачи в cgroup v2"
+cat > "$DIR/cgroups.yaml" << EOF
+job_limited:
+  command: "(sleep 46.1 &); i=0; while [ \$i -lt 50000 ]; do i=\$((i+1)); done"
+  cpu_max: 0.5
+  memory_max_mb: 64
+  dependencies: []
+
+job_after:
+  exec: [true]
+  dependencies: [job_limited]
+EOF
+"$EXECUTOR" --no-history --cgroups "$DIR/cgroups.yaml" > "$DIR/out.log" 2>&1
+check "DAG с --cgroups выполнен" "[ $? -eq 0 ]"
+if grep -q 'cgroup задач:' "$DIR/out.log"; then
+    CGROUP_PATH=$(sed -n 's/^cgroup задач: \([^ ]*\) .*/\1/p' "$DIR/out.log")
+    check "расход задачи прочитан из cgroup" "grep -q 'job_limited: cgroup: CPU' '$DIR/out.log'"
+    check "фоновый потомок задачи остановлен" "! pgrep -f '^sleep 46\.1' > /dev/null"
+    check "cgroup исполнителя удален" "[ ! -e '$CGROUP_PATH' ]"
+else
+    check "без cgroup v2 задачи запускаются как обычно" "grep -q 'cgroup v2 недоступны' '$DIR/out.log'"
+    pkill -f '^sleep 46\.1'
+fi
+
+# Тест 18: Продолжение прерванного DAG по журналу
+echo -e "\nТест 18: Журнал и --resume"
+rm -f "$DIR/resume.log" "$DIR/resume.yaml.journal"
+cat > "$DIR/resume.yaml" << EOF
+max_concurrent: 2
+
+job_a:
+  command: "echo a >> $DIR/resume.log"
+  dependencies: []
+
+job_b:
+  command: "[ -e $DIR/fixed ] || exit 1; echo b >> $DIR/resume.log"
+  dependencies: [job_a]
+
+job_c:
+  command: "echo c >> $DIR/resume.log"
+  dependencies: [job_b]
+EOF
+"$EXECUTOR" --no-history "$DIR/resume.yaml" > "$DIR/out.log" 2>&1
+check "первый запуск упал, журнал сохранен" "[ $? -ne 0 ] && [ -s '$DIR/resume.yaml.journal' ]"
+touch "$DIR/fixed"
+"$EXECUTOR" --no-history --resume "$DIR/resume.yaml" > "$DIR/out.log" 2>&1
+check "DAG продолжен и выполнен" "[ $? -eq 0 ] && grep -q 'уже выполнено задач: 1 из 3' '$DIR/out.log'"
+check "выполненная задача не перезапускалась" "[ \"\$(tr '\n' ' ' < '$DIR/resume.log')\" = 'a b c ' ]"
+check "журнал удален после успеха" "[ ! -e '$DIR/resume.yaml.journal' ]"
+cat > "$DIR/torn.yaml" << EOF
+job_a:
+  command: "[ -e $DIR/torn_a ]"
+  dependencies: []
+
+job_b:
+  command: "[ -e $DIR/torn_b ]"
+  dependencies: [job_a]
+EOF
+"$EXECUTOR" --no-history "$DIR/torn.yaml" > /dev/null 2>&1
+printf 'torn' >> "$DIR/torn.yaml.journal"
+touch "$DIR/torn_a"
+"$EXECUTOR" --no-history --resume "$DIR/torn.yaml" > /dev/null 2>&1
+touch "$DIR/torn_b"
+"$EXECUTOR" --no-history --resume "$DIR/torn.yaml" > "$DIR/out.log" 2>&1
+check "недописанная запись отрезается перед дозаписью" \
+    "[ $? -eq 0 ] && grep -q 'уже выполнено задач: 1 из 2' '$DIR/out.log'"
+cat > "$DIR/killed.yaml" << EOF
+job_a:
+  command: "echo a >> $DIR/killed.log"
+  dependencies: []
+
+job_long:
+  command: "[ -e $DIR/fast ] || sleep 47.1 && echo long >> $DIR/killed.log"
+  dependencies: [job_a]
+EOF
+"$EXECUTOR" --no-history "$DIR/killed.yaml" > /dev/null 2>&1 &
+pid=$!
+sleep 0.3
+kill -KILL $pid
+wait $pid 2> /dev/null
+pkill -f '^sleep 47\.1'
+touch "$DIR/fast"
+"$EXECUTOR" --no-history --resume "$DIR/killed.yaml" > "$DIR/out.log" 2>&1
+check "после kill -9 продолжена только незавершенная задача" "[ $? -eq 0 ] && [ \"\$(tr '\n' ' ' < '$DIR/killed.log')\" = 'a long ' ]"
+
+# Тест 19: Синтетические графы dag_gen и статистика --stats
+echo -e "\nТест 19: Генератор графов и --stats"
+for shape in layered fanout chain mutex; do
+    "$GEN" $shape 200 --seed 7 > "$DIR/gen_$shape.yaml"
+    "$EXECUTOR" --no-history --no-journal --stats "$DIR/gen_$shape.yaml" > "$DIR/out.log" 2>&1
+    check "граф $shape выполнен" "[ $? -eq 0 ] && [ \$(grep -c '^Задача .* завершена успешно' '$DIR/out.log') -eq 200 ]"
+done
+"$GEN" layered 200 --seed 7 | cmp -s - "$DIR/gen_layered.yaml"
+check "одинаковый seed дает одинаковый граф" "[ $? -eq 0 ]"
+check "--stats выводит задержку диспетчера" "grep -q 'Задержка диспетчера, мкс: p50' '$DIR/out.log'"
+check "--stats выводит нижнюю границу времени" "grep -q 'нижняя граница: .* отношение:' '$DIR/out.log'"
+
+# Тест 20: Короткие задачи в общем shell слота
+echo -e "\nТест 20: batchable: true"
+rm -f "$DIR/batch.log"
+echo "max_concurrent: 2" > "$DIR/batch.yaml"
+for i in $(seq 1 20); do
+    cat >> "$DIR/batch.yaml" << EOF
+
+batch$i:
+  command: "echo batch$i \\\$\\\$ >> $DIR/batch.log; cd /; x=leaked; exit 0"
+  batchable: true
+  dependencies: []
+EOF
+done
+cat >> "$DIR/batch.yaml" << EOF
+
+batch_last:
+  command: "[ \"\\\$(pwd)\" = \"$PWD\" ] && [ -z \"\\\$x\" ] && cat && echo last >> $DIR/batch.log"
+  batchable: true
+  dependencies: [batch20]
+EOF
+"$EXECUTOR" --no-history "$DIR/batch.yaml" > "$DIR/out.log" 2>&1
+check "DAG из batchable-задач выполнен" "[ $? -eq 0 ] && [ \$(wc -l < '$DIR/batch.log') -eq 21 ]"
+check "задачи выполнялись не больше чем в двух shell" \
+    "[ \$(grep batch '$DIR/batch.log' | awk '{ print \$2 }' | sort -u | wc -l) -le 2 ]"
+check "cd, переменные и stdin задачи не влияют на следующие" "grep -q '^last$' '$DIR/batch.log'"
+cat > "$DIR/batch_fail.yaml" << EOF
+batch_broken:
+  command: "echo \"unterminated"
+  batchable: true
+  dependencies: []
+EOF
+"$EXECUTOR" --no-history "$DIR/batch_fail.yaml" > "$DIR/out.log" 2>&1
+check "синтаксическая ошибка - ошибка задачи, а не зависание shell" \
+    "[ $? -ne 0 ] && grep -q 'batch_broken завершена с ошибкой (код: 2)' '$DIR/out.log'"
+cat > "$DIR/batch_timeout.yaml" << EOF
+batch_slow:
+  command: "sleep 43"
+  batchable: true
+  timeout: 0.3
+  dependencies: []
+
+batch_next:
+  command: "true"
+  batchable: true
+  dependencies: []
+EOF
+elapsed=$(timed_run "$DIR/batch_timeout.yaml")
+check "задача в общем shell остановлена по тайм-ауту (${elapsed} мс)" \
+    "[ $(cat "$DIR/rc") -ne 0 ] && [ $elapsed -lt 2000 ]"
+check "тайм-аут указан в выводе" "grep -q 'batch_slow завершена с сигналом 15 (тайм-аут)' '$DIR/out.log'"
+check "не осталось процессов задачи" "! pgrep -f '^sleep 43' > /dev/null"
+cat > "$DIR/batch_history.yaml" << EOF
+batch_measured:
+  command: "true"
+  dependencies: []
+EOF
+"$EXECUTOR" "$DIR/batch_history.yaml" > /dev/null 2>&1
+echo "  batchable: true" >> "$DIR/batch_history.yaml"
+"$EXECUTOR" "$DIR/batch_history.yaml" > /dev/null 2>&1
+"$EXECUTOR" --report "$DIR/batch_history.yaml" > "$DIR/out.log" 2>&1
+check "запуск в общем shell не обнуляет память в истории" \
+    "grep -q 'batch_measured: #1 -> #2' '$DIR/out.log' && ! grep -q 'память [0-9.]* -> 0.0 МБ' '$DIR/out.log'"
+
+if [ $FAILED -eq 0 ]; then
+    echo -e "\nТесты завершены: все пройдены"
+else
+    echo -e "\nТесты завершены: есть ошибки"
+fi
+exit $FAILED
@@ -5,6 +5,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#define TILE_COLS 256     //Ширина блока столбцов: строки окна по всему блоку помещаются в L1
+#define BENCH_SIZE 4096   //Размер матрицы для --bench по умолчанию
+
 //Структура для передачи данных в поток
 typedef struct {
     int **input;
@@ -16,6 +19,8 @@ typedef struct {
     int end_row;
     int iteration;
     int thread_id;
+    int reference;        //1 - исходное ядро get_median (для сравнения в --bench)
+    int verbose;          //Печатать ход работы потоков
     int *threads_completed;
     pthread_mutex_t *completed_mutex;
     pthread_cond_t *all_done_cond;
@@ -62,6 +67,207 @@ int get_median(int **matrix, int row, int col, int window_size, int rows, int co
     return matrix[row][col];
 }
 
+//Упорядочивание пары по возрастанию. После подстановки значения остаются
+//в регистрах, а сравнение компилируется в cmov, без условных переходов
+static inline void sort2(int *a, int *b) {
+    int x = *a, y = *b;
+    *a = x < y ? x : y;
+    *b = x < y ? y : x;
+}
+
+static inline int min2(int a, int b) {
+    return a < b ? a : b;
+}
+
+static inline int max2(int a, int b) {
+    return a < b ? b : a;
+}
+
+//Медиана трех значений без ветвлений
+static inline int median3(int a, int b, int c) {
+    return max2(min2(a, b), min2(max2(a, b), c));
+}
+
+//Выбор k-го по величине элемента (алгоритм Вирта): массив частично
+//переупорядочивается, полная сортировка не нужна
+int select_kth(int *values, int count, int k) {
+    int left = 0, right = count - 1;
+    while (left < right) {
+        int pivot = values[k];
+        int i = left, j = right;
+        do {
+            while (values[i] < pivot) i++;
+            while (pivot < values[j]) j--;
+            if (i <= j) {
+                int t = values[i];
+                values[i] = values[j];
+                values[j] = t;
+                i++;
+                j--;
+            }
+        } while (i <= j);
+        if (j < k) left = i;
+        if (k < i) right = j;
+    }
+    return values[k];
+}
+
+//Медиана для пикселя у края матрицы: окно обрезается по границам один раз,
+//а значения собираются в буфер потока. Результат совпадает с get_median:
+//элемент count / 2 по возрастанию
+int border_median(int **matrix, int row, int col, int window_size, int rows, int cols, int *scratch) {
+    int half = window_size / 2;
+    int r0 = row - half < 0 ? 0 : row - half;
+    int r1 = row + half >= rows ? rows - 1 : row + half;
+    int c0 = col - half < 0 ? 0 : col - half;
+    int c1 = col + half >= cols ? cols - 1 : col + half;
+    int count = 0;
+    
+    for (int r = r0; r <= r1; r++) {
+        for (int c = c0; c <= c1; c++) {
+            scratch[count++] = matrix[r][c];
+        }
+    }
+    return select_kth(scratch, count, count / 2);
+}
+
+//Медианы окна 3x3 для строки row в столбцах [from, to). Каждый столбец окна
+//сортируется один раз и служит трем соседним пикселям, а медиана девяти
+//значений - медиана из максимума минимумов, медианы средних и минимума
+//максимумов трех столбцов
+void median3x3_row(int **input, int *out, int row, int from, int to) {
+    const int *up = input[row - 1], *mid = input[row], *down = input[row + 1];
+    int lo[3], md[3], hi[3];
+    
+    //Столбцы from - 1 и from; столбец j + 1 добавляется в цикле
+    for (int k = 1; k < 3; k++) {
+        int a = up[from - 2 + k], b = mid[from - 2 + k], c = down[from - 2 + k];
+        sort2(&a, &b);
+        sort2(&b, &c);
+        sort2(&a, &b);
+        lo[k] = a;
+        md[k] = b;
+        hi[k] = c;
+    }
+    
+    for (int j = from; j < to; j++) {
+        //Сдвиг окна на столбец j + 1
+        int a = up[j + 1], b = mid[j + 1], c = down[j + 1];
+        sort2(&a, &b);
+        sort2(&b, &c);
+        sort2(&a, &b);
+        lo[0] = lo[1]; lo[1] = lo[2]; lo[2] = a;
+        md[0] = md[1]; md[1] = md[2]; md[2] = b;
+        hi[0] = hi[1]; hi[1] = hi[2]; hi[2] = c;
+        
+        out[j] = median3(max2(max2(lo[0], lo[1]), lo[2]),
+                         median3(md[0], md[1], md[2]),
+                         min2(min2(hi[0], hi[1]), hi[2]));
+    }
+}
+
+//Медиана окна 5x5 внутри матрицы: сеть из 99 сравнений (N. Devillard,
+//opt_med25), которая ставит на место только центральный элемент
+int median5x5(int **input, int row, int col) {
+    int p[25];
+    for (int i = 0; i < 5; i++) {
+        const int *line = input[row - 2 + i] + col - 2;
+        for (int j = 0; j < 5; j++) {
+            p[i * 5 + j] = line[j];
+        }
+    }
+    
+    sort2(&p[0], &p[1]);   sort2(&p[3], &p[4]);   sort2(&p[2], &p[4]);   sort2(&p[2], &p[3]);
+    sort2(&p[6], &p[7]);   sort2(&p[5], &p[7]);   sort2(&p[5], &p[6]);   sort2(&p[9], &p[10]);
+    sort2(&p[8], &p[10]);  sort2(&p[8], &p[9]);   sort2(&p[12], &p[13]); sort2(&p[11], &p[13]);
+    sort2(&p[11], &p[12]); sort2(&p[15], &p[16]); sort2(&p[14], &p[16]); sort2(&p[14], &p[15]);
+    sort2(&p[18], &p[19]); sort2(&p[17], &p[19]); sort2(&p[17], &p[18]); sort2(&p[21], &p[22]);
+    sort2(&p[20], &p[22]); sort2(&p[20], &p[21]); sort2(&p[23], &p[24]); sort2(&p[2], &p[5]);
+    sort2(&p[3], &p[6]);   sort2(&p[0], &p[6]);   sort2(&p[0], &p[3]);   sort2(&p[4], &p[7]);
+    sort2(&p[1], &p[7]);   sort2(&p[1], &p[4]);   sort2(&p[11], &p[14]); sort2(&p[8], &p[14]);
+    sort2(&p[8], &p[11]);  sort2(&p[12], &p[15]); sort2(&p[9], &p[15]);  sort2(&p[9], &p[12]);
+    sort2(&p[13], &p[16]); sort2(&p[10], &p[16]); sort2(&p[10], &p[13]); sort2(&p[20], &p[23]);
+    sort2(&p[17], &p[23]); sort2(&p[17], &p[20]); sort2(&p[21], &p[24]); sort2(&p[18], &p[24]);
+    sort2(&p[18], &p[21]); sort2(&p[19], &p[22]); sort2(&p[8], &p[17]);  sort2(&p[9], &p[18]);
+    sort2(&p[0], &p[18]);  sort2(&p[0], &p[9]);   sort2(&p[10], &p[19]); sort2(&p[1], &p[19]);
+    sort2(&p[1], &p[10]);  sort2(&p[11], &p[20]); sort2(&p[2], &p[20]);  sort2(&p[2], &p[11]);
+    sort2(&p[12], &p[21]); sort2(&p[3], &p[21]);  sort2(&p[3], &p[12]);  sort2(&p[13], &p[22]);
+    sort2(&p[4], &p[22]);  sort2(&p[4], &p[13]);  sort2(&p[14], &p[23]); sort2(&p[5], &p[23]);
+    sort2(&p[5], &p[14]);  sort2(&p[15], &p[24]); sort2(&p[6], &p[24]);  sort2(&p[6], &p[15]);
+    sort2(&p[7], &p[16]);  sort2(&p[7], &p[19]);  sort2(&p[13], &p[21]); sort2(&p[15], &p[23]);
+    sort2(&p[7], &p[13]);  sort2(&p[7], &p[15]);  sort2(&p[1], &p[9]);   sort2(&p[3], &p[11]);
+    sort2(&p[5], &p[17]);  sort2(&p[11], &p[17]); sort2(&p[9], &p[17]);  sort2(&p[4], &p[10]);
+    sort2(&p[6], &p[12]);  sort2(&p[7], &p[14]);  sort2(&p[4], &p[6]);   sort2(&p[4], &p[7]);
+    sort2(&p[12], &p[14]); sort2(&p[10], &p[14]); sort2(&p[6], &p[7]);   sort2(&p[10], &p[12]);
+    sort2(&p[6], &p[10]);  sort2(&p[6], &p[17]);  sort2(&p[12], &p[17]); sort2(&p[7], &p[17]);
+    sort2(&p[7], &p[10]);  sort2(&p[12], &p[18]); sort2(&p[7], &p[12]);  sort2(&p[10], &p[18]);
+    sort2(&p[12], &p[20]); sort2(&p[10], &p[20]); sort2(&p[10], &p[12]);
+    return p[12];
+}
+
+//Медианы внутренних пикселей строки row в столбцах [from, to): окно целиком
+//внутри матрицы, проверок границ нет
+void filter_interior(int **input, int *out, int row, int from, int to, int window_size, int *scratch) {
+    if (window_size == 3) {
+        median3x3_row(input, out, row, from, to);
+        return;
+    }
+    if (window_size == 5) {
+        for (int j = from; j < to; j++) {
+            out[j] = median5x5(input, row, j);
+        }
+        return;
+    }
+    
+    int half = window_size / 2;
+    int count = window_size * window_size;
+    for (int j = from; j < to; j++) {
+        int n = 0;
+        for (int r = row - half; r <= row + half; r++) {
+            const int *line = input[r] + j - half;
+            for (int c = 0; c < window_size; c++) {
+                scratch[n++] = line[c];
+            }
+        }
+        out[j] = select_kth(scratch, count, count / 2);
+    }
+}
+
+//Медианный фильтр для строк [start_row, end_row]. Края обрабатываются
+//отдельно через border_median, а внутренняя часть - блоками по TILE_COLS
+//столбцов: соседние строки одного блока используют те же строки окна,
+//пока они еще в кэше
+void filter_rows(int **input, int **output, int rows, int cols, int window_size,
+                 int start_row, int end_row, int *scratch) {
+    int half = window_size / 2;
+    int first = start_row > half ? start_row : half;          //Строки, у которых окно
+    int last = end_row < rows - 1 - half ? end_row : rows - 1 - half; //целиком внутри
+    int inner_cols = cols - 2 * half;
+    
+    for (int i = start_row; i <= end_row; i++) {
+        if (i < first || i > last || inner_cols <= 0) {
+            for (int j = 0; j < cols; j++) {
+                output[i][j] = border_median(input, i, j, window_size, rows, cols, scratch);
+            }
+            continue;
+        }
+        for (int j = 0; j < half; j++) {
+            output[i][j] = border_median(input, i, j, window_size, rows, cols, scratch);
+            output[i][cols - 1 - j] = border_median(input, i, cols - 1 - j, window_size, rows, cols, scratch);
+        }
+    }
+    
+    if (inner_cols <= 0) {
+        return;
+    }
+    for (int from = half; from < cols - half; from += TILE_COLS) {
+        int to = from + TILE_COLS < cols - half ? from + TILE_COLS : cols - half;
+        for (int i = first; i <= last; i++) {
+            filter_interior(input, output[i], i, from, to, window_size, scratch);
+        }
+    }
+}
+
 //Функция, выполняемая в каждом потоке
 void* process_rows(void *arg) {
     ThreadData *data = (ThreadData*)arg;
@@ -69,17 +275,27 @@ void* process_rows(void *arg) {
     //Блокировка для подсчета активных потоков
     pthread_mutex_lock(&mutex);
     active_threads++;
-    printf("Поток %d начал работу. Активных потоков: %d\n", 
-           data->thread_id, active_threads);
+    if (data->verbose) {
+        printf("Поток %d начал работу. Активных потоков: %d\n", 
+               data->thread_id, active_threads);
+    }
     pthread_mutex_unlock(&mutex);
     
     //Обработка назначенных строк
-    for (int i = data->start_row; i <= data->end_row; i++) {
-        for (int j = 0; j < data->cols; j++) {
-            data->output[i][j] = get_median(data->input, i, j, 
-                                           data->window_size, 
-                                           data->rows, data->cols);
+    if (data->reference) {
+        for (int i = data->start_row; i <= data->end_row; i++) {
+            for (int j = 0; j < data->cols; j++) {
+                data->output[i][j] = get_median(data->input, i, j, 
+                                               data->window_size, 
+                                               data->rows, data->cols);
+            }
         }
+    } else {
+        //Буфер окна выделяется один раз на поток, а не на каждый пиксель
+        int *scratch = malloc(data->window_size * data->window_size * sizeof(int));
+        filter_rows(data->input, data->output, data->rows, data->cols, data->window_size,
+                    data->start_row, data->end_row, scratch);
+        free(scratch);
     }
     
     //Отметка о завершении работы потока
@@ -102,8 +318,10 @@ void* process_rows(void *arg) {
     //Блокировка для уменьшения счетчика активных потоков
     pthread_mutex_lock(&mutex);
     active_threads--;
-    printf("Поток %d завершил итерацию %d. Активных потоков: %d\n", 
-           data->thread_id, data->iteration, active_threads);
+    if (data->verbose) {
+        printf("Поток %d завершил итерацию %d. Активных потоков: %d\n", 
+               data->thread_id, data->iteration, active_threads);
+    }
     pthread_mutex_unlock(&mutex);
     
     return NULL;
@@ -155,54 +373,20 @@ void copy_matrix(int **src, int **dst, int rows, int cols) {
     }
 }
 
-int main(int argc, char *argv[]) {
-    //Проверка аргументов командной строки
-    if (argc < 4) {
-        return 1;
-    }
-    
-    //Чтение параметров
-    max_threads = atoi(argv[1]);
-    int window_size = atoi(argv[2]);
-    int K = atoi(argv[3]);
-    
-    if (max_threads <= 0 || window_size % 2 == 0 || window_size < 3 || K <= 0) {
-        printf("Ошибка: некорректные параметры!\n");
-        printf("  max_threads должно быть > 0\n");
-        printf("  window_size должно быть нечетным числом >= 3\n");
-        printf("  K должно быть > 0\n");
-        return 1;
-    }
-    
-    //Размеры матрицы
-    int rows = 20;
-    int cols = 20;
-    
-    //Проверка, что потоков не больше, чем строк
-    if (max_threads > rows) {
-        max_threads = rows;
-        printf("Внимание: уменьшено количество потоков до %d (количество строк)\n", max_threads);
-    }
-    
-    //Создание матриц
-    int **current = create_matrix(rows, cols);
-    int **temp = create_matrix(rows, cols);
-    
-    //Генерация исходной матрицы
-    generate_random_matrix(current, rows, cols);
-    
-    printf("Максимальное количество потоков: %d\n", max_threads);
-    printf("Размер окна: %d\n", window_size);
-    printf("Количество итераций: %d\n", K);
-    printf("Размер матрицы: %d x %d\n", rows, cols);
-    printf("PID процесса: %d\n", getpid());
-    
-    printf("\nИсходная матрица:\n");
-    print_matrix(current, rows, cols);
-    
-    //Основной цикл итераций
+//Текущее время в секундах (для --bench)
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//K итераций фильтра. Результат каждой итерации копируется обратно в current
+void run_filter(int **current, int **temp, int rows, int cols, int window_size, int K,
+                int reference, int verbose) {
     for (int iter = 0; iter < K; iter++) {
-        printf("Итерация %d\n", iter + 1);
+        if (verbose) {
+            printf("Итерация %d\n", iter + 1);
+        }
         
         //Создание переменных для синхронизации
         int threads_completed = 0;
@@ -227,6 +411,8 @@ int main(int argc, char *argv[]) {
             thread_data[i].window_size = window_size;
             thread_data[i].iteration = iter + 1;
             thread_data[i].thread_id = i;
+            thread_data[i].reference = reference;
+            thread_data[i].verbose = verbose;
             thread_data[i].threads_completed = &threads_completed;
             thread_data[i].completed_mutex = &completed_mutex;
             thread_data[i].all_done_cond = &all_done_cond;
@@ -237,8 +423,10 @@ int main(int argc, char *argv[]) {
             thread_data[i].end_row = current_row + rows_per_thread + extra - 1;
             current_row = thread_data[i].end_row + 1;
             
-            printf("Поток %d обрабатывает строки %d-%d\n", 
-                   i, thread_data[i].start_row, thread_data[i].end_row);
+            if (verbose) {
+                printf("Поток %d обрабатывает строки %d-%d\n", 
+                       i, thread_data[i].start_row, thread_data[i].end_row);
+            }
         }
         
         //Создание потоков
@@ -246,7 +434,9 @@ int main(int argc, char *argv[]) {
             pthread_create(&threads[i], NULL, process_rows, &thread_data[i]);
             
             //Небольшая задержка для наглядного порядка создания потоков
-            usleep(1000);
+            if (verbose) {
+                usleep(1000);
+            }
         }
         
         //Ожидание завершения всех потоков
@@ -261,14 +451,123 @@ int main(int argc, char *argv[]) {
         pthread_mutex_destroy(&completed_mutex);
         pthread_cond_destroy(&all_done_cond);
         
-        printf("\nМатрица после итерации %d:\n", iter + 1);
-        print_matrix(current, rows, cols);
+        if (verbose) {
+            printf("\nМатрица после итерации %d:\n", iter + 1);
+            print_matrix(current, rows, cols);
+        }
+    }
+}
+
+//Сравнение нового ядра с исходным (get_median + qsort) на матрице size x size:
+//обе версии обрабатывают одну и ту же случайную матрицу, результат должен совпасть
+int run_benchmark(int size, int window_size, int K) {
+    int **current = create_matrix(size, size);
+    int **temp = create_matrix(size, size);
+    int **reference = create_matrix(size, size);
+    int **reference_temp = create_matrix(size, size);
+    generate_random_matrix(current, size, size);
+    copy_matrix(current, reference, size, size);
+    
+    printf("Бенчмарк: матрица %d x %d, окно %d, итераций %d, потоков %d\n",
+           size, size, window_size, K, max_threads);
+    
+    double start = now_seconds();
+    run_filter(reference, reference_temp, size, size, window_size, K, 1, 0);
+    double reference_time = now_seconds() - start;
+    printf("  Исходное ядро (malloc + qsort на пиксель): %.3f с\n", reference_time);
+    
+    start = now_seconds();
+    run_filter(current, temp, size, size, window_size, K, 0, 0);
+    double kernel_time = now_seconds() - start;
+    printf("  Новое ядро: %.3f с, ускорение %.1f раз\n", kernel_time,
+           kernel_time > 0 ? reference_time / kernel_time : 0);
+    
+    int mismatches = 0;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            if (current[i][j] != reference[i][j] && mismatches++ == 0) {
+                printf("  Ошибка: результаты различаются в (%d, %d): %d и %d\n",
+                       i, j, current[i][j], reference[i][j]);
+            }
+        }
+    }
+    if (mismatches == 0) {
+        printf("  Результаты совпадают\n");
+    }
+    
+    free_matrix(current, size);
+    free_matrix(temp, size);
+    free_matrix(reference, size);
+    free_matrix(reference_temp, size);
+    return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    //Проверка аргументов командной строки
+    if (argc < 4) {
+        printf("Использование: %s <max_threads> <window_size> <K> [--bench [размер]]\n", argv[0]);
+        return 1;
     }
     
+    //Чтение параметров
+    max_threads = atoi(argv[1]);
+    int window_size = atoi(argv[2]);
+    int K = atoi(argv[3]);
+    
+    if (max_threads <= 0 || window_size % 2 == 0 || window_size < 3 || K <= 0) {
+        printf("Ошибка: некорректные параметры!\n");
+        printf("  max_threads должно быть > 0\n");
+        printf("  window_size должно быть нечетным числом >= 3\n");
+        printf("  K должно быть > 0\n");
+        return 1;
+    }
+    
+    //Размеры матрицы
+    int rows = 20;
+    int cols = 20;
+    
+    //Режим сравнения ядер на большой матрице
+    int bench = argc > 4 && strcmp(argv[4], "--bench") == 0;
+    if (bench) {
+        rows = cols = argc > 5 ? atoi(argv[5]) : BENCH_SIZE;
+        if (rows < 1) {
+            printf("Ошибка: размер матрицы должен быть > 0\n");
+            return 1;
+        }
+    }
+    
+    //Проверка, что потоков не больше, чем строк
+    if (max_threads > rows) {
+        max_threads = rows;
+        printf("Внимание: уменьшено количество потоков до %d (количество строк)\n", max_threads);
+    }
+    
+    if (bench) {
+        return run_benchmark(rows, window_size, K);
+    }
+    
+    //Создание матриц
+    int **current = create_matrix(rows, cols);
+    int **temp = create_matrix(rows, cols);
+    
+    //Генерация исходной матрицы
+    generate_random_matrix(current, rows, cols);
+    
+    printf("Максимальное количество потоков: %d\n", max_threads);
+    printf("Размер окна: %d\n", window_size);
+    printf("Количество итераций: %d\n", K);
+    printf("Размер матрицы: %d x %d\n", rows, cols);
+    printf("PID процесса: %d\n", getpid());
+    
+    printf("\nИсходная матрица:\n");
+    print_matrix(current, rows, cols);
+    
+    //Основной цикл итераций
+    run_filter(current, temp, rows, cols, window_size, K, 0, 1);
+    
     //Освобождение памяти
     free_matrix(current, rows);
     free_matrix(temp, rows);
     
     return 0;
 }
-